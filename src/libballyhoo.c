@@ -21,7 +21,9 @@
 #include "libballyhoo_deferred.h"
 #include "libballyhoo_xml.h"
 #include "libballyhoo_deflate.h"
+#include "libballyhoo_helo.h"
 #include "libballyhoo_message.h"
+#include "libballyhoo_sched.h"
 #include "libcmf.h"
 #include "librcl.h"
 
@@ -29,6 +31,17 @@
 #include <stddef.h>
 #include <sslconn.h>
 #include <debug.h>
+#include <eventloop.h>
+
+/* a message whose headers were parsed from its first chunk,
+ *  while the rest of its chunks arrive */
+typedef struct _BallyhooIncoming {
+  guint64 uuid;
+  size_t offset; /* where the body starts in the put back together message */
+  size_t length; /* of the body */
+  size_t remaining; /* compressed bytes still to come */
+  BallyhooInflater *inflater; /* deflate messages are inflated as they arrive */
+} BallyhooIncoming;
 
 static void libballyhoo_connect_cb_ssl(gpointer data, PurpleSslConnection *gsc,
                                        PurpleInputCondition cond);
@@ -38,39 +51,114 @@ static void libballyhoo_connect_cb_ssl_failure(PurpleSslConnection *gsc,
 
 static void libballyhoo_handle_input_cb(gpointer data, PurpleSslConnection *gsc,
                                         PurpleInputCondition cond);
-gpointer read_raw(PurpleSslConnection *gsc, size_t len);
-gpointer read_until_null(PurpleSslConnection *gsc, size_t max_size);
+static void libballyhoo_handle_frame(BallyhooAccount *ba, const guchar *buffer,
+                                     const CMFFrame *frame);
+static void libballyhoo_handle_message(BallyhooAccount *ba,
+                                       const BallyhooSlice *message);
+static void libballyhoo_handle_xml(BallyhooAccount *ba, guint64 uuid,
+                                   const BallyhooSlice *xml);
+static gboolean libballyhoo_begin_message(BallyhooAccount *ba, const guchar *payload,
+                                          const CMFFrame *frame);
+static void libballyhoo_continue_message(BallyhooAccount *ba, BallyhooIncoming *s,
+                                         const guchar *payload, const CMFFrame *frame);
+static void libballyhoo_continue_inflate(BallyhooAccount *ba, BallyhooIncoming *s,
+                                         const guchar *payload, const CMFFrame *frame);
+static BallyhooInflater *libballyhoo_take_inflater(BallyhooAccount *ba, size_t length);
+static void libballyhoo_return_inflater(BallyhooAccount *ba, BallyhooInflater *i);
+static void libballyhoo_incoming_free(BallyhooIncoming *s);
+static void libballyhoo_close_malformed(BallyhooAccount *ba);
+static gboolean libballyhoo_handle_helo(BallyhooAccount *ba);
+static void libballyhoo_queue_raw(BallyhooAccount *ba, gconstpointer data,
+                                  size_t length);
+static void libballyhoo_queue_raw_cb(gconstpointer data, size_t length,
+                                     gpointer user_data);
+static size_t libballyhoo_queued(BallyhooAccount *ba);
+static void libballyhoo_arm_expire_timer(BallyhooAccount *ba);
+static gboolean libballyhoo_expire_cb(gpointer data);
+static void libballyhoo_expire_deferreds(BallyhooAccount *ba);
+static void libballyhoo_fire_deferred(BallyhooAccount *ba, guint64 uuid, Deferred *dfr,
+                                      gboolean success, gpointer result);
+static void libballyhoo_schedule_flush(BallyhooAccount *ba);
 void libballyhoo_handle_method_call(BallyhooAccount *ba, guint64 uuid,
                                     BallyhooXMLRPC *brpc);
-GList *libballyhoo_encode_method_response(guint64 uuid, gpointer message);
+static void libballyhoo_frame_message(BallyhooAccount *ba, BallyhooOutMessage *m);
+static BallyhooOutMessage *libballyhoo_encode_method_call_va(guint64 *uuid,
+                                                             int priority,
+                                                             const char *method_name,
+                                                             const char *format,
+                                                             va_list args);
+static gboolean libballyhoo_flush_cb(gpointer data);
+static void libballyhoo_writable_cb(gpointer data, gint source,
+                                    PurpleInputCondition cond);
+static void libballyhoo_reset_outbuf(BallyhooAccount *ba);
 
 BallyhooAccount* libballyhoo_start()
 {
   BallyhooAccount* ba = g_new0(BallyhooAccount, 1);
   ba->authenticated = FALSE;
-  ba->pending_callbacks = g_hash_table_new(g_int64_hash, g_int64_equal);
-  ba->inbuf_len = 32768;
-  ba->inbuf_used = 0;
-  ba->inbuf = g_malloc0(ba->inbuf_len);
-  ba->decoded_chunks = g_hash_table_new(g_direct_hash, g_direct_equal);
+  ba->pending_callbacks = libballyhoo_pending_new();
+  ba->timers = libballyhoo_timers_new();
+  ba->inbuf = libballyhoo_ringbuf_new(LIBBALLYHOO_INBUF_SIZE, LIBBALLYHOO_INBUF_MAX);
+  ba->outbuf = libballyhoo_ringbuf_new(LIBBALLYHOO_OUTBUF_SIZE, LIBBALLYHOO_OUTBUF_MAX);
+  ba->scheduler = libballyhoo_scheduler_new();
+  ba->templates = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)libballyhoo_out_template_free);
+  ba->decoded_chunks = libcmf_reassembler_new();
+  ba->incoming = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                       (GDestroyNotify)libballyhoo_incoming_free);
+  ba->inflaters = g_queue_new();
 
   // register some signals
   purple_signal_register(ba, LIBBALLYHOO_SIGNAL_CONNECTED,
                          purple_marshal_VOID__POINTER, NULL, 1,
                          purple_value_new(PURPLE_TYPE_SUBTYPE, PURPLE_SUBTYPE_CONNECTION));
+  purple_signal_register(ba, LIBBALLYHOO_SIGNAL_WRITABLE,
+                         purple_marshal_VOID__POINTER, NULL, 1,
+                         purple_value_new(PURPLE_TYPE_SUBTYPE, PURPLE_SUBTYPE_CONNECTION));
 
   return ba;
 }
 
+static void libballyhoo_collect_uuid(guint64 uuid, gpointer value, gpointer user_data)
+{
+  g_array_append_val((GArray*)user_data, uuid);
+}
+
 void libballyhoo_shutdown(BallyhooAccount* ba)
 {
+  // nobody will see the answers to anything still waiting,
+  //  so cancel it and everything chained to it
+  GArray *uuids = g_array_new(FALSE, FALSE, sizeof(guint64));
+  libballyhoo_pending_foreach(ba->pending_callbacks, libballyhoo_collect_uuid, uuids);
+  for (guint i = 0; i < uuids->len; i++) {
+    // an earlier one may have taken it with it
+    Deferred *dfr = libballyhoo_pending_lookup(ba->pending_callbacks,
+                                               g_array_index(uuids, guint64, i));
+    if (dfr) {
+      libballyhoo_deferred_cancel(ba, dfr);
+    }
+  }
+  g_array_free(uuids, TRUE);
+
   // clean up the BallyhooAccount
-  g_hash_table_destroy(ba->pending_callbacks);
-  g_hash_table_destroy(ba->decoded_chunks);
-  g_free(ba->inbuf);
+  libballyhoo_pending_free(ba->pending_callbacks);
+  if (ba->expire_timer) {
+    purple_timeout_remove(ba->expire_timer);
+  }
+  libballyhoo_timers_free(ba->timers);
+  libcmf_reassembler_free(ba->decoded_chunks);
+  g_hash_table_destroy(ba->incoming);
+  g_queue_free_full(ba->inflaters, (GDestroyNotify)libballyhoo_inflater_free);
+  libballyhoo_ringbuf_free(ba->inbuf);
+  libballyhoo_reset_outbuf(ba);
+  libballyhoo_ringbuf_free(ba->outbuf);
+  libballyhoo_scheduler_free(ba->scheduler);
+  g_hash_table_destroy(ba->templates);
+  libballyhoo_helo_free(ba->helo);
 
   // unregister signals
   purple_signal_unregister(ba, LIBBALLYHOO_SIGNAL_CONNECTED);
+  purple_signal_unregister(ba, LIBBALLYHOO_SIGNAL_WRITABLE);
 
   g_free(ba);
 }
@@ -84,6 +172,9 @@ void libballyhoo_connect(PurpleAccount *acct, BallyhooAccount *ballyhoo_account,
   gc = purple_account_get_connection(acct);
   
   ballyhoo_account->gc = gc;
+
+  // anything queued for an old connection is gone
+  libballyhoo_reset_outbuf(ballyhoo_account);
   
   ssl = purple_ssl_connect(acct,
                            BALLYHOO_SERVER,
@@ -100,191 +191,262 @@ void libballyhoo_connect(PurpleAccount *acct, BallyhooAccount *ballyhoo_account,
 void libballyhoo_update(BallyhooAccount *ba)
 {
   purple_debug_info("helplightning", "libballyhoo_update\n");
-  
-  // execute any expired deferreds
-  time_t now = time(NULL);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  GList *keys_to_remove = NULL;
-  
-  g_hash_table_iter_init(&iter, ba->pending_callbacks);
-  while (g_hash_table_iter_next(&iter, &key, &value)) {
-    Deferred *dfr = value;
-    if (dfr->expiration < now && !dfr->is_firing) {
-      purple_debug_info("helplightning", "found expired callback %p\n", key);
-      // we have an expiration. 
-      // kick off the errback and add this to the to_remove
-      keys_to_remove = g_list_append(keys_to_remove, key);
-    }
-  }
-
-  GList *it = keys_to_remove;
-  while (it) {
-    Deferred *dfr = g_hash_table_lookup(ba->pending_callbacks, it->data);
-    if (dfr) {
-      purple_debug_info("helplightning", "kicking off expired errbacks for %p\n", it->data);
 
-      // create an xmlrpc fault
-      BallyhooXMLRPC *fault = libballyhoo_xml_create_fault(0, "Timeout");
-      
-      DeferredResponse *r = libballyhoo_deferred_errback(dfr, ba, fault);
-      if (r->type != DEFERRED_DEFERRED) {
-        g_free(r);
-        g_free(dfr);
-      }
-      g_free(fault);
-    }
-    
-    g_hash_table_remove(ba->pending_callbacks, it->data);
-    
-    it = it->next;
-  }
+  // in case the main loop ran late
+  libballyhoo_expire_deferreds(ba);
 
-  g_list_free(keys_to_remove);
+  // give back any memory a large burst made us grab
+  libballyhoo_ringbuf_shrink(ba->inbuf);
 }
 
 
-GList *libballyhoo_encode_method_call(guint64 *uuid,
-                                      const char *method_name,
-                                      const char *format,
-                                      ...)
+BallyhooOutMessage *libballyhoo_encode_method_call(guint64 *uuid,
+                                                   const char *method_name,
+                                                   const char *format,
+                                                   ...)
 {
   va_list args;
   va_start(args, format);
+  BallyhooOutMessage *m = libballyhoo_encode_method_call_va(uuid, LIBBALLYHOO_PRIORITY_DEFAULT,
+                                                            method_name, format, args);
+  va_end(args);
 
-  gpointer message = libballyhoo_xml_encode_request(method_name, format, args);
+  return m;
+}
+
+BallyhooOutMessage *libballyhoo_encode_method_call_priority(guint64 *uuid,
+                                                            int priority,
+                                                            const char *method_name,
+                                                            const char *format,
+                                                            ...)
+{
+  va_list args;
+  va_start(args, format);
+  BallyhooOutMessage *m = libballyhoo_encode_method_call_va(uuid, priority,
+                                                            method_name, format, args);
   va_end(args);
-  
-  size_t message_size = strlen(message) - 1; // remove null at end
-  purple_debug_info("helplightning", "size %zu\n", message_size);
 
-  gpointer full_message = g_strdup_printf("message-length: %zu\r\nencoding: text\r\ncontent-type: message\r\nx-helplightning-api-key: %s\r\n\r\n%s",
-                                          message_size, BALLYHOO_API_KEY,
-                                          (unsigned char*)message);
-  // free the xml message
-  g_free(message);
-  
-  // encode into librcl
-  size_t rcl_size;
-  gpointer rcl_encoded = librcl_encode_request(full_message, strlen(full_message), uuid, &rcl_size);
-  g_free(full_message);
+  return m;
+}
+
+static BallyhooOutMessage *libballyhoo_encode_method_call_va(guint64 *uuid,
+                                                             int priority,
+                                                             const char *method_name,
+                                                             const char *format,
+                                                             va_list args)
+{
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
 
-  // encode into chunks
-  purple_debug_info("helplightning", "encoding cmf for buffer size %ld\n", rcl_size);
-  GList *encoded_chunks = libcmf_encode(rcl_encoded, rcl_size);
+  // serialize straight into the message buffer
+  libballyhoo_xml_append_request(libballyhoo_out_message_body(m),
+                                 method_name, format, args);
 
-  g_free(rcl_encoded);
+  // it is framed once we know how it will be sent
+  *uuid = librcl_generate_uuid();
+  m->uuid = *uuid;
+  m->response = FALSE;
+  m->priority = priority;
 
-  return encoded_chunks;
+  return m;
 }
 
-GList *libballyhoo_encode_method_responseb(guint64 uuid, gboolean response)
+BallyhooOutMessage *libballyhoo_encode_method_responseb(guint64 uuid, gboolean response)
 {
-  gpointer message = libballyhoo_xml_encode_responseb(response);
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
+  libballyhoo_xml_append_responseb(libballyhoo_out_message_body(m), response);
+
+  // the server is waiting on our answer
+  m->uuid = uuid;
+  m->response = TRUE;
+  m->priority = LIBBALLYHOO_PRIORITY_INTERACTIVE;
 
-  return libballyhoo_encode_method_response(uuid, message);
+  return m;
 }
 
-GList *libballyhoo_encode_method_response(guint64 uuid, gpointer message)
+/**
+ * Compress the xml in m if the server allows it, put the
+ *  ballyhoo and rcl headers in front of it, and split it
+ *  into cmf chunks.
+ */
+static void libballyhoo_frame_message(BallyhooAccount *ba, BallyhooOutMessage *m)
 {
-  size_t message_size = strlen(message) - 1; // remove null at end
-
-  gpointer full_message = g_strdup_printf("message-length: %zu\r\nencoding: text\r\ncontent-type: message\r\nx-helplightning-api-key: %s\r\n\r\n%s",
-                                          message_size, BALLYHOO_API_KEY,
-                                          (unsigned char*)message);
-  // free the xml message
-  g_free(message);
+  // the xml is sent without its final newline
+  GString *body = libballyhoo_out_message_body(m);
+  size_t message_size = libballyhoo_out_message_length(m) - 1;
+  g_string_truncate(body, body->len - 1);
+  purple_debug_info("helplightning", "size %zu\n", message_size);
 
-  // encode into librcl
-  size_t rcl_size;
-  gpointer rcl_encoded = librcl_encode_response(full_message, strlen(full_message), uuid, &rcl_size);
-  g_free(full_message);
+  const char *encoding = "text";
+  size_t deflate_min = ba->deflate_dictionary ?
+    LIBBALLYHOO_DEFLATE_DICTIONARY_MIN : LIBBALLYHOO_DEFLATE_MIN;
+  if (ba->deflate && message_size >= deflate_min) {
+    GString *compressed = g_string_sized_new(message_size);
+    if (libballyhoo_deflate_compress(body->str + m->start, message_size, compressed,
+                                     ba->deflate_dictionary)) {
+      g_string_truncate(body, m->start);
+      g_string_append_len(body, compressed->str, compressed->len);
+      message_size = compressed->len;
+      encoding = "deflate";
+    }
+    g_string_free(compressed, TRUE);
+  }
 
-  // encode into chunks
-  GList *encoded_chunks = libcmf_encode(rcl_encoded, rcl_size);
+  char headers[LIBBALLYHOO_OUT_HEADROOM];
+  int headers_size = g_snprintf(headers, sizeof(headers),
+                                "message-length: %zu\r\nencoding: %s\r\ncontent-type: message\r\nx-helplightning-api-key: %s\r\n\r\n",
+                                message_size, encoding, BALLYHOO_API_KEY);
+  memcpy(libballyhoo_out_message_prepend(m, headers_size), headers, headers_size);
 
-  g_free(rcl_encoded);
+  librcl_write_header(libballyhoo_out_message_prepend(m, LIBRCL_HEADER_SIZE),
+                      m->uuid, m->response, FALSE);
 
-  return encoded_chunks;
+  libballyhoo_out_message_frame(m, m->priority);
+  purple_debug_info("helplightning", "encoded %d cmf segments\n", m->segment_count);
 }
 
 void libballyhoo_add_deferred(BallyhooAccount *ba,
                               guint64 uuid, Deferred *dfr)
 {
-  guint64 *hash = g_malloc(sizeof(guint64));
-  *hash = uuid;
+  libballyhoo_pending_insert(ba->pending_callbacks, uuid, dfr);
+
+  dfr->uuid = uuid;
+  libballyhoo_timers_add(ba->timers, &dfr->timer);
+  libballyhoo_arm_expire_timer(ba);
+}
+
+/**
+ * Make sure the purple timeout fires by the earliest
+ *  deadline. It's only moved when that gets earlier, if
+ *  it fires early it just waits again.
+ */
+static void libballyhoo_arm_expire_timer(BallyhooAccount *ba)
+{
+  BallyhooTimer *next = libballyhoo_timers_peek(ba->timers);
+  if (next == NULL || (ba->expire_timer && ba->expire_deadline <= next->deadline)) {
+    return;
+  }
+
+  if (ba->expire_timer) {
+    purple_timeout_remove(ba->expire_timer);
+  }
+
+  gint64 delay = MAX(next->deadline - libballyhoo_timers_now(), 0);
+  ba->expire_deadline = next->deadline;
+  ba->expire_timer = purple_timeout_add(delay, libballyhoo_expire_cb, ba);
+}
+
+static gboolean libballyhoo_expire_cb(gpointer data)
+{
+  BallyhooAccount *ba = data;
+  ba->expire_timer = 0;
+
+  libballyhoo_expire_deferreds(ba);
+
+  // a one shot, the next one is armed for the new earliest
+  return FALSE;
+}
+
+/**
+ * Fail every Deferred whose deadline has passed with a
+ *  Timeout fault
+ */
+static void libballyhoo_expire_deferreds(BallyhooAccount *ba)
+{
+  gint64 now = libballyhoo_timers_now();
+  BallyhooTimer *t;
+
+  while ((t = libballyhoo_timers_pop_expired(ba->timers, now)) != NULL) {
+    Deferred *dfr = t->data;
+    purple_debug_info("helplightning", "kicking off expired errbacks for %" G_GUINT64_FORMAT "\n",
+                      dfr->uuid);
+
+    BallyhooXMLRPC *fault = libballyhoo_xml_create_fault(0, "Timeout");
+    libballyhoo_fire_deferred(ba, dfr->uuid, dfr, FALSE, fault);
+    g_free(fault);
+  }
 
-  g_hash_table_insert(ba->pending_callbacks, hash, dfr);
+  libballyhoo_arm_expire_timer(ba);
 }
 
 void libballyhoo_do_helo(BallyhooAccount *ba, PurpleSslConnection *gsc)
 {
-  libballyhoo_send_raw(gsc, "BALLYHOO\0", 9); /* include null terminator */
-  libballyhoo_send_raw(gsc, BALLYHOO_PROTOCOL, strlen(BALLYHOO_PROTOCOL) + 1); /* include null terminator */
-  libballyhoo_send_raw(gsc, BALLYHOO_API, strlen(BALLYHOO_API) + 1); /* include null terminator */
+  libballyhoo_helo_free(ba->helo);
+  ba->helo = libballyhoo_helo_new();
+  ba->deflate = FALSE;
+  ba->deflate_dictionary = FALSE;
+  // they were framed for the last connection's encoding
+  g_hash_table_remove_all(ba->templates);
+
+  // send our whole side of the handshake at once, the
+  //  server's side is handled as it arrives
+  gchar *headers = g_strdup_printf("Encoding: deflate\nDeflate-Dictionary: %s\nUser-Agent: helplightning-libpurple/%s\n",
+                                   LIBBALLYHOO_DEFLATE_DICTIONARY, HELPLIGHTNING_VERSION);
+  GString *preamble = libballyhoo_helo_preamble(BALLYHOO_PROTOCOL, BALLYHOO_API, headers);
+  g_free(headers);
 
-  
-  // read the server and make sure we get an OK
-  gpointer ballyhoo = read_until_null(gsc, 32);
-  int match = ballyhoo ? strcmp(ballyhoo, "BALLYHOO") : -1;
-  g_free(ballyhoo);
-  
-  if (match != 0) {
-    purple_debug_info("helplightning", "invalid ballyhoo\n");
+  libballyhoo_queue_raw(ba, preamble->str, preamble->len);
+  g_string_free(preamble, TRUE);
 
-    purple_connection_error_reason(ba->gc,
-                                   PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
-                                   "Invalid Handshake");
-    purple_ssl_close(gsc);
-    ba->gsc = NULL;
-    ba->connected = FALSE;
-    
+  if (!libballyhoo_flush(ba)) {
     return;
   }
 
-  // read the protocol
-  gpointer proto = read_until_null(gsc, 12);
-  g_free(proto);
+  // register to handle input
+  purple_ssl_input_add(gsc, libballyhoo_handle_input_cb, ba);
+}
 
-  // read if OK
-  gpointer ok = read_until_null(gsc, 12);
-  match = ok ? strcmp(ok, "OK") : -1;
-  g_free(ok);
+/**
+ * The server sent something we can't read past, so give
+ *  up on the connection.
+ */
+static void libballyhoo_close_malformed(BallyhooAccount *ba)
+{
+  purple_connection_error_reason(ba->gc, PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
+                                 "Received malformed data");
+  purple_ssl_close(ba->gsc);
+  ba->gsc = NULL;
+  ba->connected = FALSE;
+}
+
+/**
+ * Feed the start of the input buffer to the handshake.
+ *
+ * Returns FALSE if the handshake failed and the connection
+ *  was closed.
+ */
+static gboolean libballyhoo_handle_helo(BallyhooAccount *ba)
+{
+  size_t available, consumed;
+  gpointer buffer = libballyhoo_ringbuf_peek(ba->inbuf, &available);
+
+  int ret = libballyhoo_helo_feed(ba->helo, buffer, available, &consumed);
+  libballyhoo_ringbuf_consume(ba->inbuf, consumed);
+
+  if (ret < 0) {
+    purple_debug_info("helplightning", "handshake failed: %s\n", ba->helo->error);
 
-  if (match != 0) {
-    purple_debug_info("helplightning", "invalid protocol!\n");
     purple_connection_error_reason(ba->gc,
                                    PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
-                                   "Unsupported Protocol");
-    purple_ssl_close(gsc);
+                                   ba->helo->error);
+    purple_ssl_close(ba->gsc);
     ba->gsc = NULL;
     ba->connected = FALSE;
 
-    return;
-  }
-
-  // now send the headers..
-  gchar *headers = g_strdup_printf("Encoding: text\nUser-Agent: helplightning-libpurple/%s\n",
-                                   HELPLIGHTNING_VERSION);
-  libballyhoo_send_raw(gsc, headers, strlen(headers));
-  g_free(headers);
-
-  // write a ready
-  libballyhoo_send_raw(gsc, "READY\0", 6); /* include the null terminator */
-  
-  // read all the headers until the READY\0
-  gpointer ready = read_until_null(gsc, 4096);
-  purple_debug_info("helplightning", "read ready: %s\n", (unsigned char*)ready);
-  g_free(ready);
+    return FALSE;
+  } else if (ret > 0) {
+    purple_debug_info("helplightning", "handshake complete, protocol %s with %u headers\n",
+                      ba->helo->protocol, g_hash_table_size(ba->helo->headers));
 
-  // !mwd - TODO: parse the headers and verify the last
-  //  line is a READY\0
+    // only compress what we send if the server said it can
+    //  read it
+    ba->deflate = libballyhoo_helo_header_has(ba->helo, "encoding", "deflate");
+    ba->deflate_dictionary = ba->deflate &&
+      libballyhoo_helo_header_has(ba->helo, "deflate-dictionary", LIBBALLYHOO_DEFLATE_DICTIONARY);
 
-  // register to handle input
-  purple_ssl_input_add(gsc, libballyhoo_handle_input_cb, ba);
+    purple_signal_emit(ba, LIBBALLYHOO_SIGNAL_CONNECTED, ba->gc);
+  }
 
-  purple_signal_emit(ba, LIBBALLYHOO_SIGNAL_CONNECTED, ba->gc);
+  return TRUE;
 }
 
 static void libballyhoo_handle_input_cb(gpointer data, PurpleSslConnection *gsc,
@@ -300,8 +462,9 @@ static void libballyhoo_handle_input_cb(gpointer data, PurpleSslConnection *gsc,
   }
   
   do {
-    long long remaining = ba->inbuf_len - ba->inbuf_used - 1;
-    if (remaining <= 0) {
+    size_t remaining;
+    gpointer tail = libballyhoo_ringbuf_reserve(ba->inbuf, &remaining);
+    if (tail == NULL) {
       purple_debug_info("helplightning", "ERROR!! Inputbuf is out of space!\n");
 
       purple_connection_error_reason(ba->gc, PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
@@ -309,171 +472,58 @@ static void libballyhoo_handle_input_cb(gpointer data, PurpleSslConnection *gsc,
 
       return;
     }
-    len = purple_ssl_read(ba->gsc, ba->inbuf + ba->inbuf_used,
-                          remaining);
-    purple_debug_info("helplightning", "read %lld bytes for total %zu\n", len, (size_t)(ba->inbuf_used + len));
+    len = purple_ssl_read(ba->gsc, tail, remaining);
+    purple_debug_info("helplightning", "read %lld bytes for total %zu\n", len, (size_t)(ba->inbuf->used + len));
 
     if (len > 0) {
       purple_debug_info("helplightning", "decoding\n");
-      ba->inbuf_used += len;
+      libballyhoo_ringbuf_commit(ba->inbuf, len);
+
+      if (ba->helo->state != BALLYHOO_HELO_DONE) {
+        if (!libballyhoo_handle_helo(ba)) {
+          return;
+        }
+        if (!ba->gsc) {
+          return;
+        }
+        if (ba->helo->state != BALLYHOO_HELO_DONE) {
+          continue;
+        }
+      }
       
-      // try to parse
+      // index everything we have buffered in one pass, and
+      //  handle the chunks straight out of the input buffer
       gboolean cont = TRUE;
-      while (cont && ba->inbuf_used > 0) {
-        CMFDecodedChunk *dc = g_new0(CMFDecodedChunk, 1);
-        if (libcmf_decode(ba->inbuf, ba->inbuf_used, dc) == 1) {
-          purple_debug_info("helplightning", "decoded message chunk\n");
-          purple_debug_info("helplightning", "id: %d, size: %zu, begin: %d, end %d\n",
-                            dc->id, dc->size, dc->begin, dc->end);
-
-          // Take the message we just parsed and remove it.
-          // We do this by copying the rest of inbuf starting
-          //  at the end of the messages we just read, which is
-          //  index 0 + the size of the returned message in the chunk
-          //  + 8 for the cmf headers.
-          size_t mem_size = dc->size + 8;
-          memmove(ba->inbuf, ba->inbuf + mem_size, ba->inbuf_used - mem_size);
-          ba->inbuf_used = ba->inbuf_used - mem_size;
-
-          // !mwd - TODO: should we zero out the rest of the memory, just to keep
-          //  old messages from being in there?
-
-          if (dc->end) {
-            // we have the final chunk, grab any other chunks from
-            // our hash, combine them, and try to decode the full
-            //  rcl message
-            GList *l = g_hash_table_lookup(ba->decoded_chunks, GINT_TO_POINTER(dc->id));
-            size_t total_size = 0;
-
-            GList *it = l;
-            while (it != NULL) {
-              CMFDecodedChunk *c = it->data;
-              total_size += c->size;
-              it = it->next;
-            }
-            total_size += dc->size;
-
-            gpointer combined_message = g_malloc0(total_size);
-
-            it = l;
-            size_t current = 0;
-            while (it != NULL) {
-              CMFDecodedChunk *c = it->data;
-              memcpy(combined_message + current, c->buffer, c->size);
-              current += c->size;
-
-              it = it->next;
-            }
-            memcpy(combined_message + current, dc->buffer, dc->size);
-            current += dc->size;
-
-            // remove from hash table
-            g_hash_table_remove(ba->decoded_chunks, GINT_TO_POINTER(dc->id));
-            
-            // free everything
-            g_free(dc);
-            g_list_free(l);
-
-            // now try to decode rcl
-            purple_debug_info("helplightning", "decoding rcl message\n");
-            RCLDecoded *rcl = g_new0(RCLDecoded, 1);
-
-            if (!librcl_decode(combined_message, current, rcl)) {
-              // !mwd - TODO: handle
-              purple_debug_info("helplightning", "Uh-oh, unable to decode rcl message\n");
-            } else {
-              // !mwd - parse the message headers
-              BallyhooMessage *bm = libballyhoo_message_decode(rcl->buffer, rcl->size);
-              if (bm == NULL) {
-                purple_debug_info("helplightning", "unable to decode ballyhoo message\n");
-              }
-
-              // if we need to deflate, then do so
-              gpointer content_type = g_hash_table_lookup(bm->headers, "encoding");
-              gpointer xmlrpc;
-              size_t xmlrpc_length;
-              if (strcmp(content_type, "deflate") == 0) {
-                // deflating
-                xmlrpc = libballyhoo_deflate_decompress(bm->xmlrpc,
-                                                        bm->length,
-                                                        &xmlrpc_length);
-                g_free(bm->xmlrpc);
-                bm->xmlrpc = NULL;
-              } else {
-                xmlrpc = bm->xmlrpc;
-                xmlrpc_length = bm->length;
-              }
-              g_free(content_type);
-
-              // now read the xmlrpc
-              BallyhooXMLRPC *brpc = libballyhoo_xml_decode(xmlrpc, xmlrpc_length);
-              if (brpc) {
-                if (brpc->type == BXMLRPC_RESPONSE || brpc->type == BXMLRPC_FAULT) {
-                  g_autofree guint64 *hash = g_malloc(sizeof(guint64));
-                  *hash = rcl->uuid;
-
-                  Deferred *dfr = g_hash_table_lookup(ba->pending_callbacks, hash);
-                  
-                  if (dfr) {
-                    if (brpc->type == BXMLRPC_RESPONSE) {
-                      DeferredResponse *r = libballyhoo_deferred_callback(dfr, ba, brpc->response);
-                      if (r->type != DEFERRED_DEFERRED) {
-                        g_free(r);
-                        g_free(dfr);
-                      }
-                    } else {
-                      DeferredResponse *r = libballyhoo_deferred_errback(dfr, ba, brpc);
-                      if (r->type != DEFERRED_DEFERRED) {
-                        g_free(r);
-                        g_free(dfr);
-                      }
-                    }
-                    g_hash_table_remove(ba->pending_callbacks, hash);
-                  }
-                } else {
-                  // this is a method call
-                  purple_debug_info("helplightning", "Received a method call!\n");
-                  libballyhoo_handle_method_call(ba, rcl->uuid, brpc);
-                }
-              }
-              g_free(brpc);
-              
-              // debug
-              unsigned char *c = g_malloc0(xmlrpc_length + 1);
-              memcpy(c, xmlrpc, xmlrpc_length);
-              purple_debug_info("helplightning", "length: %ld %ld\n", xmlrpc_length, strlen((const char*)c));
-              purple_debug_info("helplightning", "%s\n", c);
-              g_free(c);
-              // end debug
-
-              
-              // clean up
-              g_free(xmlrpc);
-              g_hash_table_destroy(bm->headers);
-              g_free(bm->xmlrpc);
-              g_free(bm);
-
-            }
-            g_free(combined_message);
-            g_free(rcl->buffer);
-            g_free(rcl);
-            
-          } else {
-            // add to our hash of chunks
-            if (g_hash_table_contains(ba->decoded_chunks, GINT_TO_POINTER(dc->id))) {
-              GList* l = g_hash_table_lookup(ba->decoded_chunks, GINT_TO_POINTER(dc->id));
-              l = g_list_append(l, dc);
-            } else {
-              GList *l = NULL;
-              l = g_list_append(l, dc);
-              g_hash_table_insert(ba->decoded_chunks, GINT_TO_POINTER(dc->id), l);
-            }
-          }
-        } else {
-          cont = FALSE;
+      while (cont && ba->inbuf->used > 0) {
+        CMFFrame frames[LIBBALLYHOO_MAX_FRAMES];
+        size_t available, consumed;
+        gboolean malformed;
+        guchar *buffer = libballyhoo_ringbuf_peek(ba->inbuf, &available);
+
+        int count = libcmf_index(buffer, available, frames,
+                                 LIBBALLYHOO_MAX_FRAMES, &consumed, &malformed);
+        
+        for (int i = 0; i < count && ba->gsc; i++) {
+          libballyhoo_handle_frame(ba, buffer, &frames[i]);
+        }
+        if (!ba->gsc) {
+          // a message was malformed, and closed the connection
+          return;
+        }
+
+        // drop all the chunks we just handled
+        libballyhoo_ringbuf_consume(ba->inbuf, consumed);
+
+        if (malformed) {
+          // we can't find the start of the next chunk, so
+          //  nothing after this can be read
           purple_debug_info("helplightning", "unable to decode\n");
-          g_free(dc);
+          libballyhoo_close_malformed(ba);
+          return;
         }
+
+        // if we filled up our frames, there may be more
+        cont = count == LIBBALLYHOO_MAX_FRAMES;
       }
     }
   } while (len > 0);
@@ -499,116 +549,590 @@ static void libballyhoo_handle_input_cb(gpointer data, PurpleSslConnection *gsc,
   }
 }
 
-void libballyhoo_send_chunks(BallyhooAccount *ba,
-                             PurpleSslConnection *gsc, GList *messages)
+static void libballyhoo_handle_frame(BallyhooAccount *ba, const guchar *buffer,
+                                     const CMFFrame *frame)
 {
- for (GList *it = messages; it != NULL; it = it->next) {
-    CMFChunk *c = (CMFChunk*)it->data;
-    purple_debug_info("helplightning", "Writing chunk: %ld\n", c->size);
-    // !mwd - handle if we can't write a full chunk.
-    //guint ret = purple_ssl_write(gsc, c->buffer, c->size);
-    if (!libballyhoo_send_raw(ba->gsc, c->buffer, c->size)) {
-      purple_debug_info("helplightning", "Error sending message!\n");
-      purple_connection_error_reason(ba->gc,
-                                     PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
-                                     "Disconnected");
-      purple_ssl_close(ba->gsc);
-      ba->gsc = NULL;
-      ba->connected = FALSE;
-      
-      return;
-    }
+  purple_debug_info("helplightning", "decoded message chunk\n");
+  purple_debug_info("helplightning", "id: %d, size: %zu, begin: %d, end %d\n",
+                    frame->id, frame->size, frame->begin, frame->end);
+
+  const guchar *payload = buffer + frame->offset;
+
+  if (frame->begin && frame->end) {
+    // the whole message fit in a single chunk, so decode
+    //  it right out of the input buffer
+    BallyhooSlice message = libballyhoo_slice_borrow(payload, frame->size);
+    libballyhoo_handle_message(ba, &message);
+    return;
+  }
+
+  // the headers are parsed once, from the first chunk
+  BallyhooIncoming *s = g_hash_table_lookup(ba->incoming, GINT_TO_POINTER(frame->id));
+  if (s) {
+    libballyhoo_continue_message(ba, s, payload, frame);
+    return;
+  } else if (frame->begin && libballyhoo_begin_message(ba, payload, frame)) {
+    return;
+  }
+
+  // the headers didn't all fit in the first chunk, so
+  //  append to the rest of the message. Once we have the
+  //  final chunk, try to decode the full rcl message
+  CMFMessage *m = libcmf_reassembler_add(ba->decoded_chunks, frame, payload);
+  if (m) {
+    // hand the reassembled buffer over to a slice owner,
+    //  so anything decoded from it can keep it alive
+    BallyhooBuffer *b = libballyhoo_buffer_new(m->buffer, m->size, g_free);
+    m->buffer = NULL;
+    libcmf_message_free(m);
+
+    BallyhooSlice message = libballyhoo_slice_new(b);
+    libballyhoo_buffer_unref(b);
+
+    libballyhoo_handle_message(ba, &message);
+    libballyhoo_slice_clear(&message);
   }
 }
 
+/**
+ * Parse the headers of a message from its first chunk. A
+ *  deflate message starts inflating, and anything else is
+ *  put back together to be read once it's complete.
+ *
+ * Returns FALSE if the headers aren't all in this chunk,
+ *  so the whole message has to be decoded at the end.
+ */
+static gboolean libballyhoo_begin_message(BallyhooAccount *ba, const guchar *payload,
+                                          const CMFFrame *frame)
+{
+  BallyhooSlice chunk = libballyhoo_slice_borrow(payload, frame->size);
+  RCLDecoded rcl;
+  if (librcl_decode(&chunk, &rcl) != 1) {
+    return FALSE;
+  }
 
-gboolean libballyhoo_send_raw(PurpleSslConnection *gsc, void* buffer, size_t len) {
-  int sent = 0;
-  while (sent < len) {
-    int ret;
-    purple_debug_info("helplightning", "writing %ld bytes\n", len - sent);
-    ret = purple_ssl_write(gsc, buffer + sent, len - sent);
-    purple_debug_info("helplightning", "wrote %d bytes\n", ret);
+  BallyhooMessage bm;
+  if (!libballyhoo_message_decode_head(&rcl.body, &bm)) {
+    libballyhoo_slice_clear(&rcl.body);
+    return FALSE;
+  }
 
-    if (ret < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        // try again
-        continue;
-      } else {
-        // we failed.
-        
-        return FALSE;
-      }
-    } else if (ret == 0) {
-      // socket has closed
+  BallyhooInflater *i = NULL;
+  if (bm.encoding == BALLYHOO_ENCODING_DEFLATE) {
+    i = libballyhoo_take_inflater(ba, bm.length);
+    if (i == NULL) {
+      libballyhoo_message_clear(&bm);
+      libballyhoo_slice_clear(&rcl.body);
       return FALSE;
     }
+  }
 
-    sent += ret;
+  BallyhooIncoming *s = g_new0(BallyhooIncoming, 1);
+  s->uuid = rcl.uuid;
+  s->offset = bm.xmlrpc.data - payload;
+  s->length = bm.length;
+  s->inflater = i;
+  if (i) {
+    s->remaining = bm.length - bm.xmlrpc.length;
+    libballyhoo_inflater_feed(i, bm.xmlrpc.data, bm.xmlrpc.length);
+  } else {
+    libcmf_reassembler_add(ba->decoded_chunks, frame, payload);
   }
 
+  g_hash_table_insert(ba->incoming, GINT_TO_POINTER(frame->id), s);
+
+  libballyhoo_message_clear(&bm);
+  libballyhoo_slice_clear(&rcl.body);
+
   return TRUE;
 }
 
-gpointer read_raw(PurpleSslConnection *gsc, size_t len) {
-  gpointer buffer = g_malloc0(len);
+static void libballyhoo_continue_message(BallyhooAccount *ba, BallyhooIncoming *s,
+                                         const guchar *payload, const CMFFrame *frame)
+{
+  // deflate messages are inflated a chunk at a time
+  //  instead of being put back together first
+  if (s->inflater) {
+    libballyhoo_continue_inflate(ba, s, payload, frame);
+    return;
+  }
+
+  CMFMessage *m = libcmf_reassembler_add(ba->decoded_chunks, frame, payload);
+  if (m == NULL) {
+    return;
+  }
+
+  g_hash_table_steal(ba->incoming, GINT_TO_POINTER(frame->id));
+
+  if (s->length > m->size - s->offset) {
+    purple_debug_info("helplightning", "Invalid message-length\n");
+    libcmf_message_free(m);
+    libballyhoo_incoming_free(s);
+    libballyhoo_close_malformed(ba);
+    return;
+  }
+
+  // the body is read right out of the reassembled buffer
+  BallyhooBuffer *b = libballyhoo_buffer_new(m->buffer, m->size, g_free);
+  m->buffer = NULL;
+  libcmf_message_free(m);
+
+  BallyhooSlice message = libballyhoo_slice_new(b);
+  libballyhoo_buffer_unref(b);
+  BallyhooSlice xml = libballyhoo_slice_sub(&message, s->offset, s->length);
+  libballyhoo_slice_clear(&message);
+
+  libballyhoo_handle_xml(ba, s->uuid, &xml);
+  libballyhoo_slice_clear(&xml);
+  libballyhoo_incoming_free(s);
+}
+
+static void libballyhoo_continue_inflate(BallyhooAccount *ba, BallyhooIncoming *s,
+                                         const guchar *payload, const CMFFrame *frame)
+{
+  size_t length = MIN(frame->size, s->remaining);
+  s->remaining -= length;
+  libballyhoo_inflater_feed(s->inflater, payload, length);
+
+  if (!frame->end) {
+    return;
+  }
+
+  g_hash_table_steal(ba->incoming, GINT_TO_POINTER(frame->id));
+
+  if (s->inflater->status == 1 && s->remaining == 0) {
+    size_t xml_length;
+    gpointer xml_data = libballyhoo_inflater_steal(s->inflater, &xml_length);
+    BallyhooBuffer *b = libballyhoo_buffer_new(xml_data, xml_length, g_free);
+    BallyhooSlice xml = libballyhoo_slice_new(b);
+    libballyhoo_buffer_unref(b);
 
-  int read = 0;
-  while (read < len) {
-    int ret = purple_ssl_read(gsc, buffer + read, len - read);
-    if (ret == 0) {
-      return buffer;
-    } else if (ret < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        // try again
-        continue;
+    libballyhoo_handle_xml(ba, s->uuid, &xml);
+    libballyhoo_slice_clear(&xml);
+  } else {
+    purple_debug_info("helplightning", "unable to inflate ballyhoo message\n");
+  }
+
+  libballyhoo_return_inflater(ba, s->inflater);
+  s->inflater = NULL;
+  libballyhoo_incoming_free(s);
+}
+
+/**
+ * Reuse an idle inflater if there is one, sized for length
+ *  bytes of compressed input
+ */
+static BallyhooInflater *libballyhoo_take_inflater(BallyhooAccount *ba, size_t length)
+{
+  BallyhooInflater *i = g_queue_pop_head(ba->inflaters);
+  if (i == NULL) {
+    i = libballyhoo_inflater_new();
+    if (i == NULL)
+      return NULL;
+  }
+
+  libballyhoo_inflater_reset(i, length * LIBBALLYHOO_INFLATE_RATIO);
+
+  return i;
+}
+
+static void libballyhoo_return_inflater(BallyhooAccount *ba, BallyhooInflater *i)
+{
+  if (g_queue_get_length(ba->inflaters) < LIBBALLYHOO_IDLE_INFLATERS) {
+    g_queue_push_head(ba->inflaters, i);
+  } else {
+    libballyhoo_inflater_free(i);
+  }
+}
+
+static void libballyhoo_incoming_free(BallyhooIncoming *s)
+{
+  libballyhoo_inflater_free(s->inflater);
+  g_free(s);
+}
+
+static Deferred *libballyhoo_find_deferred(BallyhooAccount *ba, guint64 uuid)
+{
+  return libballyhoo_pending_lookup(ba->pending_callbacks, uuid);
+}
+
+/**
+ * Run a Deferred's callbacks (or errbacks if success is
+ *  FALSE) and stop tracking it.
+ */
+static void libballyhoo_fire_deferred(BallyhooAccount *ba, guint64 uuid, Deferred *dfr,
+                                      gboolean success, gpointer result)
+{
+  // it can't time out or be answered again once it has an
+  //  answer, even from inside its own callbacks
+  libballyhoo_timers_remove(ba->timers, &dfr->timer);
+  libballyhoo_pending_remove(ba->pending_callbacks, uuid);
+
+  DeferredResponse r = libballyhoo_deferred_run(dfr, ba, success, result);
+
+  // if it's now waiting on another Deferred, that one owns it
+  if (r.type != DEFERRED_DEFERRED) {
+    libballyhoo_deferred_free(dfr);
+  }
+}
+
+static void libballyhoo_handle_decoded_response(BallyhooAccount *ba, guint64 uuid,
+                                                Deferred *dfr, const BallyhooSlice *xml)
+{
+  const BallyhooDecoder *decoder = dfr->decoder;
+
+  gpointer state = decoder->begin(ba);
+  enum BallyhooXMLStreamResult r = libballyhoo_xml_stream(xml->data, xml->length,
+                                                          decoder->event, state);
+  gpointer result = NULL;
+  gboolean success = decoder->finish(state, r == BXML_STREAM_OK, &result);
+
+  if (r == BXML_STREAM_FAULT) {
+    // faults are rare, so decode them the normal way
+    BallyhooXMLRPC *brpc = libballyhoo_xml_decode(xml->data, xml->length);
+    if (brpc) {
+      libballyhoo_fire_deferred(ba, uuid, dfr, FALSE, brpc);
+      libballyhoo_xml_free(brpc);
+      return;
+    }
+  } else if (success) {
+    libballyhoo_fire_deferred(ba, uuid, dfr, TRUE, result);
+    return;
+  }
+
+  purple_debug_info("helplightning", "unable to decode response %" G_GUINT64_FORMAT "\n", uuid);
+  BallyhooXMLRPC *fault = libballyhoo_xml_create_fault(-1, "Unable to decode response");
+  libballyhoo_fire_deferred(ba, uuid, dfr, FALSE, fault);
+  g_free(fault);
+}
+
+static void libballyhoo_handle_message(BallyhooAccount *ba,
+                                       const BallyhooSlice *message)
+{
+  // now try to decode rcl
+  purple_debug_info("helplightning", "decoding rcl message\n");
+  RCLDecoded rcl;
+
+  if (librcl_decode(message, &rcl) != 1) {
+    // !mwd - TODO: handle
+    purple_debug_info("helplightning", "Uh-oh, unable to decode rcl message\n");
+    return;
+  }
+
+  // !mwd - parse the message headers
+  BallyhooMessage bm;
+  if (!libballyhoo_message_decode(&rcl.body, &bm)) {
+    // the headers are broken, or claim a bogus length, so
+    //  we can't trust anything else the server sends
+    purple_debug_info("helplightning", "unable to decode ballyhoo message\n");
+    libballyhoo_slice_clear(&rcl.body);
+    libballyhoo_close_malformed(ba);
+    return;
+  }
+
+  // if we need to deflate, then do so
+  //  into a new buffer. Otherwise the xml is read right
+  //  out of the message.
+  BallyhooSlice xml = { 0 };
+  if (bm.encoding == BALLYHOO_ENCODING_DEFLATE) {
+    BallyhooInflater *i = libballyhoo_take_inflater(ba, bm.length);
+    if (i && libballyhoo_inflater_feed(i, bm.xmlrpc.data, bm.xmlrpc.length) == 1) {
+      size_t xmlrpc_length = 0;
+      gpointer xmlrpc = libballyhoo_inflater_steal(i, &xmlrpc_length);
+      BallyhooBuffer *b = libballyhoo_buffer_new(xmlrpc, xmlrpc_length, g_free);
+      xml = libballyhoo_slice_new(b);
+      libballyhoo_buffer_unref(b);
+    }
+    if (i) {
+      libballyhoo_return_inflater(ba, i);
+    }
+  } else {
+    xml = libballyhoo_slice_sub(&bm.xmlrpc, 0, bm.xmlrpc.length);
+  }
+
+  if (xml.data == NULL) {
+    purple_debug_info("helplightning", "unable to inflate ballyhoo message\n");
+    libballyhoo_slice_clear(&xml);
+    libballyhoo_message_clear(&bm);
+    libballyhoo_slice_clear(&rcl.body);
+    return;
+  }
+
+  libballyhoo_handle_xml(ba, rcl.uuid, &xml);
+
+  // clean up
+  libballyhoo_slice_clear(&xml);
+  libballyhoo_message_clear(&bm);
+  libballyhoo_slice_clear(&rcl.body);
+}
+
+/**
+ * Dispatch the xml of a complete message
+ */
+static void libballyhoo_handle_xml(BallyhooAccount *ba, guint64 uuid,
+                                   const BallyhooSlice *xml)
+{
+  // if the response is for a Deferred with its own decoder,
+  //  stream the xml straight into it
+  Deferred *dfr = NULL;
+  if (libballyhoo_xml_sniff(xml->data, xml->length) == BXML_ROOT_RESPONSE) {
+    dfr = libballyhoo_find_deferred(ba, uuid);
+  }
+
+  if (dfr && dfr->decoder) {
+    libballyhoo_handle_decoded_response(ba, uuid, dfr, xml);
+  } else {
+    // now read the xmlrpc
+    BallyhooXMLRPC *brpc = libballyhoo_xml_decode(xml->data, xml->length);
+    if (brpc) {
+      if (brpc->type == BXMLRPC_RESPONSE || brpc->type == BXMLRPC_FAULT) {
+        if (dfr) {
+          if (brpc->type == BXMLRPC_RESPONSE) {
+            libballyhoo_fire_deferred(ba, uuid, dfr, TRUE, brpc->response);
+          } else {
+            libballyhoo_fire_deferred(ba, uuid, dfr, FALSE, brpc);
+          }
+        }
       } else {
-        purple_debug_info("helplightning", "read_until_null failed: %d: %s\n", ret, strerror(errno));
-        g_free(buffer);
-        
-        return NULL;
+        // this is a method call
+        purple_debug_info("helplightning", "Received a method call!\n");
+        libballyhoo_handle_method_call(ba, uuid, brpc);
       }
+      libballyhoo_xml_free(brpc);
     }
+  }
+
+  purple_debug_info("helplightning", "handled %zu bytes of xml\n", xml->length);
+}
+
+void libballyhoo_send_message(BallyhooAccount *ba,
+                              PurpleSslConnection *gsc, BallyhooOutMessage *m)
+{
+  if (!ba->gsc) {
+    purple_debug_info("helplightning", "Not connected, dropping message\n");
+    libballyhoo_out_message_free(m);
+    return;
+  }
+
+  libballyhoo_frame_message(ba, m);
+
+  // the chunks are copied out once it is this message's turn
+  libballyhoo_scheduler_push(ba->scheduler, m);
+
+  libballyhoo_schedule_flush(ba);
+}
+
+guint64 libballyhoo_send_constant_call(BallyhooAccount *ba, int priority,
+                                       const char *method_name)
+{
+  guint64 uuid = librcl_generate_uuid();
+
+  if (!ba->gsc) {
+    purple_debug_info("helplightning", "Not connected, dropping message\n");
+    return uuid;
+  }
+
+  BallyhooOutTemplate *t = g_hash_table_lookup(ba->templates, method_name);
+  if (t == NULL) {
+    guint64 unused;
+    BallyhooOutMessage *m = libballyhoo_encode_method_call_priority(&unused, priority,
+                                                                    method_name, "()");
+    libballyhoo_frame_message(ba, m);
+    t = libballyhoo_out_template_new(m);
+    libballyhoo_out_message_free(m);
+
+    g_return_val_if_fail(t != NULL, uuid);
+    g_hash_table_insert(ba->templates, g_strdup(method_name), t);
+  }
+
+  // it's a single chunk, so it can skip the scheduler
+  libballyhoo_out_template_stamp(t, uuid);
+  libballyhoo_queue_raw(ba, t->data, t->length);
+
+  libballyhoo_schedule_flush(ba);
+
+  return uuid;
+}
+
+/**
+ * Check for congestion after queueing a message, and make
+ *  sure it will be written
+ */
+static void libballyhoo_schedule_flush(BallyhooAccount *ba)
+{
+  size_t queued = libballyhoo_queued(ba);
+  if (!ba->congested && queued >= LIBBALLYHOO_OUTBUF_HIGH) {
+    purple_debug_info("helplightning", "Output is congested with %zu bytes\n", queued);
+    ba->congested = TRUE;
+  }
 
-    read += ret;
+  if (ba->write_watcher) {
+    // already waiting on the socket
+  } else if (queued >= LIBBALLYHOO_OUTBUF_FLUSH) {
+    libballyhoo_flush(ba);
+  } else if (!ba->flush_timer) {
+    ba->flush_timer = purple_timeout_add(0, libballyhoo_flush_cb, ba);
   }
+}
+
+/**
+ * Bytes waiting to be written, both scheduled and buffered
+ */
+static size_t libballyhoo_queued(BallyhooAccount *ba)
+{
+  return ba->outbuf->used + ba->scheduler->pending;
+}
+
+static void libballyhoo_queue_raw_cb(gconstpointer data, size_t length,
+                                     gpointer user_data)
+{
+  libballyhoo_queue_raw((BallyhooAccount*)user_data, data, length);
+}
+
+/**
+ * Copy bytes onto the end of the output buffer
+ */
+static void libballyhoo_queue_raw(BallyhooAccount *ba, gconstpointer data,
+                                  size_t length)
+{
+  const guchar *b = data;
+
+  while (length > 0 && ba->gsc) {
+    size_t available;
+    guchar *tail = libballyhoo_ringbuf_reserve(ba->outbuf, &available);
+    if (tail == NULL) {
+      // the socket hasn't taken anything for a long time
+      purple_debug_info("helplightning", "ERROR!! Outputbuf is out of space!\n");
+      libballyhoo_reset_outbuf(ba);
+
+      purple_connection_error_reason(ba->gc, PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
+                                     "Output buf is out of space");
+      purple_ssl_close(ba->gsc);
+      ba->gsc = NULL;
+      ba->connected = FALSE;
+
+      return;
+    }
 
-  return buffer;
+    size_t n = MIN(length, available);
+    memcpy(tail, b, n);
+    libballyhoo_ringbuf_commit(ba->outbuf, n);
+    b += n;
+    length -= n;
+  }
 }
 
-gpointer read_until_null(PurpleSslConnection *gsc, size_t max_size) {
-  gpointer buffer = g_malloc0(max_size);
+gboolean libballyhoo_flush(BallyhooAccount *ba)
+{
+  if (ba->flush_timer) {
+    purple_timeout_remove(ba->flush_timer);
+    ba->flush_timer = 0;
+  }
+
+  if (!ba->gsc) {
+    libballyhoo_reset_outbuf(ba);
+    return FALSE;
+  }
 
-  int read = 0;
   while (TRUE) {
-    int ret = purple_ssl_read(gsc, buffer + read, 1);
-    if (ret == 0) {
-      return buffer;
-    } else if (ret < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        // try again
-        continue;
-      } else {
-        purple_debug_info("helplightning", "read_until_null failed: %d: %s\n", ret, strerror(errno));
-        g_free(buffer);
-        
-        return NULL;
-      }
+    // top the buffer up with the next chunks in priority
+    //  order. Keeping it small lets anything urgent that is
+    //  sent later still get ahead of a big message.
+    if (ba->outbuf->used < LIBBALLYHOO_OUTBUF_FLUSH) {
+      libballyhoo_scheduler_take(ba->scheduler,
+                                 LIBBALLYHOO_OUTBUF_FLUSH - ba->outbuf->used,
+                                 libballyhoo_queue_raw_cb, ba);
     }
-    
-    if (((unsigned char*)buffer)[read] == '\0') {
-      return buffer;
+    if (ba->outbuf->used == 0) {
+      break;
     }
 
-    read += ret;
-    
-    if (read >= max_size) {
-      purple_debug_info("helplightning", "read_until_null failed: no space left\n");
-      g_free(buffer);
+    size_t length;
+    gpointer buffer = libballyhoo_ringbuf_peek(ba->outbuf, &length);
+    int ret = purple_ssl_write(ba->gsc, buffer, length);
+    purple_debug_info("helplightning", "wrote %d of %zu bytes\n", ret, length);
 
-      return NULL;
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // the socket is full, pick up again once it drains
+      break;
+    } else if (ret <= 0) {
+      purple_debug_info("helplightning", "Error sending message!\n");
+      libballyhoo_reset_outbuf(ba);
+      purple_connection_error_reason(ba->gc,
+                                     PURPLE_CONNECTION_ERROR_NETWORK_ERROR,
+                                     "Disconnected");
+      purple_ssl_close(ba->gsc);
+      ba->gsc = NULL;
+      ba->connected = FALSE;
+
+      return FALSE;
+    }
+
+    libballyhoo_ringbuf_consume(ba->outbuf, ret);
+  }
+
+  if (ba->outbuf->used > 0) {
+    if (!ba->write_watcher) {
+      ba->write_watcher = purple_input_add(ba->gsc->fd, PURPLE_INPUT_WRITE,
+                                           libballyhoo_writable_cb, ba);
+    }
+  } else {
+    if (ba->write_watcher) {
+      purple_input_remove(ba->write_watcher);
+      ba->write_watcher = 0;
     }
+    libballyhoo_ringbuf_shrink(ba->outbuf);
+  }
+
+  if (ba->congested && libballyhoo_queued(ba) <= LIBBALLYHOO_OUTBUF_LOW) {
+    purple_debug_info("helplightning", "Output is writable again\n");
+    ba->congested = FALSE;
+    purple_signal_emit(ba, LIBBALLYHOO_SIGNAL_WRITABLE, ba->gc);
+  }
+
+  return TRUE;
+}
+
+gboolean libballyhoo_is_congested(BallyhooAccount *ba)
+{
+  return ba->congested;
+}
+
+static gboolean libballyhoo_flush_cb(gpointer data)
+{
+  BallyhooAccount *ba = data;
+
+  // libballyhoo_flush would remove us, but returning
+  //  FALSE already does that
+  ba->flush_timer = 0;
+  libballyhoo_flush(ba);
+
+  return FALSE;
+}
+
+static void libballyhoo_writable_cb(gpointer data, gint source,
+                                    PurpleInputCondition cond)
+{
+  libballyhoo_flush((BallyhooAccount*)data);
+}
+
+/**
+ * Drop anything that hasn't been written, and stop
+ *  waiting to write it.
+ */
+static void libballyhoo_reset_outbuf(BallyhooAccount *ba)
+{
+  if (ba->flush_timer) {
+    purple_timeout_remove(ba->flush_timer);
+    ba->flush_timer = 0;
+  }
+  if (ba->write_watcher) {
+    purple_input_remove(ba->write_watcher);
+    ba->write_watcher = 0;
   }
+  libballyhoo_ringbuf_consume(ba->outbuf, ba->outbuf->used);
+  libballyhoo_scheduler_clear(ba->scheduler);
+  ba->congested = FALSE;
 }
 
 void libballyhoo_handle_method_call(BallyhooAccount *ba, guint64 uuid,
@@ -621,9 +1145,8 @@ void libballyhoo_handle_method_call(BallyhooAccount *ba, guint64 uuid,
 
   // send the ret
   purple_debug_info("helplightning", "sending response for %d\n", ret);
-  GList *chunks = libballyhoo_encode_method_responseb(uuid, ret);
-  libballyhoo_send_chunks(ba, ba->gsc, chunks);
-  g_list_free(chunks);
+  BallyhooOutMessage *m = libballyhoo_encode_method_responseb(uuid, ret);
+  libballyhoo_send_message(ba, ba->gsc, m);
 
 }
 
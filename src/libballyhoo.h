@@ -29,9 +29,40 @@
 #include <xmlrpc-c/base.h>
 #include <account.h>
 
+#include "libballyhoo_helo.h"
+#include "libballyhoo_outmsg.h"
+#include "libballyhoo_pending.h"
+#include "libballyhoo_ringbuf.h"
+#include "libballyhoo_sched.h"
+#include "libballyhoo_slice.h"
+#include "libballyhoo_timers.h"
+#include "libballyhoo_xml_stream.h"
+#include "libcmf.h"
+
 #define DEFAULT_TIMEOUT 90 // 90 seconds
 
+#define LIBBALLYHOO_INBUF_SIZE 32768
+#define LIBBALLYHOO_INBUF_MAX (4 * 1024 * 1024)
+#define LIBBALLYHOO_OUTBUF_SIZE 16384
+#define LIBBALLYHOO_OUTBUF_MAX (4 * 1024 * 1024)
+#define LIBBALLYHOO_OUTBUF_FLUSH 16384 // write right away once this much is queued
+#define LIBBALLYHOO_OUTBUF_HIGH (512 * 1024) // congested above this
+#define LIBBALLYHOO_OUTBUF_LOW (64 * 1024) // and writable again below this
+#define LIBBALLYHOO_DEFLATE_MIN 256 // smaller messages are always sent as text
+#define LIBBALLYHOO_DEFLATE_DICTIONARY_MIN 64 // or this, with the preset dictionary
+#define LIBBALLYHOO_IDLE_INFLATERS 4 // z_streams kept around for reuse
+#define LIBBALLYHOO_INLINE_PAIRS 4 // callback pairs a Deferred holds without allocating
+#define LIBBALLYHOO_CHAIN_DEPTH 8 // chained Deferreds resumed without allocating
+/* cmf priorities for outbound messages, lower goes first */
+#define LIBBALLYHOO_PRIORITY_INTERACTIVE 0 // things the user is waiting on
+#define LIBBALLYHOO_PRIORITY_DEFAULT 4
+#define LIBBALLYHOO_PRIORITY_BULK 12 // large background fetches
+#define LIBBALLYHOO_MAX_FRAMES 64 // chunks indexed per pass over the inbuf
+#define LIBBALLYHOO_MAX_EXTRA_HEADERS 8 // unknown headers kept per message
+#define LIBBALLYHOO_MAX_MESSAGE_LENGTH (64 * 1024 * 1024) // largest message-length we accept
+
 #define LIBBALLYHOO_SIGNAL_CONNECTED "libballyhoo-connected"
+#define LIBBALLYHOO_SIGNAL_WRITABLE "libballyhoo-writable"
 
 struct _BallyhooAccount;
 struct _BallyhooXMLRPC;
@@ -47,13 +78,38 @@ typedef struct _BallyhooAccount {
   gboolean connected;
   gboolean authenticated;
 
-  GHashTable *pending_callbacks;
-
-  size_t inbuf_len;
-  size_t inbuf_used;
-  char *inbuf;
-
-  GHashTable *decoded_chunks;
+  BallyhooPending *pending_callbacks;
+  /* when each pending Deferred times out, and the one
+   *  purple timeout waiting for the earliest of them */
+  BallyhooTimers *timers;
+  guint expire_timer;
+  gint64 expire_deadline;
+
+  /* the handshake, and the headers the server sent */
+  BallyhooHelo *helo;
+  /* the server takes deflate encoded messages, and knows
+   *  our preset dictionary */
+  gboolean deflate;
+  gboolean deflate_dictionary;
+
+  BallyhooRingBuf *inbuf;
+
+  /* messages wait in the scheduler, and their chunks are
+   *  gathered in outbuf and written together */
+  BallyhooScheduler *scheduler;
+  BallyhooRingBuf *outbuf;
+  guint flush_timer;
+  /* waiting for the socket to take the rest of outbuf */
+  guint write_watcher;
+  gboolean congested;
+  /* framed copies of constant calls, keyed by method name */
+  GHashTable *templates;
+
+  CMFReassembler *decoded_chunks;
+  /* messages whose headers were parsed from their first
+   *  chunk, keyed by cmf id, and idle inflaters to reuse */
+  GHashTable *incoming;
+  GQueue *inflaters;
 } BallyhooAccount;
 
 enum BallyhooXMLRPCType {
@@ -77,21 +133,45 @@ typedef struct _BallyhooXMLRPC {
   const char *fault_string;
 } BallyhooXMLRPC;
 
+enum BallyhooEncoding {
+  BALLYHOO_ENCODING_NONE, /* no encoding header */
+  BALLYHOO_ENCODING_TEXT,
+  BALLYHOO_ENCODING_DEFLATE,
+  BALLYHOO_ENCODING_UNKNOWN
+};
+
+typedef struct _BallyhooHeader {
+  BallyhooSlice name;
+  BallyhooSlice value;
+} BallyhooHeader;
+
 typedef struct _BallyhooMessage {
-  gpointer xmlrpc;
-  size_t length;
-  GHashTable *headers;
-} BallyhooMessage;
+  BallyhooSlice xmlrpc;
+  size_t length; /* message-length */
 
-typedef struct _Deferred {
-  GQueue *callbacks;
+  /* the known headers */
+  enum BallyhooEncoding encoding;
+  BallyhooSlice content_type;
+  BallyhooSlice api_key;
 
-  time_t expiration; // unix time when this expires
-  
-  gpointer result;
-  gboolean fired;
-  gboolean is_firing;
-} Deferred;
+  /* any other headers, in the order they were received */
+  int extra_count;
+  BallyhooHeader extra[LIBBALLYHOO_MAX_EXTRA_HEADERS];
+} BallyhooMessage;
+
+/**
+ * Decodes a response straight from the xml instead of
+ *  from a tree of xmlrpc_values. The callbacks of a
+ *  Deferred with a decoder are passed the decoded result.
+ */
+typedef struct _BallyhooDecoder {
+  /* create the state passed to event */
+  gpointer (*begin)(struct _BallyhooAccount *ba);
+  BallyhooXMLEventFunc event;
+  /* free the state and set result. Return FALSE if the
+   *  response was invalid. */
+  gboolean (*finish)(gpointer state, gboolean success, gpointer *result);
+} BallyhooDecoder;
 
 enum DeferredResponseType {
   DEFERRED_RESPONSE,
@@ -104,16 +184,64 @@ typedef struct _DeferredResponse {
   gpointer result;
 } DeferredResponse;
 
-typedef DeferredResponse *(*DeferredCbFunction)(BallyhooAccount*, gpointer, gpointer);
-typedef DeferredResponse *(*DeferredErrFunction)(BallyhooAccount*, gpointer, gpointer);
+typedef DeferredResponse (*DeferredCbFunction)(BallyhooAccount*, gpointer, gpointer);
+typedef DeferredResponse (*DeferredErrFunction)(BallyhooAccount*, gpointer, gpointer);
 
 typedef struct _CallbackPair {
   DeferredCbFunction cb;
   DeferredErrFunction err;
 
   gpointer user_data;
+  GDestroyNotify destroy; // frees user_data if neither cb nor err gets it
 } CallbackPair;
 
+struct _BallyhooCancellable;
+struct _DeferredList;
+
+typedef struct _Deferred {
+  /* the pairs still to run are pairs[first] up to
+   *  pairs[first + count]. pairs starts out pointing at
+   *  inline_pairs, so most Deferreds never allocate. */
+  CallbackPair *pairs;
+  int first;
+  int count;
+  int capacity;
+  CallbackPair inline_pairs[LIBBALLYHOO_INLINE_PAIRS];
+
+  const BallyhooDecoder *decoder;
+
+  guint64 uuid; // the call it's waiting on
+  BallyhooTimer timer; // when it times out
+  struct _Deferred *waiting_on; // what the rest of the chain waits for
+  struct _DeferredList *list; // the Deferreds it joins
+
+  struct _BallyhooCancellable *cancellable;
+  GList cancel_link;
+  
+  gpointer result;
+  gboolean fired;
+  gboolean is_firing;
+  gboolean cancelled;
+} Deferred;
+
+/**
+ * What a list built with gather passes to its callbacks:
+ *  the result of each Deferred, in the order they were given.
+ *  It's only valid until the callback returns.
+ */
+typedef struct _DeferredListResult {
+  int count;
+  gpointer *results;
+} DeferredListResult;
+
+/**
+ * A set of Deferreds to cancel together, like everything
+ *  started for a conversation.
+ */
+typedef struct _BallyhooCancellable {
+  GQueue deferreds;
+} BallyhooCancellable;
+
 /** 
  * Initialize the Ballyhoo library
  *
@@ -131,23 +259,33 @@ void libballyhoo_connect(PurpleAccount *acct, BallyhooAccount *ballyhoo_account,
 
 
 /**
- * Update the reactor. Ideally this would be done
- * every second or more.
+ * Update the reactor. Deferreds time out on their own, so
+ *  this only does housekeeping and can run as rarely as the
+ *  keepalive.
  */
 void libballyhoo_update(BallyhooAccount *ba);
 
 /**
  * Encode a method call
+ *
+ * The priority decides how its chunks are scheduled against
+ *  other outbound messages, and defaults to
+ *  LIBBALLYHOO_PRIORITY_DEFAULT.
  */
-GList *libballyhoo_encode_method_call(guint64 *uuid,
-                                      const char *method_name,
-                                      const char *format,
-                                      ...);
+BallyhooOutMessage *libballyhoo_encode_method_call(guint64 *uuid,
+                                                   const char *method_name,
+                                                   const char *format,
+                                                   ...);
+BallyhooOutMessage *libballyhoo_encode_method_call_priority(guint64 *uuid,
+                                                            int priority,
+                                                            const char *method_name,
+                                                            const char *format,
+                                                            ...);
 
 /**
  * Encode a method response
  */
-GList *libballyhoo_encode_method_responseb(guint64 uuid, gboolean response);
+BallyhooOutMessage *libballyhoo_encode_method_responseb(guint64 uuid, gboolean response);
 
 /* Deferred */
 void libballyhoo_add_deferred(BallyhooAccount *ba,
@@ -155,11 +293,117 @@ void libballyhoo_add_deferred(BallyhooAccount *ba,
 Deferred *libballyhoo_deferred_build(guint timeout);
 void libballyhoo_deferred_add_callbacks(Deferred *d, DeferredCbFunction cb,
                                         DeferredErrFunction err);
-void libballyhoo_deferred_add_callback_pair(Deferred *d, CallbackPair *cp);
+void libballyhoo_deferred_add_callbacks_full(Deferred *d, DeferredCbFunction cb,
+                                             DeferredErrFunction err, gpointer user_data);
+/**
+ * Add a pair that owns user_data. Whichever of cb or err is
+ *  called takes it over. If the pair is skipped because the
+ *  other one is NULL, or dropped when d is cancelled or freed,
+ *  user_data is freed with destroy.
+ */
+void libballyhoo_deferred_add_callbacks_notify(Deferred *d, DeferredCbFunction cb,
+                                               DeferredErrFunction err, gpointer user_data,
+                                               GDestroyNotify destroy);
+/**
+ * Free a Deferred that won't be fired again
+ */
+void libballyhoo_deferred_free(Deferred *d);
+/**
+ * Release the idle Deferreds kept for reuse. Called when
+ *  the plugin is unloaded.
+ */
+void libballyhoo_deferred_pool_drain(void);
+/**
+ * Build the result of a callback
+ */
+DeferredResponse libballyhoo_deferred_response(enum DeferredResponseType type,
+                                               gpointer result);
+void libballyhoo_deferred_set_decoder(Deferred *d, const BallyhooDecoder *decoder);
+/**
+ * Stop a Deferred, without running any more of its
+ *  callbacks or errbacks. Pairs that own their user_data
+ *  free it.
+ *
+ * It's no longer waited on, so a response or timeout for it
+ *  is ignored. Deferreds waiting on it are cancelled too, and
+ *  so is the Deferred it's waiting on unless something else
+ *  still waits for it. d is freed unless it's running or the
+ *  caller owns it.
+ */
+void libballyhoo_deferred_cancel(BallyhooAccount *ba, Deferred *d);
+
+/**
+ * Join Deferreds so they can run in parallel. The Deferred
+ *  returned runs its callbacks once all of them have
+ *  succeeded, or its errbacks with the first fault. With
+ *  gather the callbacks are passed a DeferredListResult,
+ *  otherwise NULL.
+ *
+ * Each Deferred keeps its own result for any callbacks added
+ *  after. With destroy, the results belong to the list
+ *  instead: they're handed to its callbacks, or freed if it
+ *  faults or is cancelled, including any that arrive after.
+ *
+ * Cancelling one of them cancels the list, and cancelling
+ *  the list cancels the ones nothing else waits on. Like a
+ *  call's Deferred, the list is freed once it has run. count
+ *  must be at least 1.
+ */
+Deferred *libballyhoo_deferred_list(Deferred **deferreds, int count, gboolean gather,
+                                    GDestroyNotify destroy);
+
+/* Cancellation */
+BallyhooCancellable *libballyhoo_cancellable_new(void);
+/**
+ * Free c without cancelling what it holds
+ */
+void libballyhoo_cancellable_free(BallyhooCancellable *c);
+/**
+ * Cancel d along with c. d can only belong to one
+ *  BallyhooCancellable, and leaves it once it's freed.
+ *  c can be NULL.
+ */
+void libballyhoo_cancellable_add(BallyhooCancellable *c, Deferred *d);
+/**
+ * Cancel every Deferred in c. c can be used again after.
+ */
+void libballyhoo_cancellable_cancel(BallyhooAccount *ba, BallyhooCancellable *c);
 
 /* Sending */
-void libballyhoo_send_chunks(BallyhooAccount *ba,
-                             PurpleSslConnection *gsc, GList *messages);
-gboolean libballyhoo_send_raw(PurpleSslConnection *gsc, void* buffer, size_t len);
+/**
+ * Frame an encoded message and queue all of it to be
+ *  written, then free it. Messages of at least
+ *  LIBBALLYHOO_DEFLATE_MIN bytes (or
+ *  LIBBALLYHOO_DEFLATE_DICTIONARY_MIN with the preset
+ *  dictionary) are compressed if the server accepts deflate
+ *  and it makes them smaller. The queue is written once control returns to the
+ *  main loop, or as soon as it passes LIBBALLYHOO_OUTBUF_FLUSH.
+ */
+void libballyhoo_send_message(BallyhooAccount *ba,
+                              PurpleSslConnection *gsc, BallyhooOutMessage *m);
+/**
+ * Send a call that takes no parameters, and return its
+ *  uuid. It is encoded and framed once per connection, and
+ *  after that each call only copies the framed bytes. The
+ *  priority is the one it was first sent with.
+ */
+guint64 libballyhoo_send_constant_call(BallyhooAccount *ba, int priority,
+                                       const char *method_name);
+/**
+ * Write as much as the socket will take of everything queued
+ *  by libballyhoo_send_message now, instead of waiting for the
+ *  main loop to come around. The rest is written as the
+ *  socket becomes writable.
+ *
+ * Returns FALSE if the connection was lost.
+ */
+gboolean libballyhoo_flush(BallyhooAccount *ba);
+
+/**
+ * Has more than LIBBALLYHOO_OUTBUF_HIGH been queued without
+ *  being written? Callers should hold off on sending anything
+ *  optional until LIBBALLYHOO_SIGNAL_WRITABLE is emitted.
+ */
+gboolean libballyhoo_is_congested(BallyhooAccount *ba);
 
 #endif
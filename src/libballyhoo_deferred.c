@@ -17,208 +17,649 @@
  */
 
 #include "libballyhoo_deferred.h"
+#include "libballyhoo_pool.h"
 
+#include <string.h>
 #include <debug.h>
 
-DeferredResponse *libballyhoo_deferred_handle_cb(BallyhooAccount *ba, gpointer result, gpointer user_data);
-DeferredResponse *libballyhoo_deferred_handle_err(BallyhooAccount *ba, gpointer result, gpointer user_data);
+// every call builds a Deferred, so recycle them instead of
+//  going back to the heap
+static BallyhooPool deferred_pool = LIBBALLYHOO_POOL_INIT(Deferred, 64);
+
+/* a Deferred being run, and where its chain is at */
+typedef struct _ChainFrame {
+  Deferred *d;
+  gboolean success;
+  gpointer result;
+} ChainFrame;
+
+/* one of the Deferreds a list joins */
+typedef struct _DeferredListSlot {
+  struct _DeferredList *list;
+  Deferred *d;
+  gboolean done;
+} DeferredListSlot;
+
+typedef struct _DeferredList {
+  Deferred *d; // NULL once it has been freed
+  gboolean fired; // run, failed or cancelled
+  gboolean gather;
+  GDestroyNotify destroy;
+  int waiting; // slots that aren't done yet
+  DeferredListResult result;
+  DeferredListSlot *slots;
+} DeferredList;
+
+static DeferredResponse libballyhoo_deferred_resume(BallyhooAccount *ba,
+                                                    gpointer result, gpointer user_data);
+static DeferredResponse libballyhoo_deferred_list_cb(BallyhooAccount *ba,
+                                                     gpointer result, gpointer user_data);
+static DeferredResponse libballyhoo_deferred_list_err(BallyhooAccount *ba,
+                                                      gpointer fault, gpointer user_data);
+static Deferred *libballyhoo_deferred_list_step(DeferredListSlot *slot, gboolean success,
+                                                gpointer *result);
+static void libballyhoo_deferred_list_stop(DeferredList *l);
+static void libballyhoo_deferred_list_done(DeferredListSlot *slot);
+static void libballyhoo_deferred_list_release(DeferredList *l);
 
 Deferred *libballyhoo_deferred_build(guint timeout)
 {
-  Deferred *dfr = g_new0(Deferred, 1);
-  dfr->expiration = time(NULL) + timeout;
+  Deferred *dfr = libballyhoo_pool_alloc0(&deferred_pool);
+  libballyhoo_timer_init(&dfr->timer, libballyhoo_timers_now() + timeout * 1000, dfr);
   dfr->fired = FALSE;
-  dfr->callbacks = g_queue_new();
+  dfr->pairs = dfr->inline_pairs;
+  dfr->capacity = LIBBALLYHOO_INLINE_PAIRS;
 
   return dfr;
 }
 
-void libballyhoo_deferred_add_callbacks(Deferred *d, DeferredCbFunction cb,
-                                        DeferredErrFunction err)
+/* free what a pair owns when it's never going to run */
+static void drop_pair(const CallbackPair *cp)
+{
+  if (cp->destroy) {
+    cp->destroy(cp->user_data);
+  }
+}
+
+void libballyhoo_deferred_free(Deferred *d)
+{
+  if (d == NULL)
+    return;
+
+  for (int i = d->first; i < d->first + d->count; i++) {
+    drop_pair(&d->pairs[i]);
+  }
+  if (d->list) {
+    DeferredList *l = d->list;
+    if (!l->fired) {
+      libballyhoo_deferred_list_stop(l);
+    }
+    l->d = NULL;
+    libballyhoo_deferred_list_release(l);
+  }
+  if (d->cancellable) {
+    g_queue_unlink(&d->cancellable->deferreds, &d->cancel_link);
+  }
+  if (d->pairs != d->inline_pairs) {
+    g_free(d->pairs);
+  }
+  libballyhoo_pool_free(&deferred_pool, d);
+}
+
+void libballyhoo_deferred_pool_drain(void)
+{
+  libballyhoo_pool_drain(&deferred_pool);
+}
+
+DeferredResponse libballyhoo_deferred_response(enum DeferredResponseType type,
+                                               gpointer result)
+{
+  DeferredResponse r = { type, result };
+
+  return r;
+}
+
+/**
+ * Make room for one more pair at the end, sliding the
+ *  pairs still to run back to the start before growing
+ */
+static void reserve_pair(Deferred *d)
+{
+  if (d->first + d->count < d->capacity) {
+    return;
+  }
+
+  if (d->first > 0) {
+    memmove(d->pairs, d->pairs + d->first, d->count * sizeof(CallbackPair));
+    d->first = 0;
+    if (d->count < d->capacity) {
+      return;
+    }
+  }
+
+  int capacity = d->capacity * 2;
+  if (d->pairs == d->inline_pairs) {
+    d->pairs = g_new(CallbackPair, capacity);
+    memcpy(d->pairs, d->inline_pairs, d->count * sizeof(CallbackPair));
+  } else {
+    d->pairs = g_renew(CallbackPair, d->pairs, capacity);
+  }
+  d->capacity = capacity;
+}
+
+/* make room for one more frame, moving off the stack if needed */
+static ChainFrame *grow_frames(ChainFrame *frames, ChainFrame *inline_frames,
+                               int *capacity)
+{
+  *capacity *= 2;
+  if (frames == inline_frames) {
+    frames = g_new(ChainFrame, *capacity);
+    memcpy(frames, inline_frames, LIBBALLYHOO_CHAIN_DEPTH * sizeof(ChainFrame));
+  } else {
+    frames = g_renew(ChainFrame, frames, *capacity);
+  }
+
+  return frames;
+}
+
+/* take the next pair to run, or return FALSE if there aren't any */
+static gboolean pop_pair(Deferred *d, CallbackPair *cp)
+{
+  if (d->count == 0) {
+    return FALSE;
+  }
+
+  *cp = d->pairs[d->first++];
+  d->count--;
+
+  return TRUE;
+}
+
+/* put a pair back to be run next */
+static void push_front_pair(Deferred *d, const CallbackPair *cp)
+{
+  if (d->first == 0) {
+    reserve_pair(d);
+    memmove(d->pairs + 1, d->pairs, d->count * sizeof(CallbackPair));
+    d->first = 1;
+  }
+
+  d->pairs[--d->first] = *cp;
+  d->count++;
+}
+
+void libballyhoo_deferred_add_callbacks_full(Deferred *d, DeferredCbFunction cb,
+                                             DeferredErrFunction err, gpointer user_data)
+{
+  libballyhoo_deferred_add_callbacks_notify(d, cb, err, user_data, NULL);
+}
+
+void libballyhoo_deferred_add_callbacks_notify(Deferred *d, DeferredCbFunction cb,
+                                               DeferredErrFunction err, gpointer user_data,
+                                               GDestroyNotify destroy)
 {
   // !mwd - TODO: if fired, execute immediately
-  
-  CallbackPair *cp = g_new0(CallbackPair, 1);
+
+  reserve_pair(d);
+
+  CallbackPair *cp = &d->pairs[d->first + d->count++];
   cp->cb = cb;
   cp->err = err;
-  
-  g_queue_push_tail(d->callbacks, cp);
+  cp->user_data = user_data;
+  cp->destroy = destroy;
 }
 
-void libballyhoo_deferred_add_callback_pair(Deferred *d, CallbackPair *cp)
+void libballyhoo_deferred_add_callbacks(Deferred *d, DeferredCbFunction cb,
+                                        DeferredErrFunction err)
 {
-  // !mwd - TODO: if fired, execute immediately
-  
-  g_queue_push_tail(d->callbacks, cp);
+  libballyhoo_deferred_add_callbacks_full(d, cb, err, NULL);
 }
 
-DeferredResponse *libballyhoo_deferred_callback(Deferred *d,
-                                                BallyhooAccount *ba, gpointer result)
+void libballyhoo_deferred_set_decoder(Deferred *d, const BallyhooDecoder *decoder)
 {
-  purple_debug_info("helplightning", "DeferredCallback for %p\n", d);
-  gpointer current_result = result;
-  DeferredResponse* resp = NULL;
+  d->decoder = decoder;
+}
 
-  d->is_firing = TRUE;
-  
-  if (d->fired == TRUE) {
+DeferredResponse libballyhoo_deferred_run(Deferred *d, BallyhooAccount *ba,
+                                          gboolean success, gpointer result)
+{
+  purple_debug_info("helplightning", "DeferredRun for %p\n", d);
+
+  if (d->fired || d->is_firing) {
     purple_debug_info("helplightning", "Warning, already fired deferred!\n");
-    return NULL;
+    return libballyhoo_deferred_response(DEFERRED_DEFERRED, NULL);
   }
-  
-  CallbackPair *cp = g_queue_pop_head(d->callbacks);
-  while (cp != NULL) {
-    purple_debug_info("helplightning", "executing deferred\n");
 
-    // make sure the current pair has a callback, otherwise
-    //  skip to the next
-    if (cp->cb) {
-      resp = cp->cb(ba, current_result, cp->user_data);
-      purple_debug_info("helplightning", "got a response %d\n", resp->type);
-    
-      // if current result is a Deferred, then add all our callback pairs to that
-      //  deferred instead.
-      if (resp->type == DEFERRED_DEFERRED) {
-        purple_debug_info("helplightning", "chaining deferreds!\n");
-        Deferred *dfr = resp->result;
-        
-        // create a callback pair
-        CallbackPair *cp2 = g_new0(CallbackPair, 1);
-        cp2->user_data = d;
-        cp2->cb = libballyhoo_deferred_handle_cb;
-        cp2->err = libballyhoo_deferred_handle_err;
-        
-        libballyhoo_deferred_add_callback_pair(dfr, cp2);
-        
-        return resp;
-      } else if (resp->type == DEFERRED_FAULT) {
-        // call the pair's errback. Put the current cb
-        // back on the head of the queue
-        g_queue_push_head(d->callbacks, cp);
-
-        gpointer result = resp->result;
-        g_free(resp);
-        
-        return libballyhoo_deferred_errback(d, ba, result);
+  // Deferreds that were waiting on this one, and lists it
+  //  completes, are run by pushing a frame instead of
+  //  recursing, so a long chain runs in constant stack
+  ChainFrame inline_frames[LIBBALLYHOO_CHAIN_DEPTH];
+  ChainFrame *frames = inline_frames;
+  int capacity = LIBBALLYHOO_CHAIN_DEPTH;
+  int depth = 1;
+
+  frames[0].d = d;
+  frames[0].success = success;
+  frames[0].result = result;
+  d->is_firing = TRUE;
+
+  DeferredResponse last = { DEFERRED_RESPONSE, NULL };
+
+  while (depth > 0) {
+    ChainFrame *f = &frames[depth - 1];
+    CallbackPair cp;
+
+    if (f->d->cancelled) {
+      // cancelled by one of its own callbacks, stop here
+      f->d->is_firing = FALSE;
+      if (depth == 1) {
+        last = libballyhoo_deferred_response(DEFERRED_FAULT, NULL);
       } else {
-        current_result = resp->result;
+        libballyhoo_deferred_free(f->d);
+      }
+      depth--;
+      continue;
+    }
+
+    if (!pop_pair(f->d, &cp)) {
+      // all done, don't refire
+      purple_debug_info("helplightning", "finished callbacks for %p\n", f->d);
+      f->d->is_firing = FALSE;
+      f->d->fired = TRUE;
+      f->d->result = f->result;
+
+      if (depth == 1) {
+        last = libballyhoo_deferred_response(f->success ? DEFERRED_RESPONSE : DEFERRED_FAULT,
+                                             f->result);
+      } else {
+        // nothing else holds a Deferred that was waiting
+        libballyhoo_deferred_free(f->d);
+      }
+      depth--;
+      continue;
+    }
+
+    if (cp.cb == libballyhoo_deferred_resume) {
+      // a Deferred that was waiting on this one picks up
+      //  where it left off with our result. We carry on with
+      //  the same result once it's done.
+      Deferred *waiting = cp.user_data;
+      if (waiting->fired || waiting->is_firing) {
+        continue;
+      }
+
+      if (depth == capacity) {
+        frames = grow_frames(frames, inline_frames, &capacity);
+        f = &frames[depth - 1];
       }
-    
-      g_free(resp);
+
+      frames[depth].d = waiting;
+      frames[depth].success = f->success;
+      frames[depth].result = f->result;
+      waiting->waiting_on = NULL;
+      waiting->is_firing = TRUE;
+      depth++;
+      continue;
+    }
+
+    if (cp.cb == libballyhoo_deferred_list_cb) {
+      // hand our result to the list. If that completes it,
+      //  the list runs next and we carry on once it's done.
+      gpointer list_result = f->result;
+      Deferred *list = libballyhoo_deferred_list_step(cp.user_data, f->success,
+                                                      &list_result);
+      if (list == NULL) {
+        continue;
+      }
+
+      if (depth == capacity) {
+        frames = grow_frames(frames, inline_frames, &capacity);
+        f = &frames[depth - 1];
+      }
+
+      frames[depth].d = list;
+      frames[depth].success = f->success;
+      frames[depth].result = list_result;
+      list->is_firing = TRUE;
+      depth++;
+      continue;
+    }
+
+    // make sure the current pair has a callback (or errback),
+    //  otherwise skip to the next
+    DeferredCbFunction fn = f->success ? cp.cb : cp.err;
+    if (fn == NULL) {
+      drop_pair(&cp);
+      continue;
+    }
+
+    purple_debug_info("helplightning", "executing deferred\n");
+    DeferredResponse resp = fn(ba, f->result, cp.user_data);
+    purple_debug_info("helplightning", "got a response %d\n", resp.type);
+
+    if (resp.type == DEFERRED_DEFERRED) {
+      // the rest of the chain waits for the Deferred we got
+      //  back, which now owns this one
+      purple_debug_info("helplightning", "chaining deferreds!\n");
+      Deferred *dfr = resp.result;
+      libballyhoo_deferred_add_callbacks_full(dfr, libballyhoo_deferred_resume,
+                                              libballyhoo_deferred_resume, f->d);
+      f->d->waiting_on = dfr;
+      f->d->is_firing = FALSE;
+
+      if (depth == 1) {
+        last = resp;
+      }
+      depth--;
+    } else if (resp.type == DEFERRED_FAULT) {
+      if (f->success) {
+        // call the pair's errback. Put the current pair
+        //  back on the head of the queue. The callback
+        //  already had its user_data.
+        cp.destroy = NULL;
+        push_front_pair(f->d, &cp);
+        f->success = FALSE;
+      }
+      // otherwise continue to the next errback
+      f->result = resp.result;
+    } else {
+      // switch (back) over to the callbacks. We don't call
+      //  the callback in the current pair, only the next one
+      //  in the chain.
+      f->success = TRUE;
+      f->result = resp.result;
     }
-    
-    g_free(cp);
-    
-    cp = g_queue_pop_head(d->callbacks);
   }
 
-  purple_debug_info("helplightning", "finished callbacks for %p\n", d);
-  resp = g_new0(DeferredResponse, 1);
-  resp->type = DEFERRED_RESPONSE;
-  resp->result = current_result;
+  if (frames != inline_frames) {
+    g_free(frames);
+  }
 
-  // all done, don't refire
-  d->fired = TRUE;
-  
-  return resp;
+  return last;
 }
 
-DeferredResponse *libballyhoo_deferred_errback(Deferred *d,
+DeferredResponse libballyhoo_deferred_callback(Deferred *d,
                                                BallyhooAccount *ba, gpointer result)
 {
-  gpointer current_result = result;
-  DeferredResponse* resp = NULL;
+  return libballyhoo_deferred_run(d, ba, TRUE, result);
+}
 
-  d->is_firing = TRUE;
-  
-  if (d->fired == TRUE) {
-    purple_debug_info("helplightning", "Warning, already fired deferred!\n");
-    return NULL;
+DeferredResponse libballyhoo_deferred_errback(Deferred *d,
+                                              BallyhooAccount *ba, gpointer result)
+{
+  return libballyhoo_deferred_run(d, ba, FALSE, result);
+}
+
+/**
+ * Only marks a pair that resumes a waiting Deferred,
+ *  libballyhoo_deferred_run() handles those itself
+ */
+static DeferredResponse libballyhoo_deferred_resume(BallyhooAccount *ba,
+                                                    gpointer result, gpointer user_data)
+{
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result);
+}
+
+/**
+ * Take out the pair that resumes waiting. Returns FALSE if
+ *  there wasn't one.
+ */
+static gboolean remove_resume_pair(Deferred *d, Deferred *waiting)
+{
+  for (int i = d->first; i < d->first + d->count; i++) {
+    if (d->pairs[i].cb == libballyhoo_deferred_resume && d->pairs[i].user_data == waiting) {
+      memmove(d->pairs + i, d->pairs + i + 1,
+              (d->first + d->count - i - 1) * sizeof(CallbackPair));
+      d->count--;
+      return TRUE;
+    }
   }
-  
-  CallbackPair *cp = g_queue_pop_head(d->callbacks);
-  while (cp != NULL) {
-    purple_debug_info("helplightning", "executing deferred\n");
 
-    // make sure the current pair has an errback, otherwise
-    //  skip to the next
-    if (cp->err) {
-      resp = cp->err(ba, current_result, cp->user_data);
-      purple_debug_info("helplightning", "got a response %d\n", resp->type);
-    
-      // if current result is a Deferred, then add all our callback pairs to that
-      //  deferred instead.
-      if (resp->type == DEFERRED_DEFERRED) {
-        purple_debug_info("helplightning", "chaining deferreds!\n");
-        Deferred *dfr = resp->result;
-        
-        // create a callback pair
-        CallbackPair *cp2 = g_new0(CallbackPair, 1);
-        cp2->user_data = d;
-        cp2->cb = libballyhoo_deferred_handle_cb;
-        cp2->err = libballyhoo_deferred_handle_err;
-        
-        libballyhoo_deferred_add_callback_pair(dfr, cp2);
-        
-        return resp;
-      } else if (resp->type == DEFERRED_FAULT) {
-        // continue to the next errback
-        current_result = resp->result;
+  return FALSE;
+}
+
+static gboolean has_waiting(Deferred *d)
+{
+  for (int i = d->first; i < d->first + d->count; i++) {
+    if (d->pairs[i].cb == libballyhoo_deferred_resume) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void libballyhoo_deferred_cancel(BallyhooAccount *ba, Deferred *d)
+{
+  // everything chained to d is collected first and freed at
+  //  the end, so nothing is looked at after it's freed
+  GQueue work = G_QUEUE_INIT;
+  GQueue dead = G_QUEUE_INIT;
+  g_queue_push_tail(&work, d);
+
+  while ((d = g_queue_pop_head(&work)) != NULL) {
+    if (d->cancellable) {
+      g_queue_unlink(&d->cancellable->deferreds, &d->cancel_link);
+      d->cancellable = NULL;
+    }
+    if (d->fired || d->cancelled) {
+      continue;
+    }
+    purple_debug_info("helplightning", "cancelling deferred %p\n", d);
+    d->cancelled = TRUE;
+
+    // a Deferred we're waiting on belongs to us, and
+    //  everything else is owned by the pending calls, unless
+    //  the caller built it
+    gboolean owned = d->waiting_on != NULL;
+    if (ba && libballyhoo_pending_lookup(ba->pending_callbacks, d->uuid) == d) {
+      libballyhoo_pending_remove(ba->pending_callbacks, d->uuid);
+      libballyhoo_timers_remove(ba->timers, &d->timer);
+      owned = TRUE;
+    }
+
+    // what we're waiting on goes too, unless it still has
+    //  something else to resume
+    Deferred *w = d->waiting_on;
+    if (w && remove_resume_pair(w, d) && !has_waiting(w)) {
+      g_queue_push_tail(&work, w);
+    }
+
+    // the Deferreds a list joins go too, unless something
+    //  else waits for them
+    DeferredList *l = d->list;
+    if (l) {
+      owned = TRUE;
+      if (!l->fired) {
+        libballyhoo_deferred_list_stop(l);
+        for (int i = 0; i < l->result.count; i++) {
+          if (!l->slots[i].done && !has_waiting(l->slots[i].d)) {
+            g_queue_push_tail(&work, l->slots[i].d);
+          }
+        }
+      }
+    }
+
+    // and anything waiting on us would never run
+    CallbackPair cp;
+    while (pop_pair(d, &cp)) {
+      if (cp.cb == libballyhoo_deferred_resume) {
+        g_queue_push_tail(&work, cp.user_data);
+      } else if (cp.cb == libballyhoo_deferred_list_cb) {
+        DeferredListSlot *slot = cp.user_data;
+        if (slot->list->d && !slot->list->fired) {
+          g_queue_push_tail(&work, slot->list->d);
+        }
+        libballyhoo_deferred_list_done(slot);
       } else {
-        // switch over to the callbacks. We don't
-        //  call the callback in the current pair
-        //  only the next one in the chain.
-
-        gpointer result = resp->result;
-        g_free(resp);
-        g_free(cp);
-        
-        return libballyhoo_deferred_callback(d, ba, result);
+        drop_pair(&cp);
       }
-    
-      g_free(resp);
     }
-    
-    g_free(cp);
-    
-    cp = g_queue_pop_head(d->callbacks);
+
+    // a running Deferred is freed once it stops
+    if (owned && !d->is_firing) {
+      g_queue_push_tail(&dead, d);
+    }
   }
 
-  purple_debug_info("helplightning", "finished callbacks for %p\n", d);
-  resp = g_new0(DeferredResponse, 1);
-  resp->type = DEFERRED_RESPONSE;
-  resp->result = current_result;
+  while ((d = g_queue_pop_head(&dead)) != NULL) {
+    libballyhoo_deferred_free(d);
+  }
+}
 
-  // all done, don't refire
-  d->fired = TRUE;
-  
-  return resp;
+Deferred *libballyhoo_deferred_list(Deferred **deferreds, int count, gboolean gather,
+                                    GDestroyNotify destroy)
+{
+  g_return_val_if_fail(count > 0, NULL);
+
+  DeferredList *l = g_new0(DeferredList, 1);
+  l->d = libballyhoo_deferred_build(0);
+  l->d->list = l;
+  l->gather = gather;
+  l->destroy = destroy;
+  l->waiting = count;
+  l->result.count = count;
+  l->result.results = g_new0(gpointer, count);
+  l->slots = g_new0(DeferredListSlot, count);
+
+  for (int i = 0; i < count; i++) {
+    l->slots[i].list = l;
+    l->slots[i].d = deferreds[i];
+    libballyhoo_deferred_add_callbacks_full(deferreds[i], libballyhoo_deferred_list_cb,
+                                            libballyhoo_deferred_list_err, &l->slots[i]);
+  }
+
+  return l->d;
+}
+
+/* free the list once its Deferred is gone and nothing is left to report to it */
+static void libballyhoo_deferred_list_release(DeferredList *l)
+{
+  if (l->waiting == 0 && l->d == NULL) {
+    g_free(l->result.results);
+    g_free(l->slots);
+    g_free(l);
+  }
+}
+
+static void libballyhoo_deferred_list_done(DeferredListSlot *slot)
+{
+  DeferredList *l = slot->list;
+  slot->done = TRUE;
+  l->waiting--;
+
+  libballyhoo_deferred_list_release(l);
+}
+
+/* the list won't succeed, so free the results it holds */
+static void libballyhoo_deferred_list_stop(DeferredList *l)
+{
+  l->fired = TRUE;
+  if (l->destroy == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < l->result.count; i++) {
+    if (l->result.results[i]) {
+      l->destroy(l->result.results[i]);
+      l->result.results[i] = NULL;
+    }
+  }
+}
+
+/**
+ * Record the result of one of the list's Deferreds. Returns
+ *  the list's Deferred if it's ready to run, with what to
+ *  pass it in result, otherwise NULL.
+ */
+static Deferred *libballyhoo_deferred_list_step(DeferredListSlot *slot, gboolean success,
+                                                gpointer *result)
+{
+  DeferredList *l = slot->list;
+  Deferred *ready = NULL;
+
+  if (l->fired) {
+    // too late, nobody will see it
+    if (success && l->destroy && *result) {
+      l->destroy(*result);
+    }
+  } else if (success) {
+    l->result.results[slot - l->slots] = *result;
+
+    // the last one to succeed runs the list
+    if (l->waiting == 1) {
+      l->fired = TRUE;
+      ready = l->d;
+      *result = l->gather ? &l->result : NULL;
+    }
+  } else {
+    // the first fault fails the list
+    libballyhoo_deferred_list_stop(l);
+    ready = l->d;
+  }
+
+  // the list's Deferred holds on to it until it's freed
+  libballyhoo_deferred_list_done(slot);
+
+  return ready;
 }
 
-DeferredResponse *libballyhoo_deferred_handle_cb(BallyhooAccount *ba,
-                                                 gpointer result, gpointer user_data)
+/**
+ * Only mark the pairs that report to a list,
+ *  libballyhoo_deferred_run() handles those itself
+ */
+static DeferredResponse libballyhoo_deferred_list_cb(BallyhooAccount *ba,
+                                                     gpointer result, gpointer user_data)
 {
-  Deferred *dfr = (Deferred*)user_data;
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result);
+}
 
-  DeferredResponse *resp = libballyhoo_deferred_callback(dfr, ba, result);
+static DeferredResponse libballyhoo_deferred_list_err(BallyhooAccount *ba,
+                                                      gpointer fault, gpointer user_data)
+{
+  return libballyhoo_deferred_response(DEFERRED_FAULT, fault);
+}
 
-  // We can't free here. This causes an issue
-  //  if we have multiple callbacks all return a Deferred
-  //  within a single deferred, meaning we have multiple
-  //  chains
-  //g_free(dfr);
+BallyhooCancellable *libballyhoo_cancellable_new(void)
+{
+  BallyhooCancellable *c = g_new0(BallyhooCancellable, 1);
+  g_queue_init(&c->deferreds);
 
-  return resp;
+  return c;
 }
 
-DeferredResponse *libballyhoo_deferred_handle_err(BallyhooAccount *ba,
-                                                  gpointer result, gpointer user_data)
+void libballyhoo_cancellable_free(BallyhooCancellable *c)
 {
-  Deferred *dfr = (Deferred*)user_data;
+  if (c == NULL)
+    return;
 
-  DeferredResponse *resp = libballyhoo_deferred_errback(dfr, ba, result);
+  GList *link;
+  while ((link = g_queue_peek_head_link(&c->deferreds)) != NULL) {
+    Deferred *d = link->data;
+    g_queue_unlink(&c->deferreds, link);
+    d->cancellable = NULL;
+  }
+  g_free(c);
+}
 
-  //g_free(dfr);
+void libballyhoo_cancellable_add(BallyhooCancellable *c, Deferred *d)
+{
+  if (c == NULL)
+    return;
 
-  return resp;
+  if (d->cancellable) {
+    g_queue_unlink(&d->cancellable->deferreds, &d->cancel_link);
+  }
+  d->cancel_link.data = d;
+  g_queue_push_tail_link(&c->deferreds, &d->cancel_link);
+  d->cancellable = c;
+}
+
+void libballyhoo_cancellable_cancel(BallyhooAccount *ba, BallyhooCancellable *c)
+{
+  // cancelling takes each Deferred out of c
+  GList *link;
+  while ((link = g_queue_peek_head_link(&c->deferreds)) != NULL) {
+    libballyhoo_deferred_cancel(ba, link->data);
+  }
 }
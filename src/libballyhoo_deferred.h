@@ -22,13 +22,26 @@
 #include "libballyhoo.h"
 #include <glib.h>
 
+/**
+ * Execute the chain, starting with the callbacks (or the
+ *  errbacks if success is FALSE) and switching between them
+ *  as each step succeeds or faults.
+ *
+ * Returns the last step. If its type is DEFERRED_DEFERRED,
+ *  the chain is waiting on that Deferred: it owns d from
+ *  then on, and frees it once the rest of the chain has run.
+ *  It's also returned, and d left alone, if d has already
+ *  been run. Otherwise d is done and the caller frees it.
+ */
+DeferredResponse libballyhoo_deferred_run(Deferred *d, BallyhooAccount *ba,
+                                          gboolean success, gpointer result);
 /**
  * Execute a callback chain passing in the initial result
  */
-DeferredResponse *libballyhoo_deferred_callback(Deferred *d, BallyhooAccount *ba, gpointer result);
+DeferredResponse libballyhoo_deferred_callback(Deferred *d, BallyhooAccount *ba, gpointer result);
 /**
  * Execute an error chain passing in the initial fault.
  */
-DeferredResponse *libballyhoo_deferred_errback(Deferred *d, BallyhooAccount *ba, gpointer result);
+DeferredResponse libballyhoo_deferred_errback(Deferred *d, BallyhooAccount *ba, gpointer result);
 
 #endif
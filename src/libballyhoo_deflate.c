@@ -21,73 +21,200 @@
 #include <debug.h>
 
 #define CHUNK 16384
+#define MAX_HINT (1024 * 1024) // never reserve more than this up front
 
-gpointer libballyhoo_deflate_decompress(gpointer input,
+// The preset dictionary. Deflate can refer back into it
+//  from the very first byte, so even a short message gets
+//  the xml-rpc boilerplate almost for free. zlib looks
+//  furthest back last, so the most common strings are at
+//  the end.
+static const char dictionary[] =
+  "conn_register user_authenticate user_refresh_token user_get_workspaces "
+  "workspace_switch enterprise_contact_refresh user_search_team "
+  "session_get_by_id session_create_with_contact session_batch_set_message_flag "
+  "session_created session_message_received conn_pong conn_ping session_send_message"
+  "<member><name>faultCode</name><value><int></int></value></member>"
+  "<member><name>faultString</name><value><string>"
+  "<name>reachable</name><name>backward</name><name>workspace</name>"
+  "<name>entries</name><name>owner_id</name><name>session_id</name>"
+  "<name>users</name><name>username</name><name>token</name>"
+  "<name>status</name><name>email</name><name>body</name><name>name</name><name>id</name>"
+  "<value><boolean>0</boolean></value><value><boolean>1</boolean></value>"
+  "<value><i4></i4></value><value><int></int></value>"
+  "<array><data></data></array>"
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n<methodCall>\r\n<methodName>"
+  "</methodName>\r\n<params>\r\n<param><value><string></string></value></param>\r\n"
+  "</params>\r\n</methodCall>\r\n"
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?><methodResponse><params><param><value>"
+  "<struct><member><name></name><value><string></string></value></member></struct>"
+  "</value></param></params></methodResponse>";
+
+/* the id zlib puts in a stream compressed against it */
+static uLong dictionary_id()
+{
+  static uLong id = 0;
+  if (id == 0) {
+    id = adler32(adler32(0L, Z_NULL, 0), (const Bytef*)dictionary, sizeof(dictionary) - 1);
+  }
+
+  return id;
+}
+
+BallyhooInflater *libballyhoo_inflater_new()
+{
+  BallyhooInflater *i = g_new0(BallyhooInflater, 1);
+  i->strm.zalloc = Z_NULL;
+  i->strm.zfree = Z_NULL;
+  i->strm.opaque = Z_NULL;
+  i->strm.avail_in = 0;
+  i->strm.next_in = Z_NULL;
+  if (inflateInit(&i->strm) != Z_OK) {
+    g_free(i);
+    return NULL;
+  }
+
+  return i;
+}
+
+void libballyhoo_inflater_free(BallyhooInflater *i)
+{
+  if (i == NULL)
+    return;
+
+  inflateEnd(&i->strm);
+  g_free(i->output);
+  g_free(i);
+}
+
+void libballyhoo_inflater_reset(BallyhooInflater *i, size_t size_hint)
+{
+  // reuses the window zlib already allocated
+  inflateReset(&i->strm);
+
+  g_free(i->output);
+  i->capacity = CLAMP(size_hint, 64, MAX_HINT);
+  i->output = g_malloc(i->capacity);
+  i->length = 0;
+  i->status = 0;
+}
+
+int libballyhoo_inflater_feed(BallyhooInflater *i, gconstpointer data, size_t length)
+{
+  if (i->status != 0) {
+    // anything after the end of the stream is ignored
+    return i->status;
+  }
+
+  i->strm.next_in = (Bytef*)data;
+  i->strm.avail_in = length;
+
+  while (TRUE) {
+    if (i->length == i->capacity) {
+      // grow geometrically, so inflating stays linear overall
+      i->capacity = MAX(i->capacity * 2, CHUNK);
+      i->output = g_realloc(i->output, i->capacity);
+    }
+    i->strm.next_out = i->output + i->length;
+    i->strm.avail_out = i->capacity - i->length;
+
+    int ret = inflate(&i->strm, Z_NO_FLUSH);
+    i->length = i->capacity - i->strm.avail_out;
+
+    if (ret == Z_STREAM_END) {
+      i->status = 1;
+      break;
+    } else if (ret == Z_NEED_DICT && i->strm.adler == dictionary_id()) {
+      inflateSetDictionary(&i->strm, (const Bytef*)dictionary, sizeof(dictionary) - 1);
+      continue;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      purple_debug_info("helplightning", "inflate error: %d\n", ret);
+      i->status = -1;
+      break;
+    }
+
+    // stop once the input is used up and nothing is
+    //  left waiting for room in the output
+    if (i->strm.avail_in == 0 && i->strm.avail_out > 0) {
+      break;
+    }
+  }
+
+  return i->status;
+}
+
+gpointer libballyhoo_inflater_steal(BallyhooInflater *i, size_t *length)
+{
+  gpointer output = i->output;
+  *length = i->length;
+
+  i->output = NULL;
+  i->length = 0;
+  i->capacity = 0;
+
+  return output;
+}
+
+gpointer libballyhoo_deflate_decompress(gconstpointer input,
                                         size_t length,
                                         size_t *output_length)
 {
-  unsigned char *in = (unsigned char*)input;
+  BallyhooInflater *i = libballyhoo_inflater_new();
+  if (i == NULL)
+    return NULL;
+
+  purple_debug_info("helplightning", "inflating %zu bytes\n", length);
+
   gpointer output = NULL;
-  unsigned char out[CHUNK];
+  libballyhoo_inflater_reset(i, length * LIBBALLYHOO_INFLATE_RATIO);
+  if (libballyhoo_inflater_feed(i, input, length) == 1) {
+    output = libballyhoo_inflater_steal(i, output_length);
+  }
+  libballyhoo_inflater_free(i);
+
+  return output;
+}
+
+gboolean libballyhoo_deflate_compress(gconstpointer input,
+                                      size_t length,
+                                      GString *output,
+                                      gboolean use_dictionary)
+{
   z_stream strm;
   int ret;
-  unsigned int have;
 
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
-  strm.avail_in = 0;
-  strm.next_in = Z_NULL;
-  ret = inflateInit(&strm);
+  ret = deflateInit(&strm, Z_DEFAULT_COMPRESSION);
   if (ret != Z_OK)
-    return NULL;
+    return FALSE;
 
-  purple_debug_info("helplightning", "deflating %ld bytes\n", length);
-  
-  *output_length = 0;
+  if (use_dictionary) {
+    deflateSetDictionary(&strm, (const Bytef*)dictionary, sizeof(dictionary) - 1);
+  }
 
-  /* decompress until the end of our input */
-  size_t read = 0;
-  do {
-    int s = MIN(CHUNK, length - read);
-    purple_debug_info("helplightning", "reading next %d. already read %ld\n", s, read);
-    strm.avail_in = s;
+  // there's no point keeping anything that isn't smaller,
+  //  so the output never needs more than length bytes
+  size_t offset = output->len;
+  g_string_set_size(output, offset + length);
 
-    if (strm.avail_in == 0) {
-      break;
-    }
-    strm.next_in = in + read;
-    read += s;
-
-    do {
-      strm.avail_out = CHUNK;
-      strm.next_out = out;
-
-      purple_debug_info("helplightning", "inner do: inflat\n");
-      ret = inflate(&strm, Z_NO_FLUSH);
-      if (ret == Z_STREAM_ERROR) {
-        purple_debug_info("helplightning", "z_stream_error\n");
-        return NULL;
-      }
-
-      switch (ret) {
-        case Z_NEED_DICT:
-        case Z_DATA_ERROR:
-        case Z_MEM_ERROR:
-          inflateEnd(&strm);
-          purple_debug_info("helplightning", "end_error: %d\n", ret);
-          return NULL;
-      }
-
-      have = CHUNK - strm.avail_out;
-      output = g_realloc(output, *output_length + have);
-
-      memcpy(output + *output_length, out, have);
-      *output_length += have;
-    } while (strm.avail_out == 0);
-  } while (ret != Z_STREAM_END);
-
-  inflateEnd(&strm);
-  
-  return output;
+  strm.next_in = (Bytef*)input;
+  strm.avail_in = length;
+  strm.next_out = (Bytef*)output->str + offset;
+  strm.avail_out = length;
+
+  ret = deflate(&strm, Z_FINISH);
+  size_t have = length - strm.avail_out;
+  deflateEnd(&strm);
+
+  if (ret != Z_STREAM_END) {
+    // either an error or it ran out of room
+    g_string_truncate(output, offset);
+    return FALSE;
+  }
+
+  purple_debug_info("helplightning", "compressed %zu bytes to %zu\n", length, have);
+  g_string_truncate(output, offset + have);
+
+  return TRUE;
 }
@@ -22,8 +22,72 @@
 #include "zlib.h"
 #include <glib.h>
 
-gpointer libballyhoo_deflate_decompress(gpointer input,
+/* how much bigger xml usually is once inflated */
+#define LIBBALLYHOO_INFLATE_RATIO 4
+
+/* the name of the preset dictionary, agreed on in the
+ *  handshake. Change it whenever the dictionary changes. */
+#define LIBBALLYHOO_DEFLATE_DICTIONARY "xmlrpc-1"
+
+/**
+ * A z_stream that can be fed a message a piece at a time,
+ *  and then reset and reused for the next one.
+ */
+typedef struct _BallyhooInflater {
+  z_stream strm;
+  guchar *output;
+  size_t length;
+  size_t capacity;
+  int status; /* the last result of libballyhoo_inflater_feed */
+} BallyhooInflater;
+
+/**
+ * Returns NULL if zlib couldn't be initialized
+ */
+BallyhooInflater *libballyhoo_inflater_new();
+void libballyhoo_inflater_free(BallyhooInflater *i);
+
+/**
+ * Start a new message, reserving room for about size_hint
+ *  bytes of output. The output grows geometrically past it.
+ */
+void libballyhoo_inflater_reset(BallyhooInflater *i, size_t size_hint);
+
+/**
+ * Inflate the next piece of the message. Messages that were
+ *  compressed against the preset dictionary are recognized
+ *  by its zlib id.
+ *
+ * A return status of:
+ *  1 = the message is complete
+ *  0 = more input is needed
+ * -1 = error (malformed data)
+ */
+int libballyhoo_inflater_feed(BallyhooInflater *i, gconstpointer data, size_t length);
+
+/**
+ * Take the output so far, which the caller must g_free
+ */
+gpointer libballyhoo_inflater_steal(BallyhooInflater *i, size_t *length);
+
+/**
+ * Inflate a whole message at once
+ */
+gpointer libballyhoo_deflate_decompress(gconstpointer input,
                                         size_t length,
                                         size_t *output_length);
 
+/**
+ * Compress length bytes of input onto the end of output,
+ *  against the preset dictionary if use_dictionary is set.
+ *  Only do that if the other side agreed to it.
+ *
+ * Returns FALSE, leaving output as it was, if compressing
+ *  failed or wouldn't make the data any smaller.
+ */
+gboolean libballyhoo_deflate_compress(gconstpointer input,
+                                      size_t length,
+                                      GString *output,
+                                      gboolean use_dictionary);
+
 #endif
@@ -0,0 +1,191 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_helo.h"
+
+#include <string.h>
+
+/* the longest each part of the server's handshake can be */
+#define HELO_MAX_BALLYHOO 32
+#define HELO_MAX_PROTOCOL 12
+#define HELO_MAX_OK 12
+#define HELO_MAX_HEADERS 4096
+
+static gboolean libballyhoo_helo_parse_headers(BallyhooHelo *h,
+                                               const char *headers);
+
+BallyhooHelo *libballyhoo_helo_new()
+{
+  BallyhooHelo *h = g_new0(BallyhooHelo, 1);
+  h->state = BALLYHOO_HELO_BALLYHOO;
+  h->headers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  return h;
+}
+
+void libballyhoo_helo_free(BallyhooHelo *h)
+{
+  if (h == NULL)
+    return;
+
+  g_free(h->protocol);
+  g_hash_table_destroy(h->headers);
+  g_free(h);
+}
+
+GString *libballyhoo_helo_preamble(const char *protocol, const char *api,
+                                   const char *headers)
+{
+  GString *preamble = g_string_sized_new(256);
+
+  // each part includes its null terminator
+  g_string_append_len(preamble, "BALLYHOO", 9);
+  g_string_append_len(preamble, protocol, strlen(protocol) + 1);
+  g_string_append_len(preamble, api, strlen(api) + 1);
+  g_string_append(preamble, headers);
+  g_string_append_len(preamble, "READY", 6);
+
+  return preamble;
+}
+
+int libballyhoo_helo_feed(BallyhooHelo *h, const void *data, size_t length,
+                          size_t *consumed)
+{
+  const char *b = data;
+  size_t offset = 0;
+
+  *consumed = 0;
+
+  while (h->state != BALLYHOO_HELO_DONE) {
+    size_t max;
+    switch (h->state) {
+    case BALLYHOO_HELO_BALLYHOO: max = HELO_MAX_BALLYHOO; break;
+    case BALLYHOO_HELO_PROTOCOL: max = HELO_MAX_PROTOCOL; break;
+    case BALLYHOO_HELO_OK: max = HELO_MAX_OK; break;
+    default: max = HELO_MAX_HEADERS; break;
+    }
+
+    // each part of the handshake is null terminated
+    const char *end = memchr(b + offset, '\0', MIN(length - offset, max));
+    if (end == NULL) {
+      if (length - offset >= max) {
+        h->error = "Invalid Handshake";
+        return -1;
+      }
+      return 0;
+    }
+    const char *part = b + offset;
+
+    switch (h->state) {
+    case BALLYHOO_HELO_BALLYHOO:
+      if (strcmp(part, "BALLYHOO") != 0) {
+        h->error = "Invalid Handshake";
+        return -1;
+      }
+      h->state = BALLYHOO_HELO_PROTOCOL;
+      break;
+    case BALLYHOO_HELO_PROTOCOL:
+      h->protocol = g_strdup(part);
+      h->state = BALLYHOO_HELO_OK;
+      break;
+    case BALLYHOO_HELO_OK:
+      if (strcmp(part, "OK") != 0) {
+        h->error = "Unsupported Protocol";
+        return -1;
+      }
+      h->state = BALLYHOO_HELO_HEADERS;
+      break;
+    default:
+      if (!libballyhoo_helo_parse_headers(h, part)) {
+        h->error = "Invalid Handshake";
+        return -1;
+      }
+      h->state = BALLYHOO_HELO_DONE;
+      break;
+    }
+
+    offset = end - b + 1;
+    *consumed = offset;
+  }
+
+  return 1;
+}
+
+const char *libballyhoo_helo_header(BallyhooHelo *h, const char *name)
+{
+  gchar *key = g_ascii_strdown(name, -1);
+  const char *value = g_hash_table_lookup(h->headers, key);
+  g_free(key);
+
+  return value;
+}
+
+gboolean libballyhoo_helo_header_has(BallyhooHelo *h, const char *name,
+                                     const char *token)
+{
+  const char *value = libballyhoo_helo_header(h, name);
+  if (value == NULL)
+    return FALSE;
+
+  gboolean found = FALSE;
+  gchar **items = g_strsplit(value, ",", -1);
+  for (int i = 0; items[i] != NULL && !found; i++) {
+    found = g_ascii_strcasecmp(g_strstrip(items[i]), token) == 0;
+  }
+  g_strfreev(items);
+
+  return found;
+}
+
+/**
+ * The headers are "Name: value" lines, the last of
+ *  which is READY.
+ */
+static gboolean libballyhoo_helo_parse_headers(BallyhooHelo *h,
+                                               const char *headers)
+{
+  const char *line = headers;
+
+  while (TRUE) {
+    const char *eol = strchr(line, '\n');
+    size_t line_length = eol ? (size_t)(eol - line) : strlen(line);
+
+    // tolerate \r\n line endings
+    if (line_length > 0 && line[line_length - 1] == '\r') {
+      line_length--;
+    }
+
+    if (eol == NULL) {
+      return line_length == 5 && strncmp(line, "READY", 5) == 0;
+    }
+
+    const char *colon = memchr(line, ':', line_length);
+    if (colon != NULL) {
+      const char *value = colon + 1;
+      while (value < line + line_length && *value == ' ') {
+        value++;
+      }
+
+      g_hash_table_replace(h->headers,
+                           g_ascii_strdown(line, colon - line),
+                           g_strndup(value, line + line_length - value));
+    }
+
+    line = eol + 1;
+  }
+}
@@ -0,0 +1,80 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_HELO_H_
+#define _LIBBALLYHOO_HELO_H_
+
+#include <glib.h>
+
+enum BallyhooHeloState {
+  BALLYHOO_HELO_BALLYHOO, /* waiting for BALLYHOO\0 */
+  BALLYHOO_HELO_PROTOCOL, /* waiting for the server's protocol */
+  BALLYHOO_HELO_OK, /* waiting for OK\0 */
+  BALLYHOO_HELO_HEADERS, /* waiting for the headers and READY\0 */
+  BALLYHOO_HELO_DONE
+};
+
+/**
+ * The client's side of the handshake is sent all at once,
+ *  and the server's side is parsed as it arrives.
+ */
+typedef struct _BallyhooHelo {
+  enum BallyhooHeloState state;
+  gchar *protocol;
+  /* the server's headers, keyed by lowercase name */
+  GHashTable *headers;
+  /* why the handshake failed */
+  const char *error;
+} BallyhooHelo;
+
+BallyhooHelo *libballyhoo_helo_new();
+void libballyhoo_helo_free(BallyhooHelo *h);
+
+/**
+ * Build everything the client sends: BALLYHOO, the protocol
+ *  and api versions, our headers and READY.
+ */
+GString *libballyhoo_helo_preamble(const char *protocol, const char *api,
+                                   const char *headers);
+
+/**
+ * Parse as much of the server's handshake as there is in
+ *  data. consumed is set to the number of bytes used, anything
+ *  after the READY belongs to the first CMF chunk.
+ *
+ * A return status of:
+ *  1 = the handshake is complete
+ *  0 = not enough data
+ * -1 = error (see h->error)
+ */
+int libballyhoo_helo_feed(BallyhooHelo *h, const void *data, size_t length,
+                          size_t *consumed);
+
+/**
+ * Look up a server header, or NULL
+ */
+const char *libballyhoo_helo_header(BallyhooHelo *h, const char *name);
+
+/**
+ * Whether the comma separated list in a server header
+ *  contains token, ignoring case
+ */
+gboolean libballyhoo_helo_header_has(BallyhooHelo *h, const char *name,
+                                     const char *token);
+
+#endif
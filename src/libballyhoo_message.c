@@ -18,97 +18,215 @@
 
 #include "libballyhoo_message.h"
 
-#include <stdio.h>
+#include <string.h>
 #include <debug.h>
 
-int match_count(gchar **matches);
-
-BallyhooMessage *libballyhoo_message_decode(gpointer data, size_t length)
+/* the headers we know about */
+enum {
+  HEADER_MESSAGE_LENGTH,
+  HEADER_ENCODING,
+  HEADER_CONTENT_TYPE,
+  HEADER_API_KEY,
+  HEADER_UNKNOWN
+};
+
+static const struct {
+  const char *name;
+  size_t length;
+} known_headers[] = {
+  { "message-length", 14 },
+  { "encoding", 8 },
+  { "content-type", 12 },
+  { "x-helplightning-api-key", 23 },
+};
+
+static int lookup_header(const guchar *name, size_t length)
 {
-  gchar *data2;
-  BallyhooMessage *bm = g_new0(BallyhooMessage, 1);
-  bm->headers = g_hash_table_new(g_str_hash, g_str_equal);
+  for (int i = 0; i < HEADER_UNKNOWN; i++) {
+    if (length == known_headers[i].length &&
+        g_ascii_strncasecmp((const gchar*)name, known_headers[i].name, length) == 0) {
+      return i;
+    }
+  }
 
-  // parse the headers
-  gchar **results, **results2;
+  return HEADER_UNKNOWN;
+}
 
-  data2 = g_malloc0(length + 1);
-  memcpy(data2, data, length);
+static gboolean slice_equal(const BallyhooSlice *s, const char *str)
+{
+  size_t length = strlen(str);
+  return s->length == length && memcmp(s->data, str, length) == 0;
+}
 
-  results = g_strsplit(data2, "\r\n\r\n", -1);
-  if (match_count(results) != 2) {
-    purple_debug_info("helplightning", "Unable to parse message headers\n");
-    g_strfreev(results);
-    g_free(bm);
-    return NULL;
+/* strip leading and trailing spaces from [*start, *end) */
+static void strip(const guchar **start, const guchar **end)
+{
+  while (*start < *end && g_ascii_isspace(**start)) {
+    (*start)++;
+  }
+  while (*end > *start && g_ascii_isspace(*(*end - 1))) {
+    (*end)--;
   }
-  purple_debug_info("helplightning", "Splits headers: %s\n", results[0]);
-  purple_debug_info("helplightning", "Splits Message:\n");
-
-  // parse the headers out of results[0]
-  results2 = g_strsplit(results[0], "\r\n", -1);
-  int i = 0;
-  gchar *header = results2[i];
-  while (header != NULL) {
-    purple_debug_info("helplightning", "Working on header %s\n", header);
-    // split based on :
-    gchar **s = g_strsplit(header, ":", 2);
-    if (match_count(s) != 2) {
-      purple_debug_info("helplightning", "Invalid header: %s\n", header);
-    } else {
-      gchar *h = g_strdup(g_strstrip(s[0]));
-      gchar *v = g_strdup(g_strstrip(s[1]));
-      // iterate through and make lower case
-      gchar *hlower = g_utf8_strdown(h, -1);
-      g_free(h);
-
-      purple_debug_info("helplightning", "inserting header %s:%s\n", hlower, v);
-      g_hash_table_insert(bm->headers,
-                          hlower,
-                          v);
+}
+
+/**
+ * Parse the headers into bm, setting body_offset to where
+ *  the body starts in data.
+ */
+static gboolean decode_headers(const BallyhooSlice *data, BallyhooMessage *bm,
+                               size_t *body_offset)
+{
+  memset(bm, 0, sizeof(BallyhooMessage));
+
+  // walk forward one header line at a time until we hit
+  //  the empty line. The body may be binary data, so we
+  //  never look past that.
+  const guchar *p = data->data;
+  const guchar *end = data->data + data->length;
+  gboolean have_length = FALSE;
+
+  while (TRUE) {
+    const guchar *eol = p;
+    while (eol + 1 < end && !(eol[0] == '\r' && eol[1] == '\n')) {
+      eol++;
+    }
+    if (eol + 1 >= end) {
+      purple_debug_info("helplightning", "Unable to parse message headers\n");
+      return FALSE;
+    }
+
+    if (eol == p) {
+      // empty line, the body follows
+      p += 2;
+      break;
     }
 
-    g_strfreev(s);
+    const guchar *colon = memchr(p, ':', eol - p);
+    if (colon == NULL) {
+      purple_debug_info("helplightning", "Invalid header: %.*s\n", (int)(eol - p), p);
+      p = eol + 2;
+      continue;
+    }
+
+    const guchar *name = p, *name_end = colon;
+    const guchar *value = colon + 1, *value_end = eol;
+    strip(&name, &name_end);
+    strip(&value, &value_end);
+
+    BallyhooSlice v = libballyhoo_slice_borrow(value, value_end - value);
+
+    switch (lookup_header(name, name_end - name)) {
+    case HEADER_MESSAGE_LENGTH:
+      bm->length = 0;
+      have_length = v.length > 0;
+      for (size_t i = 0; i < v.length; i++) {
+        if (!g_ascii_isdigit(v.data[i])) {
+          have_length = FALSE;
+          break;
+        }
+        bm->length = bm->length * 10 + (v.data[i] - '0');
+        // stopping here also keeps it from overflowing
+        if (bm->length > LIBBALLYHOO_MAX_MESSAGE_LENGTH) {
+          have_length = FALSE;
+          break;
+        }
+      }
+      break;
+    case HEADER_ENCODING:
+      if (slice_equal(&v, "deflate")) {
+        bm->encoding = BALLYHOO_ENCODING_DEFLATE;
+      } else if (slice_equal(&v, "text")) {
+        bm->encoding = BALLYHOO_ENCODING_TEXT;
+      } else {
+        bm->encoding = BALLYHOO_ENCODING_UNKNOWN;
+      }
+      break;
+    case HEADER_CONTENT_TYPE:
+      bm->content_type = v;
+      break;
+    case HEADER_API_KEY:
+      bm->api_key = v;
+      break;
+    default:
+      if (bm->extra_count < LIBBALLYHOO_MAX_EXTRA_HEADERS) {
+        BallyhooHeader *h = &bm->extra[bm->extra_count++];
+        h->name = libballyhoo_slice_borrow(name, name_end - name);
+        h->value = v;
+      } else {
+        purple_debug_info("helplightning", "Dropping header: %.*s\n",
+                          (int)(name_end - name), name);
+      }
+      break;
+    }
+
+    p = eol + 2;
+  }
 
-    i++;
-    header = results2[i];
+  if (!have_length) {
+    purple_debug_info("helplightning", "Invalid message-length\n");
+    return FALSE;
   }
-  g_strfreev(results2);
-
-  gpointer msg_length = g_hash_table_lookup(bm->headers, "message-length");
-
-  sscanf(msg_length, "%zu", &(bm->length));
-  bm->xmlrpc = g_malloc0(bm->length);
-  // !mwd - The second part of this message may be binary data
-  //  and could have NULL values in it. This causes confusion
-  //  with g_strsplit, since it stops at the first NULL value
-  //  since it assumes we have it a string. Therefore, we are
-  //  going to copy from the original data set (not the newly
-  //  created result which may be missing data) using the offset
-  //  of the first result + 4 (for the \r\n\r\n).
-  memcpy(bm->xmlrpc, data + (strlen(results[0]) + 4), bm->length);
-  //bm->xmlrpc = g_strdup(results[1]);
-  //bm->length = strlen(results[1]);
-  purple_debug_info("helplightning",
-                    "comparing length of string to message header: %zu vs %zu\n",
-                    strlen(results[1]), bm->length);
-  
-  g_strfreev(results);
-  g_free(data2);
-  
-  return bm;
+
+  *body_offset = p - data->data;
+
+  return TRUE;
 }
 
-int match_count(gchar **matches) {
-  int count = 0;
-  purple_debug_info("helplightning", "match_count\n");
+gboolean libballyhoo_message_decode(const BallyhooSlice *data, BallyhooMessage *bm)
+{
+  size_t body_offset;
+  if (!decode_headers(data, bm, &body_offset)) {
+    return FALSE;
+  }
 
-  gchar *it = matches[count];
-  while (it != NULL) {
-    purple_debug_info("helplightning", "match %d\n", count);
-    count += 1;
-    it = matches[count];
+  if (bm->length > data->length - body_offset) {
+    purple_debug_info("helplightning", "Invalid message-length\n");
+    return FALSE;
   }
 
-  return count;
+  // the body is a slice of the original data
+  bm->xmlrpc = libballyhoo_slice_sub(data, body_offset, bm->length);
+
+  return TRUE;
+}
+
+gboolean libballyhoo_message_decode_head(const BallyhooSlice *data, BallyhooMessage *bm)
+{
+  size_t body_offset;
+  if (!decode_headers(data, bm, &body_offset)) {
+    return FALSE;
+  }
+
+  bm->xmlrpc = libballyhoo_slice_sub(data, body_offset,
+                                     MIN(bm->length, data->length - body_offset));
+
+  return TRUE;
+}
+
+void libballyhoo_message_clear(BallyhooMessage *bm)
+{
+  libballyhoo_slice_clear(&bm->xmlrpc);
+}
+
+const BallyhooSlice *libballyhoo_message_header(const BallyhooMessage *bm,
+                                                const char *name)
+{
+  switch (lookup_header((const guchar*)name, strlen(name))) {
+  case HEADER_CONTENT_TYPE:
+    return &bm->content_type;
+  case HEADER_API_KEY:
+    return &bm->api_key;
+  case HEADER_UNKNOWN:
+    for (int i = 0; i < bm->extra_count; i++) {
+      const BallyhooHeader *h = &bm->extra[i];
+      if (h->name.length == strlen(name) &&
+          g_ascii_strncasecmp((const gchar*)h->name.data, name, h->name.length) == 0) {
+        return &h->value;
+      }
+    }
+    return NULL;
+  default:
+    // the parsed headers have their own fields
+    return NULL;
+  }
 }
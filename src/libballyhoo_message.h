@@ -24,8 +24,32 @@
 #include <glib.h>
 
 /**
- * Decode a ballyhoo message.
+ * Decode a ballyhoo message into bm.
+ *
+ * This doesn't allocate. The known headers are parsed into
+ *  bm's fields and the rest are kept as slices of data,
+ *  so they are only valid as long as data is. The xmlrpc
+ *  body is a slice of data rather than a copy. Clear it
+ *  with libballyhoo_message_clear.
  */
-BallyhooMessage *libballyhoo_message_decode(gpointer data, size_t length);
+gboolean libballyhoo_message_decode(const BallyhooSlice *data, BallyhooMessage *bm);
+
+/**
+ * Decode the headers of a message whose body may not have
+ *  all arrived yet. The headers must all be in data, and
+ *  xmlrpc is set to as much of the body as there is.
+ *  bm->length is still the full length.
+ */
+gboolean libballyhoo_message_decode_head(const BallyhooSlice *data, BallyhooMessage *bm);
+void libballyhoo_message_clear(BallyhooMessage *bm);
+
+/**
+ * Look up the value of a string header, ignoring case.
+ *
+ * message-length and encoding are parsed into their own
+ *  fields, so aren't returned here.
+ */
+const BallyhooSlice *libballyhoo_message_header(const BallyhooMessage *bm,
+                                                const char *name);
 
 #endif
@@ -0,0 +1,163 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_outmsg.h"
+#include "libcmf.h"
+#include "librcl.h"
+
+#include <string.h>
+
+BallyhooOutMessage *libballyhoo_out_message_new()
+{
+  BallyhooOutMessage *m = g_new0(BallyhooOutMessage, 1);
+  m->buffer = g_string_sized_new(LIBBALLYHOO_OUT_HEADROOM + 1024);
+  g_string_set_size(m->buffer, LIBBALLYHOO_OUT_HEADROOM);
+  m->start = LIBBALLYHOO_OUT_HEADROOM;
+
+  return m;
+}
+
+void libballyhoo_out_message_free(BallyhooOutMessage *m)
+{
+  if (m == NULL)
+    return;
+
+  g_string_free(m->buffer, TRUE);
+  g_free(m->cmf_headers);
+  g_free(m->segments);
+  g_free(m);
+}
+
+GString *libballyhoo_out_message_body(BallyhooOutMessage *m)
+{
+  return m->buffer;
+}
+
+size_t libballyhoo_out_message_length(BallyhooOutMessage *m)
+{
+  return m->buffer->len - m->start;
+}
+
+guchar *libballyhoo_out_message_prepend(BallyhooOutMessage *m, size_t length)
+{
+  g_return_val_if_fail(length <= m->start, NULL);
+
+  m->start -= length;
+
+  return (guchar*)m->buffer->str + m->start;
+}
+
+void libballyhoo_out_message_frame(BallyhooOutMessage *m, int priority)
+{
+  size_t length = libballyhoo_out_message_length(m);
+  gint32 id = libcmf_next_id();
+
+  // this matches libcmf_encode, a message that is an exact
+  //  multiple of the chunk size ends with an empty chunk
+  int chunks = length / LIBCMF_CHUNK_SIZE + 1;
+
+  m->segments = g_new(BallyhooSlice, chunks * 2 - 1);
+  m->segment_count = 0;
+  m->priority = priority;
+  m->chunk_count = chunks;
+  m->next_chunk = 0;
+  if (chunks > 1) {
+    m->cmf_headers = g_malloc(LIBCMF_HEADER_SIZE * (chunks - 1));
+  }
+
+  for (int i = 0; i < chunks; i++) {
+    size_t offset = i * LIBCMF_CHUNK_SIZE;
+    size_t chunk_size = MIN(length - offset, LIBCMF_CHUNK_SIZE);
+    gboolean begin = i == 0;
+    gboolean end = i == chunks - 1;
+
+    if (begin) {
+      // the first header goes in the headroom, so it
+      //  shares a segment with the start of the message
+      guchar *header = libballyhoo_out_message_prepend(m, LIBCMF_HEADER_SIZE);
+      libcmf_write_header(header, chunk_size, id, begin, end, priority);
+      m->segments[m->segment_count++] = libballyhoo_slice_borrow(header, LIBCMF_HEADER_SIZE + chunk_size);
+    } else {
+      guchar *header = m->cmf_headers + LIBCMF_HEADER_SIZE * (i - 1);
+      libcmf_write_header(header, chunk_size, id, begin, end, priority);
+      m->segments[m->segment_count++] = libballyhoo_slice_borrow(header, LIBCMF_HEADER_SIZE);
+      if (chunk_size > 0) {
+        const guchar *payload = (const guchar*)m->buffer->str + m->start + LIBCMF_HEADER_SIZE + offset;
+        m->segments[m->segment_count++] = libballyhoo_slice_borrow(payload, chunk_size);
+      }
+    }
+  }
+}
+
+size_t libballyhoo_out_message_wire_length(BallyhooOutMessage *m)
+{
+  size_t length = 0;
+  for (int i = 0; i < m->segment_count; i++) {
+    length += m->segments[i].length;
+  }
+
+  return length;
+}
+
+int libballyhoo_out_message_next_chunk(BallyhooOutMessage *m,
+                                       const BallyhooSlice **segments)
+{
+  if (m->next_chunk >= m->chunk_count) {
+    return 0;
+  }
+
+  // the first chunk is a single segment, the rest are a
+  //  header and a payload, except for an empty last chunk
+  int chunk = m->next_chunk++;
+  int index = chunk == 0 ? 0 : 1 + 2 * (chunk - 1);
+  *segments = &(m->segments[index]);
+
+  return (chunk > 0 && index + 1 < m->segment_count) ? 2 : 1;
+}
+
+BallyhooOutTemplate *libballyhoo_out_template_new(BallyhooOutMessage *m)
+{
+  if (m->chunk_count != 1) {
+    return NULL;
+  }
+
+  BallyhooOutTemplate *t = g_new0(BallyhooOutTemplate, 1);
+  t->data = g_memdup(m->segments[0].data, m->segments[0].length);
+  t->length = m->segments[0].length;
+  t->response = m->response;
+  t->priority = m->priority;
+
+  return t;
+}
+
+void libballyhoo_out_template_free(BallyhooOutTemplate *t)
+{
+  if (t == NULL)
+    return;
+
+  g_free(t->data);
+  g_free(t);
+}
+
+void libballyhoo_out_template_stamp(BallyhooOutTemplate *t, guint64 uuid)
+{
+  // the cmf header comes first, then the rcl header
+  libcmf_write_header(t->data, t->length - LIBCMF_HEADER_SIZE, libcmf_next_id(),
+                      TRUE, TRUE, t->priority);
+  librcl_write_header(t->data + LIBCMF_HEADER_SIZE, uuid, t->response, FALSE);
+}
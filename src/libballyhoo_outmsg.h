@@ -0,0 +1,118 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_OUTMSG_H_
+#define _LIBBALLYHOO_OUTMSG_H_
+
+#include "libballyhoo_slice.h"
+
+#include <glib.h>
+
+/* room kept in front of the body for the rcl header, the
+ *  first cmf header and the ballyhoo headers */
+#define LIBBALLYHOO_OUT_HEADROOM 256
+
+/**
+ * An outbound message, framed without copying the body.
+ *
+ * The body is written once into buffer, after some
+ *  headroom. Each layer then writes its header in place in
+ *  front of it, and the cmf headers for every chunk after
+ *  the first go into cmf_headers. The wire bytes are the
+ *  segments, in order, which point into those two buffers.
+ */
+typedef struct _BallyhooOutMessage {
+  GString *buffer;
+  size_t start; /* where the message begins in buffer */
+
+  guchar *cmf_headers;
+  BallyhooSlice *segments;
+  int segment_count;
+
+  /* the rcl header, written when the message is framed */
+  guint64 uuid;
+  gboolean response;
+
+  int priority;
+  int chunk_count;
+  int next_chunk; /* the first chunk that hasn't been sent */
+} BallyhooOutMessage;
+
+/**
+ * A framed message that is sent over and over. Only the
+ *  rcl uuid and the cmf id change from one copy to the
+ *  next, and they are written in place.
+ */
+typedef struct _BallyhooOutTemplate {
+  guchar *data;
+  size_t length;
+  gboolean response;
+  int priority;
+} BallyhooOutTemplate;
+
+BallyhooOutMessage *libballyhoo_out_message_new();
+void libballyhoo_out_message_free(BallyhooOutMessage *m);
+
+/**
+ * The buffer to append the body to
+ */
+GString *libballyhoo_out_message_body(BallyhooOutMessage *m);
+
+/**
+ * The length of everything after the headroom
+ */
+size_t libballyhoo_out_message_length(BallyhooOutMessage *m);
+
+/**
+ * Claim length bytes of headroom directly in front of the
+ *  message and return them for the caller to fill in.
+ */
+guchar *libballyhoo_out_message_prepend(BallyhooOutMessage *m, size_t length);
+
+/**
+ * Split the message into cmf chunks, filling in segments.
+ *  Nothing may be added to the message afterwards.
+ */
+void libballyhoo_out_message_frame(BallyhooOutMessage *m, int priority);
+
+/**
+ * The total number of bytes that will be written
+ */
+size_t libballyhoo_out_message_wire_length(BallyhooOutMessage *m);
+
+/**
+ * Take the segments of the next unsent chunk. Returns how
+ *  many there are (1 or 2), or 0 once every chunk is taken.
+ */
+int libballyhoo_out_message_next_chunk(BallyhooOutMessage *m,
+                                       const BallyhooSlice **segments);
+
+/**
+ * Copy the wire bytes of a framed message that fits in a
+ *  single chunk, or return NULL if it doesn't.
+ */
+BallyhooOutTemplate *libballyhoo_out_template_new(BallyhooOutMessage *m);
+void libballyhoo_out_template_free(BallyhooOutTemplate *t);
+
+/**
+ * Give the template a new uuid and the next cmf id, ready
+ *  to write out t->data again.
+ */
+void libballyhoo_out_template_stamp(BallyhooOutTemplate *t, guint64 uuid);
+
+#endif
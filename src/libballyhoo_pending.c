@@ -0,0 +1,135 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_pending.h"
+
+#define SLOT(p, uuid) ((guint)(uuid) & ((p)->capacity - 1))
+#define NEXT(p, i) (((i) + 1) & ((p)->capacity - 1))
+
+static void libballyhoo_pending_grow(BallyhooPending *p);
+
+BallyhooPending *libballyhoo_pending_new(void)
+{
+  BallyhooPending *p = g_new0(BallyhooPending, 1);
+  p->capacity = LIBBALLYHOO_PENDING_SIZE;
+  p->entries = g_new0(BallyhooPendingEntry, p->capacity);
+
+  return p;
+}
+
+void libballyhoo_pending_free(BallyhooPending *p)
+{
+  if (p == NULL)
+    return;
+
+  g_free(p->entries);
+  g_free(p);
+}
+
+void libballyhoo_pending_insert(BallyhooPending *p, guint64 uuid, gpointer value)
+{
+  g_return_if_fail(value != NULL);
+
+  // keep it at most half full so probes stay short
+  if ((p->count + 1) * 2 > p->capacity) {
+    libballyhoo_pending_grow(p);
+  }
+
+  guint i = SLOT(p, uuid);
+  while (p->entries[i].value && p->entries[i].uuid != uuid) {
+    i = NEXT(p, i);
+  }
+
+  if (p->entries[i].value == NULL) {
+    p->count++;
+  }
+  p->entries[i].uuid = uuid;
+  p->entries[i].value = value;
+}
+
+gpointer libballyhoo_pending_lookup(const BallyhooPending *p, guint64 uuid)
+{
+  guint i = SLOT(p, uuid);
+  while (p->entries[i].value) {
+    if (p->entries[i].uuid == uuid) {
+      return p->entries[i].value;
+    }
+    i = NEXT(p, i);
+  }
+
+  return NULL;
+}
+
+gpointer libballyhoo_pending_remove(BallyhooPending *p, guint64 uuid)
+{
+  guint i = SLOT(p, uuid);
+  while (p->entries[i].value && p->entries[i].uuid != uuid) {
+    i = NEXT(p, i);
+  }
+
+  gpointer value = p->entries[i].value;
+  if (value == NULL) {
+    return NULL;
+  }
+
+  // shift back anything after it in the run that would no
+  //  longer be found, instead of leaving a tombstone
+  guint hole = i;
+  for (guint j = NEXT(p, i); p->entries[j].value; j = NEXT(p, j)) {
+    guint home = SLOT(p, p->entries[j].uuid);
+    // can the entry at j move back to hole? only if its home
+    //  isn't cyclically in (hole, j]
+    gboolean stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+    if (!stays) {
+      p->entries[hole] = p->entries[j];
+      hole = j;
+    }
+  }
+  p->entries[hole].value = NULL;
+  p->count--;
+
+  return value;
+}
+
+void libballyhoo_pending_foreach(const BallyhooPending *p, BallyhooPendingFunc func,
+                                 gpointer user_data)
+{
+  for (guint i = 0; i < p->capacity; i++) {
+    if (p->entries[i].value) {
+      func(p->entries[i].uuid, p->entries[i].value, user_data);
+    }
+  }
+}
+
+static void libballyhoo_pending_grow(BallyhooPending *p)
+{
+  BallyhooPendingEntry *old = p->entries;
+  guint old_capacity = p->capacity;
+
+  p->capacity *= 2;
+  p->entries = g_new0(BallyhooPendingEntry, p->capacity);
+  p->count = 0;
+
+  for (guint i = 0; i < old_capacity; i++) {
+    if (old[i].value) {
+      libballyhoo_pending_insert(p, old[i].uuid, old[i].value);
+    }
+  }
+
+  g_free(old);
+}
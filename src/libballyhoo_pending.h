@@ -0,0 +1,71 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_PENDING_H_
+#define _LIBBALLYHOO_PENDING_H_
+
+#include <glib.h>
+
+#define LIBBALLYHOO_PENDING_SIZE 64 // initial slots, always a power of 2
+
+typedef struct _BallyhooPendingEntry {
+  guint64 uuid;
+  gpointer value; // NULL if the slot is empty
+} BallyhooPendingEntry;
+
+/**
+ * The calls waiting on a response, keyed by their rcl uuid.
+ *
+ * This is an open addressed table with linear probing. rcl
+ *  uuids are handed out in order, so the low bits of the uuid
+ *  are used as the slot directly: the calls in flight sit
+ *  next to each other and rarely collide. Inserting and
+ *  looking up never allocate, only growing does.
+ */
+typedef struct _BallyhooPending {
+  BallyhooPendingEntry *entries;
+  guint capacity;
+  guint count;
+} BallyhooPending;
+
+typedef void (*BallyhooPendingFunc)(guint64 uuid, gpointer value, gpointer user_data);
+
+BallyhooPending *libballyhoo_pending_new(void);
+void libballyhoo_pending_free(BallyhooPending *p);
+
+/**
+ * Track value under uuid, replacing anything already there.
+ *  value can't be NULL.
+ */
+void libballyhoo_pending_insert(BallyhooPending *p, guint64 uuid, gpointer value);
+/**
+ * Find the value for uuid, or NULL
+ */
+gpointer libballyhoo_pending_lookup(const BallyhooPending *p, guint64 uuid);
+/**
+ * Stop tracking uuid, returning its value, or NULL if it
+ *  wasn't there
+ */
+gpointer libballyhoo_pending_remove(BallyhooPending *p, guint64 uuid);
+/**
+ * Call func for every entry. func must not change the table.
+ */
+void libballyhoo_pending_foreach(const BallyhooPending *p, BallyhooPendingFunc func,
+                                 gpointer user_data);
+
+#endif
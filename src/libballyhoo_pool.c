@@ -0,0 +1,60 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_pool.h"
+
+#include <string.h>
+
+gpointer libballyhoo_pool_alloc0(BallyhooPool *pool)
+{
+  gpointer obj = pool->free_list;
+  if (obj == NULL) {
+    return g_malloc0(pool->size);
+  }
+
+  pool->free_list = *(gpointer*)obj;
+  pool->idle--;
+  memset(obj, 0, pool->size);
+
+  return obj;
+}
+
+void libballyhoo_pool_free(BallyhooPool *pool, gpointer obj)
+{
+  if (obj == NULL)
+    return;
+
+  if (pool->idle >= pool->max_idle) {
+    g_free(obj);
+    return;
+  }
+
+  *(gpointer*)obj = pool->free_list;
+  pool->free_list = obj;
+  pool->idle++;
+}
+
+void libballyhoo_pool_drain(BallyhooPool *pool)
+{
+  while (pool->free_list) {
+    gpointer obj = pool->free_list;
+    pool->free_list = *(gpointer*)obj;
+    g_free(obj);
+  }
+  pool->idle = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_POOL_H_
+#define _LIBBALLYHOO_POOL_H_
+
+#include <glib.h>
+
+/**
+ * A free list of fixed size objects.
+ *
+ * Freed objects are kept for the next allocation instead of
+ *  going back to the heap, up to max_idle of them. The link
+ *  to the next free object is stored in the object itself,
+ *  so size must be at least a pointer.
+ *
+ * Pools aren't thread safe, they're only used from the
+ *  main loop.
+ */
+typedef struct _BallyhooPool {
+  size_t size;
+  guint max_idle;
+  guint idle;
+  gpointer free_list;
+} BallyhooPool;
+
+#define LIBBALLYHOO_POOL_INIT(type, max_idle) { sizeof(type), (max_idle), 0, NULL }
+
+/**
+ * Take a zeroed object from the pool
+ */
+gpointer libballyhoo_pool_alloc0(BallyhooPool *pool);
+
+/**
+ * Give an object back to the pool
+ */
+void libballyhoo_pool_free(BallyhooPool *pool, gpointer obj);
+
+/**
+ * Release every idle object back to the heap
+ */
+void libballyhoo_pool_drain(BallyhooPool *pool);
+
+#endif
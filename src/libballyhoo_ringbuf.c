@@ -0,0 +1,130 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "libballyhoo_ringbuf.h"
+
+#include <string.h>
+#include <debug.h>
+
+static void libballyhoo_ringbuf_resize(BallyhooRingBuf *rb, size_t capacity);
+
+BallyhooRingBuf *libballyhoo_ringbuf_new(size_t initial, size_t max)
+{
+  BallyhooRingBuf *rb = g_new0(BallyhooRingBuf, 1);
+  rb->capacity = initial;
+  rb->initial = initial;
+  rb->max = max;
+  rb->buffer = g_malloc(rb->capacity);
+  rb->head = 0;
+  rb->used = 0;
+
+  return rb;
+}
+
+void libballyhoo_ringbuf_free(BallyhooRingBuf *rb)
+{
+  g_free(rb->buffer);
+  g_free(rb);
+}
+
+gpointer libballyhoo_ringbuf_reserve(BallyhooRingBuf *rb, size_t *available)
+{
+  if (rb->used == rb->capacity) {
+    if (rb->capacity >= rb->max) {
+      *available = 0;
+      return NULL;
+    }
+
+    libballyhoo_ringbuf_resize(rb, MIN(rb->capacity * 2, rb->max));
+  }
+
+  // capacity is a power of 2, so we can mask instead of mod
+  size_t tail = (rb->head + rb->used) & (rb->capacity - 1);
+  if (tail >= rb->head) {
+    // free space runs from the tail to the end of the buffer
+    //  (or the whole buffer when empty)
+    *available = rb->capacity - tail;
+  } else {
+    // we've wrapped, free space runs up to the head
+    *available = rb->head - tail;
+  }
+
+  return rb->buffer + tail;
+}
+
+void libballyhoo_ringbuf_commit(BallyhooRingBuf *rb, size_t length)
+{
+  rb->used += length;
+}
+
+gpointer libballyhoo_ringbuf_peek(BallyhooRingBuf *rb, size_t *length)
+{
+  if (rb->head + rb->used > rb->capacity) {
+    // the data wraps around, so make it contiguous again.
+    //  This only copies when a read straddled the end
+    //  of the buffer, not once per frame.
+    purple_debug_info("helplightning", "ringbuf: linearizing %zu bytes\n", rb->used);
+    libballyhoo_ringbuf_resize(rb, rb->capacity);
+  }
+
+  *length = rb->used;
+
+  return rb->buffer + rb->head;
+}
+
+void libballyhoo_ringbuf_consume(BallyhooRingBuf *rb, size_t length)
+{
+  length = MIN(length, rb->used);
+
+  rb->used -= length;
+  if (rb->used == 0) {
+    // reset to the start, so the next read gets the
+    //  largest possible contiguous space
+    rb->head = 0;
+  } else {
+    rb->head = (rb->head + length) & (rb->capacity - 1);
+  }
+}
+
+void libballyhoo_ringbuf_shrink(BallyhooRingBuf *rb)
+{
+  if (rb->used == 0 && rb->capacity > rb->initial) {
+    purple_debug_info("helplightning", "ringbuf: shrinking from %zu to %zu\n",
+                      rb->capacity, rb->initial);
+    g_free(rb->buffer);
+    rb->capacity = rb->initial;
+    rb->buffer = g_malloc(rb->capacity);
+    rb->head = 0;
+  }
+}
+
+static void libballyhoo_ringbuf_resize(BallyhooRingBuf *rb, size_t capacity)
+{
+  guchar *buffer = g_malloc(capacity);
+
+  // copy the (possibly wrapped) data to the start of the new buffer
+  size_t first = MIN(rb->used, rb->capacity - rb->head);
+  memcpy(buffer, rb->buffer + rb->head, first);
+  memcpy(buffer + first, rb->buffer, rb->used - first);
+
+  g_free(rb->buffer);
+  rb->buffer = buffer;
+  rb->capacity = capacity;
+  rb->head = 0;
+}
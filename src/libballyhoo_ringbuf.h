@@ -0,0 +1,86 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _LIBBALLYHOO_RINGBUF_H_
+#define _LIBBALLYHOO_RINGBUF_H_
+
+#include <glib.h>
+
+/**
+ * A growable ring buffer for the inbound byte stream.
+ *
+ * Bytes are read from the socket directly into the free
+ *  space at the tail and handed out from the head. Consuming
+ *  data only advances the head, so nothing is shifted after
+ *  each decoded frame. The buffer doubles in size when it
+ *  is full (up to max) and can be shrunk back to its
+ *  initial size once it has been drained.
+ */
+typedef struct _BallyhooRingBuf {
+  guchar *buffer;
+  size_t capacity;
+  size_t initial;
+  size_t max;
+
+  size_t head; /* index of the first readable byte */
+  size_t used; /* number of readable bytes */
+} BallyhooRingBuf;
+
+/**
+ * Create a new ring buffer. Both initial and max should
+ *  be powers of 2.
+ */
+BallyhooRingBuf *libballyhoo_ringbuf_new(size_t initial, size_t max);
+void libballyhoo_ringbuf_free(BallyhooRingBuf *rb);
+
+/**
+ * Get a pointer to the contiguous free space at the tail
+ *  of the buffer, growing the buffer if it is full.
+ *
+ * Returns NULL if the buffer is full and already at its
+ *  maximum size.
+ */
+gpointer libballyhoo_ringbuf_reserve(BallyhooRingBuf *rb, size_t *available);
+
+/**
+ * Mark length bytes that were written into the space
+ *  returned by reserve as readable.
+ */
+void libballyhoo_ringbuf_commit(BallyhooRingBuf *rb, size_t length);
+
+/**
+ * Get a pointer to all the readable data.
+ *
+ * If the readable data wraps around the end of the buffer,
+ *  it is first made contiguous.
+ */
+gpointer libballyhoo_ringbuf_peek(BallyhooRingBuf *rb, size_t *length);
+
+/**
+ * Drop length bytes from the head of the buffer
+ */
+void libballyhoo_ringbuf_consume(BallyhooRingBuf *rb, size_t length);
+
+/**
+ * Release any memory above the initial size.
+ *  This only does something if the buffer is empty.
+ */
+void libballyhoo_ringbuf_shrink(BallyhooRingBuf *rb);
+
+#endif
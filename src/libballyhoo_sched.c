@@ -0,0 +1,94 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_sched.h"
+
+BallyhooScheduler *libballyhoo_scheduler_new()
+{
+  BallyhooScheduler *s = g_new0(BallyhooScheduler, 1);
+  for (int i = 0; i < LIBCMF_PRIORITIES; i++) {
+    s->queues[i] = g_queue_new();
+  }
+
+  return s;
+}
+
+void libballyhoo_scheduler_free(BallyhooScheduler *s)
+{
+  if (s == NULL)
+    return;
+
+  libballyhoo_scheduler_clear(s);
+  for (int i = 0; i < LIBCMF_PRIORITIES; i++) {
+    g_queue_free(s->queues[i]);
+  }
+  g_free(s);
+}
+
+void libballyhoo_scheduler_clear(BallyhooScheduler *s)
+{
+  for (int i = 0; i < LIBCMF_PRIORITIES; i++) {
+    BallyhooOutMessage *m;
+    while ((m = g_queue_pop_head(s->queues[i])) != NULL) {
+      libballyhoo_out_message_free(m);
+    }
+  }
+  s->pending = 0;
+}
+
+void libballyhoo_scheduler_push(BallyhooScheduler *s, BallyhooOutMessage *m)
+{
+  int priority = CLAMP(m->priority, 0, LIBCMF_PRIORITIES - 1);
+
+  s->pending += libballyhoo_out_message_wire_length(m);
+  g_queue_push_tail(s->queues[priority], m);
+}
+
+size_t libballyhoo_scheduler_take(BallyhooScheduler *s, size_t budget,
+                                  BallyhooSchedWriteFunc func, gpointer user_data)
+{
+  size_t taken = 0;
+  int priority = 0;
+
+  while (taken < budget && priority < LIBCMF_PRIORITIES) {
+    GQueue *q = s->queues[priority];
+    BallyhooOutMessage *m = g_queue_pop_head(q);
+    if (m == NULL) {
+      priority++;
+      continue;
+    }
+
+    const BallyhooSlice *segments;
+    int count = libballyhoo_out_message_next_chunk(m, &segments);
+    for (int i = 0; i < count; i++) {
+      func(segments[i].data, segments[i].length, user_data);
+      taken += segments[i].length;
+    }
+
+    // give the next message at this priority a turn
+    if (m->next_chunk < m->chunk_count) {
+      g_queue_push_tail(q, m);
+    } else {
+      libballyhoo_out_message_free(m);
+    }
+  }
+
+  s->pending -= taken;
+
+  return taken;
+}
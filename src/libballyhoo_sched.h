@@ -0,0 +1,74 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_SCHED_H_
+#define _LIBBALLYHOO_SCHED_H_
+
+#include "libballyhoo_outmsg.h"
+#include "libcmf.h"
+
+#include <glib.h>
+
+/**
+ * Called with each segment of the chunks taken from the
+ *  scheduler, in order.
+ */
+typedef void (*BallyhooSchedWriteFunc)(gconstpointer data, size_t length,
+                                       gpointer user_data);
+
+/**
+ * Outbound messages waiting for their chunks to be written.
+ *
+ * There is a queue per cmf priority. Chunks are always taken
+ *  from the highest priority queue with anything in it, and
+ *  the messages within a queue take turns one chunk at a
+ *  time. A small message never waits behind all of a large
+ *  one, and never waits behind a lower priority one at all.
+ */
+typedef struct _BallyhooScheduler {
+  GQueue *queues[LIBCMF_PRIORITIES];
+  size_t pending; /* bytes not taken yet */
+} BallyhooScheduler;
+
+BallyhooScheduler *libballyhoo_scheduler_new();
+
+/**
+ * Free the scheduler and any messages still waiting
+ */
+void libballyhoo_scheduler_free(BallyhooScheduler *s);
+
+/**
+ * Drop every waiting message
+ */
+void libballyhoo_scheduler_clear(BallyhooScheduler *s);
+
+/**
+ * Queue a framed message at its priority. The scheduler
+ *  owns m, and frees it once all its chunks are taken.
+ */
+void libballyhoo_scheduler_push(BallyhooScheduler *s, BallyhooOutMessage *m);
+
+/**
+ * Take whole chunks, in schedule order, passing their bytes
+ *  to func until at least budget bytes have been taken or
+ *  nothing is left. Returns the number of bytes taken.
+ */
+size_t libballyhoo_scheduler_take(BallyhooScheduler *s, size_t budget,
+                                  BallyhooSchedWriteFunc func, gpointer user_data);
+
+#endif
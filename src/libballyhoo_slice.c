@@ -0,0 +1,117 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_slice.h"
+
+#include <string.h>
+
+#ifdef BALLYHOO_COPY_STATS
+size_t libballyhoo_bytes_copied = 0;
+#endif
+
+BallyhooBuffer *libballyhoo_buffer_new(gpointer data, size_t length,
+                                       GDestroyNotify free_func)
+{
+  BallyhooBuffer *b = g_new0(BallyhooBuffer, 1);
+  b->ref_count = 1;
+  b->data = data;
+  b->length = length;
+  b->free_func = free_func;
+
+  return b;
+}
+
+BallyhooBuffer *libballyhoo_buffer_ref(BallyhooBuffer *b)
+{
+  b->ref_count++;
+
+  return b;
+}
+
+void libballyhoo_buffer_unref(BallyhooBuffer *b)
+{
+  b->ref_count--;
+  if (b->ref_count > 0) {
+    return;
+  }
+
+  if (b->free_func) {
+    b->free_func(b->data);
+  }
+  g_free(b);
+}
+
+BallyhooSlice libballyhoo_slice_new(BallyhooBuffer *b)
+{
+  BallyhooSlice s;
+  s.data = b->data;
+  s.length = b->length;
+  s.owner = libballyhoo_buffer_ref(b);
+
+  return s;
+}
+
+BallyhooSlice libballyhoo_slice_borrow(gconstpointer data, size_t length)
+{
+  BallyhooSlice s;
+  s.data = data;
+  s.length = length;
+  s.owner = NULL;
+
+  return s;
+}
+
+BallyhooSlice libballyhoo_slice_sub(const BallyhooSlice *s, size_t offset,
+                                    size_t length)
+{
+  g_assert(offset + length <= s->length);
+
+  BallyhooSlice sub;
+  sub.data = s->data + offset;
+  sub.length = length;
+  sub.owner = s->owner ? libballyhoo_buffer_ref(s->owner) : NULL;
+
+  return sub;
+}
+
+BallyhooSlice libballyhoo_slice_retain(const BallyhooSlice *s)
+{
+  if (s->owner) {
+    return libballyhoo_slice_sub(s, 0, s->length);
+  }
+
+  // nobody owns these bytes, so we have to take a copy
+  gpointer copy = g_memdup(s->data, s->length);
+  BALLYHOO_COUNT_COPY(s->length);
+
+  BallyhooBuffer *b = libballyhoo_buffer_new(copy, s->length, g_free);
+  BallyhooSlice r = libballyhoo_slice_new(b);
+  libballyhoo_buffer_unref(b);
+
+  return r;
+}
+
+void libballyhoo_slice_clear(BallyhooSlice *s)
+{
+  if (s->owner) {
+    libballyhoo_buffer_unref(s->owner);
+  }
+  s->data = NULL;
+  s->length = 0;
+  s->owner = NULL;
+}
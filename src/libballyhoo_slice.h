@@ -0,0 +1,107 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_SLICE_H_
+#define _LIBBALLYHOO_SLICE_H_
+
+#include <glib.h>
+
+/**
+ * A reference counted block of memory that one or more
+ *  slices point into.
+ */
+typedef struct _BallyhooBuffer {
+  gint ref_count;
+  gpointer data;
+  size_t length;
+  GDestroyNotify free_func;
+} BallyhooBuffer;
+
+/**
+ * A borrowed view of bytes.
+ *
+ * Each layer (rcl, the message headers, xmlrpc) narrows
+ *  the slice it was given instead of copying the bytes
+ *  it cares about into a new buffer.
+ *
+ * If owner is set, the slice holds a reference to it and
+ *  the bytes stay valid until the slice is cleared. If owner
+ *  is NULL, the bytes belong to someone else (like the input
+ *  buffer) and are only valid for the current call. Use
+ *  libballyhoo_slice_retain to keep them around any longer.
+ */
+typedef struct _BallyhooSlice {
+  const guchar *data;
+  size_t length;
+  BallyhooBuffer *owner;
+} BallyhooSlice;
+
+/**
+ * Wrap data in a new buffer, taking ownership of it. When
+ *  the last reference is dropped, free_func is called on
+ *  data.
+ */
+BallyhooBuffer *libballyhoo_buffer_new(gpointer data, size_t length,
+                                       GDestroyNotify free_func);
+BallyhooBuffer *libballyhoo_buffer_ref(BallyhooBuffer *b);
+void libballyhoo_buffer_unref(BallyhooBuffer *b);
+
+/**
+ * Make a slice over all of a buffer. The slice holds its
+ *  own reference to b.
+ */
+BallyhooSlice libballyhoo_slice_new(BallyhooBuffer *b);
+
+/**
+ * Make a slice over data that is owned by the caller.
+ */
+BallyhooSlice libballyhoo_slice_borrow(gconstpointer data, size_t length);
+
+/**
+ * Make a slice of length bytes starting at offset in s,
+ *  sharing the same owner.
+ *
+ * The range must be within s.
+ */
+BallyhooSlice libballyhoo_slice_sub(const BallyhooSlice *s, size_t offset,
+                                    size_t length);
+
+/**
+ * Make a slice that outlives the current call. This only
+ *  copies if s doesn't have an owner.
+ */
+BallyhooSlice libballyhoo_slice_retain(const BallyhooSlice *s);
+
+/**
+ * Drop the slice's reference to its owner.
+ */
+void libballyhoo_slice_clear(BallyhooSlice *s);
+
+/**
+ * Count of the bytes copied while decoding messages. This
+ *  is only kept when built with BALLYHOO_COPY_STATS, and is
+ *  used by the benchmarks.
+ */
+#ifdef BALLYHOO_COPY_STATS
+extern size_t libballyhoo_bytes_copied;
+#define BALLYHOO_COUNT_COPY(n) (libballyhoo_bytes_copied += (n))
+#else
+#define BALLYHOO_COUNT_COPY(n)
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_timers.h"
+
+#define INITIAL_CAPACITY 32
+
+BallyhooTimers *libballyhoo_timers_new()
+{
+  BallyhooTimers *timers = g_new0(BallyhooTimers, 1);
+  timers->capacity = INITIAL_CAPACITY;
+  timers->heap = g_new(BallyhooTimer*, timers->capacity);
+
+  return timers;
+}
+
+void libballyhoo_timers_free(BallyhooTimers *timers)
+{
+  if (timers == NULL)
+    return;
+
+  for (int i = 0; i < timers->count; i++) {
+    timers->heap[i]->index = -1;
+  }
+  g_free(timers->heap);
+  g_free(timers);
+}
+
+gint64 libballyhoo_timers_now()
+{
+  return g_get_monotonic_time() / 1000;
+}
+
+void libballyhoo_timer_init(BallyhooTimer *t, gint64 deadline, gpointer data)
+{
+  t->deadline = deadline;
+  t->index = -1;
+  t->data = data;
+}
+
+static void place(BallyhooTimers *timers, BallyhooTimer *t, int index)
+{
+  timers->heap[index] = t;
+  t->index = index;
+}
+
+/* move the timer at index towards the root until its parent is earlier */
+static void sift_up(BallyhooTimers *timers, int index)
+{
+  BallyhooTimer *t = timers->heap[index];
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (timers->heap[parent]->deadline <= t->deadline) {
+      break;
+    }
+    place(timers, timers->heap[parent], index);
+    index = parent;
+  }
+  place(timers, t, index);
+}
+
+/* move the timer at index towards the leaves until its children are later */
+static void sift_down(BallyhooTimers *timers, int index)
+{
+  BallyhooTimer *t = timers->heap[index];
+  while (TRUE) {
+    int child = index * 2 + 1;
+    if (child >= timers->count) {
+      break;
+    }
+    if (child + 1 < timers->count &&
+        timers->heap[child + 1]->deadline < timers->heap[child]->deadline) {
+      child++;
+    }
+    if (t->deadline <= timers->heap[child]->deadline) {
+      break;
+    }
+    place(timers, timers->heap[child], index);
+    index = child;
+  }
+  place(timers, t, index);
+}
+
+void libballyhoo_timers_add(BallyhooTimers *timers, BallyhooTimer *t)
+{
+  g_return_if_fail(t->index == -1);
+
+  if (timers->count == timers->capacity) {
+    timers->capacity *= 2;
+    timers->heap = g_renew(BallyhooTimer*, timers->heap, timers->capacity);
+  }
+
+  place(timers, t, timers->count++);
+  sift_up(timers, t->index);
+}
+
+void libballyhoo_timers_remove(BallyhooTimers *timers, BallyhooTimer *t)
+{
+  int index = t->index;
+  if (index < 0 || index >= timers->count || timers->heap[index] != t) {
+    return;
+  }
+  t->index = -1;
+
+  // fill the hole with the last timer, and move that one
+  //  whichever way it needs to go
+  BallyhooTimer *last = timers->heap[--timers->count];
+  if (last != t) {
+    place(timers, last, index);
+    sift_up(timers, index);
+    sift_down(timers, last->index);
+  }
+}
+
+BallyhooTimer *libballyhoo_timers_peek(BallyhooTimers *timers)
+{
+  return timers->count > 0 ? timers->heap[0] : NULL;
+}
+
+BallyhooTimer *libballyhoo_timers_pop_expired(BallyhooTimers *timers, gint64 now)
+{
+  BallyhooTimer *t = libballyhoo_timers_peek(timers);
+  if (t == NULL || t->deadline > now) {
+    return NULL;
+  }
+
+  libballyhoo_timers_remove(timers, t);
+
+  return t;
+}
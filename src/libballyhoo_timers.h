@@ -0,0 +1,83 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_TIMERS_H_
+#define _LIBBALLYHOO_TIMERS_H_
+
+#include <glib.h>
+
+/**
+ * A deadline kept in a BallyhooTimers heap. It is embedded
+ *  in whatever it times out, and knows its place in the
+ *  heap so it can be removed without a search.
+ */
+typedef struct _BallyhooTimer {
+  gint64 deadline; /* monotonic milliseconds */
+  int index; /* position in the heap, or -1 */
+  gpointer data;
+} BallyhooTimer;
+
+/**
+ * A binary min-heap of timers ordered by deadline. Adding
+ *  and removing are O(log n), and finding the next one to
+ *  expire is O(1).
+ */
+typedef struct _BallyhooTimers {
+  BallyhooTimer **heap;
+  int count;
+  int capacity;
+} BallyhooTimers;
+
+BallyhooTimers *libballyhoo_timers_new();
+/**
+ * Free the heap. The timers themselves belong to the caller.
+ */
+void libballyhoo_timers_free(BallyhooTimers *timers);
+
+/**
+ * The current time on the clock deadlines are measured
+ *  against
+ */
+gint64 libballyhoo_timers_now();
+
+/**
+ * Set up a timer that isn't in a heap yet
+ */
+void libballyhoo_timer_init(BallyhooTimer *t, gint64 deadline, gpointer data);
+
+void libballyhoo_timers_add(BallyhooTimers *timers, BallyhooTimer *t);
+
+/**
+ * Take a timer out of the heap. Does nothing if it isn't in
+ *  one.
+ */
+void libballyhoo_timers_remove(BallyhooTimers *timers, BallyhooTimer *t);
+
+/**
+ * The timer with the earliest deadline, or NULL if the heap
+ *  is empty
+ */
+BallyhooTimer *libballyhoo_timers_peek(BallyhooTimers *timers);
+
+/**
+ * Remove and return the earliest timer if its deadline is
+ *  at or before now, otherwise NULL
+ */
+BallyhooTimer *libballyhoo_timers_pop_expired(BallyhooTimers *timers, gint64 now);
+
+#endif
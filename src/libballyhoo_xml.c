@@ -23,18 +23,100 @@
 #include <debug.h>
 #include <xmlrpc-c/base.h>
 
-gpointer libballyhoo_xml_encode_request(const char *method_name,
-                                        const char *format,
-                                        va_list args)
+// these match what xmlrpc_serialize_call writes, so the
+//  fast path is byte for byte the same as the fallback
+#define XML_PROLOGUE "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+#define XML_CRLF "\r\n"
+
+/**
+ * Append text to out, escaped the same way xmlrpc-c does.
+ */
+static void libballyhoo_xml_append_escaped(GString *out, const char *text)
+{
+  const char *run = text;
+  const char *p;
+
+  for (p = text; *p; p++) {
+    const char *entity;
+    switch (*p) {
+    case '<': entity = "&lt;"; break;
+    case '>': entity = "&gt;"; break;
+    case '&': entity = "&amp;"; break;
+    case '\r': entity = "&#x0d;"; break;
+    default: continue;
+    }
+
+    g_string_append_len(out, run, p - run);
+    g_string_append(out, entity);
+    run = p + 1;
+  }
+  g_string_append_len(out, run, p - run);
+}
+
+/**
+ * Is format a flat list of strings, ints and booleans, which
+ *  is all galdr ever sends?
+ */
+static gboolean libballyhoo_xml_is_simple_format(const char *format)
+{
+  if (format[0] != '(') {
+    return FALSE;
+  }
+
+  const char *p;
+  for (p = format + 1; *p == 's' || *p == 'i' || *p == 'b'; p++)
+    ;
+
+  return p[0] == ')' && p[1] == '\0';
+}
+
+static gboolean libballyhoo_xml_append_simple_request(GString *out,
+                                                      const char *method_name,
+                                                      const char *format,
+                                                      va_list args)
+{
+  g_string_append(out, XML_PROLOGUE "<methodCall>" XML_CRLF "<methodName>");
+  libballyhoo_xml_append_escaped(out, method_name);
+  g_string_append(out, "</methodName>" XML_CRLF "<params>" XML_CRLF);
+
+  for (const char *p = format + 1; *p != ')'; p++) {
+    g_string_append(out, "<param><value>");
+    switch (*p) {
+    case 's': {
+      const char *str = va_arg(args, const char*);
+      if (str == NULL) {
+        return FALSE;
+      }
+      g_string_append(out, "<string>");
+      libballyhoo_xml_append_escaped(out, str);
+      g_string_append(out, "</string>");
+      break;
+    }
+    case 'i':
+      g_string_append_printf(out, "<i4>%d</i4>", va_arg(args, int));
+      break;
+    case 'b':
+      g_string_append(out, va_arg(args, int) ? "<boolean>1</boolean>" : "<boolean>0</boolean>");
+      break;
+    }
+    g_string_append(out, "</value></param>" XML_CRLF);
+  }
+
+  g_string_append(out, "</params>" XML_CRLF "</methodCall>" XML_CRLF);
+
+  return TRUE;
+}
+
+static void libballyhoo_xml_append_xmlrpc_request(GString *out,
+                                                  const char *method_name,
+                                                  const char *format,
+                                                  va_list args)
 {
   xmlrpc_env env;
   xmlrpc_mem_block *c;
   xmlrpc_value *values;
   const char *suffix;
 
-  // output buffer
-  gpointer buffer;
-
   xmlrpc_env_init(&env);
   c = XMLRPC_MEMBLOCK_NEW(char, &env, 0);
   xmlrpc_env_clean(&env);
@@ -48,26 +130,53 @@ gpointer libballyhoo_xml_encode_request(const char *method_name,
   xmlrpc_env_init(&env);
   xmlrpc_serialize_call(&env, c, method_name, values);
 
-  // copy into a pointer
-  size_t size = xmlrpc_mem_block_size(c);
-  buffer = g_malloc0(size+1);
-  memcpy(buffer, xmlrpc_mem_block_contents(c), size);
+  g_string_append_len(out, xmlrpc_mem_block_contents(c), xmlrpc_mem_block_size(c));
 
   xmlrpc_DECREF(values);
   xmlrpc_mem_block_free(c);
   xmlrpc_env_clean(&env);
+}
+
+void libballyhoo_xml_append_request(GString *out,
+                                    const char *method_name,
+                                    const char *format,
+                                    va_list args)
+{
+  if (libballyhoo_xml_is_simple_format(format)) {
+    size_t start = out->len;
+    va_list simple_args;
+
+    va_copy(simple_args, args);
+    gboolean success = libballyhoo_xml_append_simple_request(out, method_name,
+                                                             format, simple_args);
+    va_end(simple_args);
+
+    if (success) {
+      return;
+    }
+    // let xmlrpc-c deal with anything odd
+    g_string_truncate(out, start);
+  }
 
-  return buffer;
+  libballyhoo_xml_append_xmlrpc_request(out, method_name, format, args);
 }
 
-gpointer libballyhoo_xml_encode_responseb(gboolean resp)
+gpointer libballyhoo_xml_encode_request(const char *method_name,
+                                        const char *format,
+                                        va_list args)
+{
+  GString *out = g_string_sized_new(512);
+  libballyhoo_xml_append_request(out, method_name, format, args);
+
+  return g_string_free(out, FALSE);
+}
+
+void libballyhoo_xml_append_responseb(GString *out, gboolean resp)
 {
   xmlrpc_env env;
   xmlrpc_mem_block *c;
   xmlrpc_value *value;
 
-  gpointer buffer;
-
   xmlrpc_env_init(&env);
   value = xmlrpc_bool_new(&env, resp);
   xmlrpc_env_clean(&env);
@@ -79,17 +188,20 @@ gpointer libballyhoo_xml_encode_responseb(gboolean resp)
   xmlrpc_env_init(&env);
   xmlrpc_serialize_response(&env, c, value);
 
-  // copy into a pointer
-  size_t size = xmlrpc_mem_block_size(c);
-  buffer = g_malloc0(size+1);
-  memcpy(buffer, xmlrpc_mem_block_contents(c), size);
+  g_string_append_len(out, xmlrpc_mem_block_contents(c), xmlrpc_mem_block_size(c));
 
   xmlrpc_mem_block_free(c);
   xmlrpc_env_clean(&env);
   
   xmlrpc_DECREF(value);
+}
+
+gpointer libballyhoo_xml_encode_responseb(gboolean resp)
+{
+  GString *out = g_string_sized_new(256);
+  libballyhoo_xml_append_responseb(out, resp);
 
-  return buffer;
+  return g_string_free(out, FALSE);
 }
 
 BallyhooXMLRPC *libballyhoo_xml_create_fault(gint code, gchar *fault_string)
@@ -102,35 +214,125 @@ BallyhooXMLRPC *libballyhoo_xml_create_fault(gint code, gchar *fault_string)
   return rpc;
 }
 
-BallyhooXMLRPC *libballyhoo_xml_decode(gpointer xmlrpc, size_t length)
+enum BallyhooXMLRoot libballyhoo_xml_sniff(gconstpointer xmlrpc, size_t length)
+{
+  const char *p = xmlrpc;
+  const char *end = p + length;
+
+  // skip a utf-8 byte order mark
+  if (length >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) {
+    p += 3;
+  }
+
+  while (p < end) {
+    if (g_ascii_isspace(*p)) {
+      p++;
+      continue;
+    }
+    if (*p != '<' || p + 1 >= end) {
+      return BXML_ROOT_UNKNOWN;
+    }
+
+    if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+      // skip comments
+      const char *close = g_strstr_len(p + 4, end - p - 4, "-->");
+      if (close == NULL) {
+        return BXML_ROOT_UNKNOWN;
+      }
+      p = close + 3;
+      continue;
+    }
+    if (p[1] == '?' || p[1] == '!') {
+      // skip the xml declaration and doctype
+      const char *close = memchr(p, '>', end - p);
+      if (close == NULL) {
+        return BXML_ROOT_UNKNOWN;
+      }
+      p = close + 1;
+      continue;
+    }
+
+    // this is the root element
+    p++;
+    size_t remaining = end - p;
+    if (remaining > 10 && memcmp(p, "methodCall", 10) == 0 &&
+        (p[10] == '>' || g_ascii_isspace(p[10]))) {
+      return BXML_ROOT_CALL;
+    }
+    if (remaining > 14 && memcmp(p, "methodResponse", 14) == 0 &&
+        (p[14] == '>' || g_ascii_isspace(p[14]))) {
+      return BXML_ROOT_RESPONSE;
+    }
+    return BXML_ROOT_UNKNOWN;
+  }
+
+  return BXML_ROOT_UNKNOWN;
+}
+
+static gboolean libballyhoo_xml_parse_call(gconstpointer xmlrpc, size_t length,
+                                           BallyhooXMLRPC *b)
 {
-  BallyhooXMLRPC *b = g_new0(BallyhooXMLRPC, 1);
   xmlrpc_env env;
-  
   xmlrpc_env_init(&env);
 
-  // first try a method call
-  xmlrpc_parse_call(&env, xmlrpc, length, &(b->method_name), &(b->method_params));
-  if (!env.fault_occurred) {
-    // it was a method call!
+  const char *method_name = NULL;
+  xmlrpc_parse_call(&env, xmlrpc, length, &method_name, &(b->method_params));
+  gboolean success = !env.fault_occurred;
+  if (success) {
     b->type = BXMLRPC_CALL;
-
-    return b;
+    b->method_name = g_strdup(method_name);
+    free((char*)method_name);
   }
   xmlrpc_env_clean(&env);
+
+  return success;
+}
+
+static gboolean libballyhoo_xml_parse_response(gconstpointer xmlrpc, size_t length,
+                                               BallyhooXMLRPC *b)
+{
+  xmlrpc_env env;
   xmlrpc_env_init(&env);
 
-  // try a response
   xmlrpc_parse_response2(&env, xmlrpc, length,
                          &(b->response),
                          &(b->fault_code),
                          &(b->fault_string));
-  if (!env.fault_occurred) {
+  gboolean success = !env.fault_occurred;
+  if (success) {
     if (b->fault_code) {
       b->type = BXMLRPC_FAULT;
     } else {
       b->type = BXMLRPC_RESPONSE;
     }
+  }
+  xmlrpc_env_clean(&env);
+
+  return success;
+}
+
+BallyhooXMLRPC *libballyhoo_xml_decode(gconstpointer xmlrpc, size_t length)
+{
+  BallyhooXMLRPC *b = g_new0(BallyhooXMLRPC, 1);
+  gboolean success;
+
+  // look at the root element so we only have to parse
+  //  the document once
+  switch (libballyhoo_xml_sniff(xmlrpc, length)) {
+  case BXML_ROOT_CALL:
+    success = libballyhoo_xml_parse_call(xmlrpc, length, b);
+    break;
+  case BXML_ROOT_RESPONSE:
+    success = libballyhoo_xml_parse_response(xmlrpc, length, b);
+    break;
+  default:
+    // we couldn't tell, so try both
+    success = libballyhoo_xml_parse_call(xmlrpc, length, b) ||
+      libballyhoo_xml_parse_response(xmlrpc, length, b);
+    break;
+  }
+
+  if (success) {
     return b;
   }
 
@@ -142,3 +344,20 @@ BallyhooXMLRPC *libballyhoo_xml_decode(gpointer xmlrpc, size_t length)
 
   return NULL;
 }
+
+xmlrpc_value *libballyhoo_xml_params(BallyhooXMLRPC *b)
+{
+  return b->method_params;
+}
+
+void libballyhoo_xml_free(BallyhooXMLRPC *b)
+{
+  if (b->type == BXMLRPC_CALL) {
+    g_free((char*)b->method_name);
+    if (b->method_params) {
+      xmlrpc_DECREF(b->method_params);
+    }
+  }
+
+  g_free(b);
+}
@@ -25,13 +25,56 @@
 #include <glib.h>
 #include <xmlrpc-c/base.h>
 
+enum BallyhooXMLRoot {
+  BXML_ROOT_UNKNOWN,
+  BXML_ROOT_CALL,
+  BXML_ROOT_RESPONSE
+};
+
 gpointer libballyhoo_xml_encode_request(const char *method_name,
                                         const char *format,
                                         va_list args);
 
+/**
+ * Serialize an xmlrpc method call onto the end of out.
+ *
+ * Flat signatures of strings, ints and booleans, like "(ss)"
+ *  or "(sssb)", are written directly without building any
+ *  xmlrpc_values. Anything else goes through xmlrpc-c.
+ */
+void libballyhoo_xml_append_request(GString *out,
+                                    const char *method_name,
+                                    const char *format,
+                                    va_list args);
+
 gpointer libballyhoo_xml_encode_responseb(gboolean resp);
+void libballyhoo_xml_append_responseb(GString *out, gboolean resp);
 
 BallyhooXMLRPC *libballyhoo_xml_create_fault(gint code, gchar *fault_string);
-BallyhooXMLRPC *libballyhoo_xml_decode(gpointer xmlrpc, size_t length);
+/**
+ * Peek at the root element of an xmlrpc document to see if
+ *  it is a methodCall or methodResponse, without parsing it.
+ */
+enum BallyhooXMLRoot libballyhoo_xml_sniff(gconstpointer xmlrpc, size_t length);
+
+/**
+ * Decode an xmlrpc method call or response.
+ *
+ * The document is only parsed once, by whichever parser
+ *  matches its root element, so a malformed method call is
+ *  rejected here.
+ */
+BallyhooXMLRPC *libballyhoo_xml_decode(gconstpointer xmlrpc, size_t length);
+
+/**
+ * Get the params of a method call
+ */
+xmlrpc_value *libballyhoo_xml_params(BallyhooXMLRPC *b);
+
+/**
+ * Free a decoded method call or response. The response
+ *  value itself belongs to the Deferred's callbacks.
+ */
+void libballyhoo_xml_free(BallyhooXMLRPC *b);
 
 #endif
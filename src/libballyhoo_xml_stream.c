@@ -0,0 +1,332 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libballyhoo_xml_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _StreamFrame {
+  gboolean is_struct;
+  int index;
+} StreamFrame;
+
+typedef struct _StreamState {
+  BallyhooXMLEventFunc func;
+  gpointer user_data;
+
+  /* the open structs and arrays */
+  StreamFrame frames[LIBBALLYHOO_XML_MAX_DEPTH];
+  int depth;
+  int param_index;
+
+  /* text of the current scalar or member name. These
+   *  are reused for the whole document. */
+  GString *text;
+  gboolean collecting;
+  GString *member;
+
+  /* inside a <value> we haven't sent an event for yet */
+  gboolean in_value;
+  gboolean typed;
+  enum BallyhooXMLScalarType scalar;
+
+  gboolean fault;
+  /* the callback asked us to stop */
+  gboolean stopped;
+} StreamState;
+
+static const struct {
+  const char *element;
+  enum BallyhooXMLScalarType type;
+} scalar_elements[] = {
+  { "string", BXML_SCALAR_STRING },
+  { "int", BXML_SCALAR_INT },
+  { "i4", BXML_SCALAR_INT },
+  { "i8", BXML_SCALAR_INT },
+  { "ex:i8", BXML_SCALAR_INT },
+  { "boolean", BXML_SCALAR_BOOLEAN },
+  { "double", BXML_SCALAR_DOUBLE },
+  { "dateTime.iso8601", BXML_SCALAR_DATETIME },
+  { "base64", BXML_SCALAR_BASE64 },
+  { "nil", BXML_SCALAR_NIL },
+  { "ex:nil", BXML_SCALAR_NIL },
+};
+
+static gboolean lookup_scalar(const gchar *element, enum BallyhooXMLScalarType *type)
+{
+  for (int i = 0; i < G_N_ELEMENTS(scalar_elements); i++) {
+    if (strcmp(element, scalar_elements[i].element) == 0) {
+      *type = scalar_elements[i].type;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void stream_event_init(StreamState *st, BallyhooXMLEvent *ev,
+                              enum BallyhooXMLEventType type)
+{
+  memset(ev, 0, sizeof(BallyhooXMLEvent));
+  ev->type = type;
+  ev->depth = st->depth;
+
+  if (st->depth == 0) {
+    ev->index = st->param_index;
+  } else if (st->frames[st->depth - 1].is_struct) {
+    ev->member = st->member->str;
+    ev->index = -1;
+  } else {
+    ev->index = st->frames[st->depth - 1].index;
+  }
+}
+
+static void stream_emit(StreamState *st, BallyhooXMLEvent *ev, GError **error)
+{
+  if (!st->func(ev, st->user_data)) {
+    st->stopped = TRUE;
+    g_set_error(error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                "Stopped by the caller");
+  }
+}
+
+static void stream_emit_scalar(StreamState *st, GError **error)
+{
+  BallyhooXMLEvent ev;
+  stream_event_init(st, &ev, BXML_EVENT_SCALAR);
+  ev.scalar = st->scalar;
+  ev.text = st->text->str;
+  ev.length = st->text->len;
+
+  st->in_value = FALSE;
+  st->collecting = FALSE;
+  stream_emit(st, &ev, error);
+}
+
+static void stream_start_element(GMarkupParseContext *context,
+                                 const gchar *element_name,
+                                 const gchar **attribute_names,
+                                 const gchar **attribute_values,
+                                 gpointer user_data,
+                                 GError **error)
+{
+  StreamState *st = user_data;
+  enum BallyhooXMLScalarType scalar;
+
+  if (strcmp(element_name, "value") == 0) {
+    st->in_value = TRUE;
+    st->typed = FALSE;
+    st->scalar = BXML_SCALAR_STRING; /* untyped values are strings */
+    g_string_truncate(st->text, 0);
+    st->collecting = TRUE;
+  } else if (strcmp(element_name, "name") == 0) {
+    g_string_truncate(st->text, 0);
+    st->collecting = TRUE;
+  } else if (st->in_value && lookup_scalar(element_name, &scalar)) {
+    st->typed = TRUE;
+    st->scalar = scalar;
+    g_string_truncate(st->text, 0);
+    st->collecting = TRUE;
+  } else if (strcmp(element_name, "struct") == 0 ||
+             strcmp(element_name, "array") == 0) {
+    gboolean is_struct = element_name[0] == 's';
+    if (st->depth == LIBBALLYHOO_XML_MAX_DEPTH) {
+      g_set_error(error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                  "Values are nested too deeply");
+      return;
+    }
+
+    st->in_value = FALSE;
+    st->collecting = FALSE;
+
+    BallyhooXMLEvent ev;
+    stream_event_init(st, &ev, is_struct ? BXML_EVENT_STRUCT_BEGIN : BXML_EVENT_ARRAY_BEGIN);
+
+    st->frames[st->depth].is_struct = is_struct;
+    st->frames[st->depth].index = 0;
+    st->depth++;
+
+    stream_emit(st, &ev, error);
+  } else if (strcmp(element_name, "fault") == 0) {
+    // let the caller decode faults the normal way
+    st->fault = TRUE;
+    g_set_error(error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                "Fault response");
+  } else {
+    st->collecting = FALSE;
+  }
+}
+
+static void stream_end_element(GMarkupParseContext *context,
+                               const gchar *element_name,
+                               gpointer user_data,
+                               GError **error)
+{
+  StreamState *st = user_data;
+  enum BallyhooXMLScalarType scalar;
+
+  if (strcmp(element_name, "value") == 0) {
+    if (st->in_value) {
+      // a value without a type is a string
+      stream_emit_scalar(st, error);
+    }
+    st->collecting = FALSE;
+
+    if (st->depth > 0 && !st->frames[st->depth - 1].is_struct) {
+      st->frames[st->depth - 1].index++;
+    }
+  } else if (strcmp(element_name, "name") == 0) {
+    g_string_assign(st->member, st->text->str);
+    st->collecting = FALSE;
+  } else if (st->in_value && lookup_scalar(element_name, &scalar)) {
+    stream_emit_scalar(st, error);
+  } else if (strcmp(element_name, "struct") == 0 ||
+             strcmp(element_name, "array") == 0) {
+    if (st->depth == 0) {
+      g_set_error(error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                  "Unbalanced %s", element_name);
+      return;
+    }
+    st->depth--;
+
+    BallyhooXMLEvent ev;
+    stream_event_init(st, &ev, element_name[0] == 's' ? BXML_EVENT_STRUCT_END : BXML_EVENT_ARRAY_END);
+    ev.member = NULL;
+
+    stream_emit(st, &ev, error);
+  } else if (strcmp(element_name, "param") == 0) {
+    st->param_index++;
+  }
+}
+
+static void stream_text(GMarkupParseContext *context,
+                        const gchar *text,
+                        gsize text_len,
+                        gpointer user_data,
+                        GError **error)
+{
+  StreamState *st = user_data;
+
+  if (st->collecting) {
+    g_string_append_len(st->text, text, text_len);
+  }
+}
+
+static const GMarkupParser stream_parser = {
+  stream_start_element,
+  stream_end_element,
+  stream_text,
+  NULL,
+  NULL
+};
+
+enum BallyhooXMLStreamResult libballyhoo_xml_stream(gconstpointer xmlrpc, size_t length,
+                                                    BallyhooXMLEventFunc func,
+                                                    gpointer user_data)
+{
+  const gchar *xml = xmlrpc;
+
+  // GMarkup doesn't understand a byte order mark
+  if (length >= 3 && memcmp(xml, "\xef\xbb\xbf", 3) == 0) {
+    xml += 3;
+    length -= 3;
+  }
+
+  StreamState st;
+  memset(&st, 0, sizeof(StreamState));
+  st.func = func;
+  st.user_data = user_data;
+  st.text = g_string_sized_new(256);
+  st.member = g_string_sized_new(32);
+
+  GError *error = NULL;
+  GMarkupParseContext *context = g_markup_parse_context_new(&stream_parser,
+                                                            G_MARKUP_TREAT_CDATA_AS_TEXT,
+                                                            &st, NULL);
+  gboolean success = g_markup_parse_context_parse(context, xml, length, &error) &&
+    g_markup_parse_context_end_parse(context, &error);
+  g_markup_parse_context_free(context);
+
+  g_string_free(st.text, TRUE);
+  g_string_free(st.member, TRUE);
+
+  if (st.fault) {
+    g_clear_error(&error);
+    return BXML_STREAM_FAULT;
+  }
+  if (!success && !st.stopped) {
+    g_clear_error(&error);
+    return BXML_STREAM_ERROR;
+  }
+
+  g_clear_error(&error);
+  return BXML_STREAM_OK;
+}
+
+gboolean libballyhoo_xml_event_is(const BallyhooXMLEvent *event, int depth,
+                                  const char *member)
+{
+  return event->depth == depth &&
+    event->member != NULL &&
+    strcmp(event->member, member) == 0;
+}
+
+gboolean libballyhoo_xml_event_int(const BallyhooXMLEvent *event, gint32 *value)
+{
+  if (event->type != BXML_EVENT_SCALAR || event->scalar != BXML_SCALAR_INT) {
+    return FALSE;
+  }
+
+  gchar *end;
+  gint64 v = g_ascii_strtoll(event->text, &end, 10);
+  if (end == event->text) {
+    return FALSE;
+  }
+  *value = (gint32)v;
+
+  return TRUE;
+}
+
+gboolean libballyhoo_xml_event_bool(const BallyhooXMLEvent *event, gboolean *value)
+{
+  if (event->type != BXML_EVENT_SCALAR || event->scalar != BXML_SCALAR_BOOLEAN) {
+    return FALSE;
+  }
+
+  // skip any whitespace
+  const char *t = event->text;
+  while (g_ascii_isspace(*t)) {
+    t++;
+  }
+  if (*t != '0' && *t != '1') {
+    return FALSE;
+  }
+  *value = *t == '1';
+
+  return TRUE;
+}
+
+gchar *libballyhoo_xml_event_dup(const BallyhooXMLEvent *event)
+{
+  if (event->type != BXML_EVENT_SCALAR) {
+    return NULL;
+  }
+
+  return g_strndup(event->text, event->length);
+}
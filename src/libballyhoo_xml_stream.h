@@ -0,0 +1,104 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBBALLYHOO_XML_STREAM_H_
+#define _LIBBALLYHOO_XML_STREAM_H_
+
+#include <glib.h>
+
+#define LIBBALLYHOO_XML_MAX_DEPTH 32
+
+enum BallyhooXMLEventType {
+  BXML_EVENT_STRUCT_BEGIN,
+  BXML_EVENT_STRUCT_END,
+  BXML_EVENT_ARRAY_BEGIN,
+  BXML_EVENT_ARRAY_END,
+  BXML_EVENT_SCALAR
+};
+
+enum BallyhooXMLScalarType {
+  BXML_SCALAR_STRING,
+  BXML_SCALAR_INT,
+  BXML_SCALAR_BOOLEAN,
+  BXML_SCALAR_DOUBLE,
+  BXML_SCALAR_DATETIME,
+  BXML_SCALAR_BASE64,
+  BXML_SCALAR_NIL
+};
+
+/**
+ * A single value (or the end of a struct or array) read
+ *  from an xmlrpc document.
+ *
+ * The response value, or each of a method call's params,
+ *  is at depth 0. Anything inside a struct or array is one
+ *  deeper than its container.
+ */
+typedef struct _BallyhooXMLEvent {
+  enum BallyhooXMLEventType type;
+  int depth;
+
+  /* the name of the struct member holding this value. This
+   *  is NULL for array items, params, and *_END events */
+  const char *member;
+  /* the position in the array or param list, or -1 for
+   *  struct members */
+  int index;
+
+  /* for scalars, the unescaped text. This is only valid
+   *  during the callback. */
+  enum BallyhooXMLScalarType scalar;
+  const char *text;
+  size_t length;
+} BallyhooXMLEvent;
+
+/**
+ * Called for each event. Return FALSE to stop parsing, the
+ *  document is still considered a success.
+ */
+typedef gboolean (*BallyhooXMLEventFunc)(const BallyhooXMLEvent *event,
+                                         gpointer user_data);
+
+enum BallyhooXMLStreamResult {
+  BXML_STREAM_OK,
+  BXML_STREAM_FAULT, /* the document is a fault response */
+  BXML_STREAM_ERROR
+};
+
+/**
+ * Stream the values of an xmlrpc method call or response
+ *  to func, without building a tree of xmlrpc_values.
+ *
+ * Fault responses aren't streamed, BXML_STREAM_FAULT is
+ *  returned as soon as one is seen so the caller can decode
+ *  it with libballyhoo_xml_decode instead.
+ */
+enum BallyhooXMLStreamResult libballyhoo_xml_stream(gconstpointer xmlrpc, size_t length,
+                                                    BallyhooXMLEventFunc func,
+                                                    gpointer user_data);
+
+/**
+ * Helpers to read the value of a scalar event
+ */
+gboolean libballyhoo_xml_event_is(const BallyhooXMLEvent *event, int depth,
+                                  const char *member);
+gboolean libballyhoo_xml_event_int(const BallyhooXMLEvent *event, gint32 *value);
+gboolean libballyhoo_xml_event_bool(const BallyhooXMLEvent *event, gboolean *value);
+gchar *libballyhoo_xml_event_dup(const BallyhooXMLEvent *event);
+
+#endif
@@ -26,12 +26,16 @@
 #define END 32
 #define FLAG_4 0
 
+/* how much bigger than its first chunk we guess a message will be */
+#define REASSEMBLY_FACTOR 4
+
 // keep track of the message index
 static int32_t _cmf_static_index = 1;
 
 void *build_chunk(const void *data, size_t length, int32_t id,
                   gboolean begin, gboolean end, int priority);
 int calculate_priority(int priority);
+static int libcmf_decode_header(const unsigned char *b, size_t length, CMFFrame *frame);
 
 GList *libcmf_encode(const void *data, size_t length)
 {
@@ -41,7 +45,7 @@ GList *libcmf_encode(const void *data, size_t length)
 GList *libcmf_encode_priority(const void *data, size_t length, int priority)
 {
   GList *chunks = NULL;
-  int32_t chunk_id = _cmf_static_index++;
+  int32_t chunk_id = libcmf_next_id();
   
   for (int i = 0; i < length; i += LIBCMF_CHUNK_SIZE) {
     gboolean start = i == 0;
@@ -59,67 +63,144 @@ GList *libcmf_encode_priority(const void *data, size_t length, int priority)
 
 int libcmf_decode(const void *data, size_t length, CMFDecodedChunk* chunk)
 {
-  gboolean begin, end;
-  unsigned char *b = (unsigned char*)data;
-  
-  if (length < 8) {
-    return 0; // not enough data to even parse the header
+  CMFFrame frame;
+  int ret = libcmf_decode_header(data, length, &frame);
+  if (ret != 1) {
+    return ret;
   }
 
-  /** start FLAGS **/
-  unsigned char flags = b[0];
-  if ((flags & 0x80) != 0) {
-    /* first bit should be 0 */
-    return -1;
+  // we have enough data! copy it into our chunk
+  chunk->size = frame.size;
+  chunk->buffer = g_malloc0(chunk->size);
+  memcpy(chunk->buffer, (unsigned char*)data + frame.offset, frame.size);
+
+  chunk->begin = frame.begin;
+  chunk->end = frame.end;
+  chunk->priority = frame.priority;
+  chunk->id = frame.id;
+
+  return 1;
+}
+
+int libcmf_index(const void *data, size_t length,
+                 CMFFrame *frames, int max_frames, size_t *consumed,
+                 gboolean *malformed)
+{
+  const unsigned char *b = (const unsigned char*)data;
+  size_t offset = 0;
+  int count = 0;
+  gboolean bad = FALSE;
+
+  while (count < max_frames) {
+    int ret = libcmf_decode_header(b + offset, length - offset, &frames[count]);
+    if (ret == -1) {
+      // keep the frames before it
+      bad = TRUE;
+      break;
+    } else if (ret == 0) {
+      break;
+    }
+
+    // make the payload offset relative to the start of data
+    frames[count].offset += offset;
+    offset = frames[count].offset + frames[count].size;
+    count++;
   }
-  /* next flag is begin then end */
-  begin = (flags & 0x40) == 0x40;
-  end = (flags & 0x20) == 0x20;
-  /* ignore priority */
-  /** end FLAGS **/
 
-  /* skip ignored */
+  *consumed = offset;
+  if (malformed) {
+    *malformed = bad;
+  }
 
-  /* next 16-bits are the length */
-  gushort msg_length_be;
-  memcpy(&msg_length_be, b + 2, 2);
-  gushort msg_length = g_ntohs(msg_length_be);
-  purple_debug_info("helplightning", "length is %d\n", msg_length);
+  return count;
+}
 
-  /* next 32-bits are the id */
-  guint id_be;
-  memcpy(&id_be, b + 4, 4);
-  guint id = g_ntohl(id_be);
-  purple_debug_info("helplightning", "id is %d\n", id);
+CMFReassembler *libcmf_reassembler_new()
+{
+  CMFReassembler *r = g_new0(CMFReassembler, 1);
+  r->messages = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                      NULL, (GDestroyNotify)libcmf_message_free);
 
-  
-  if (msg_length + 8 <= length) {
-    // we have enough data! copy it into our chunk
-    chunk->size = msg_length;
-    chunk->buffer = g_malloc0(chunk->size);
-    memcpy(chunk->buffer, b+8, msg_length);
-
-    chunk->begin = begin;
-    chunk->end = end;
-    chunk->priority = 10;
-    chunk->id = id;
-
-    return 1;
-  } else {
-    return 0;
+  return r;
+}
+
+void libcmf_reassembler_free(CMFReassembler *r)
+{
+  // this also frees any partial messages
+  g_hash_table_destroy(r->messages);
+  g_free(r);
+}
+
+CMFMessage *libcmf_reassembler_add(CMFReassembler *r, const CMFFrame *frame,
+                                   const void *payload)
+{
+  CMFMessage *m = g_hash_table_lookup(r->messages, GINT_TO_POINTER(frame->id));
+  if (m == NULL) {
+    // size the buffer from the first chunk. If that chunk
+    //  isn't the last one, there is more to come.
+    m = g_new0(CMFMessage, 1);
+    m->id = frame->id;
+    m->capacity = frame->end ? frame->size : frame->size * REASSEMBLY_FACTOR;
+    m->buffer = g_malloc(MAX(m->capacity, 1));
+
+    g_hash_table_insert(r->messages, GINT_TO_POINTER(frame->id), m);
+  }
+
+  if (m->size + frame->size > m->capacity) {
+    // grow geometrically, so appending stays linear overall
+    while (m->size + frame->size > m->capacity) {
+      m->capacity = MAX(m->capacity * 2, LIBCMF_CHUNK_SIZE);
+    }
+    m->buffer = g_realloc(m->buffer, m->capacity);
+  }
+
+  memcpy(m->buffer + m->size, payload, frame->size);
+  m->size += frame->size;
+
+  if (!frame->end) {
+    return NULL;
   }
+
+  // the message is complete, hand it over to the caller
+  g_hash_table_steal(r->messages, GINT_TO_POINTER(frame->id));
+
+  return m;
 }
 
+void libcmf_message_free(CMFMessage *m)
+{
+  g_free(m->buffer);
+  g_free(m);
+}
 
 gpointer build_chunk(const void *data, size_t length, int32_t id,
                   gboolean begin, gboolean end, int priority)
 {
   CMFChunk *chunk = g_new0(CMFChunk, 1);
 
-  chunk->size = 8 + length; /* 8-byte header */
-  chunk->buffer = g_malloc0(chunk->size); /* 8-byte header */
+  chunk->size = LIBCMF_HEADER_SIZE + length;
+  chunk->buffer = g_malloc0(chunk->size);
   unsigned char *b = (unsigned char*)chunk->buffer;
 
+  libcmf_write_header(b, length, id, begin, end, priority);
+  b += LIBCMF_HEADER_SIZE;
+
+  // copy data into b
+  memcpy(b, data, length);
+
+  return chunk;
+}
+
+gint32 libcmf_next_id()
+{
+  return _cmf_static_index++;
+}
+
+void libcmf_write_header(void *header, size_t length, gint32 id,
+                         gboolean begin, gboolean end, int priority)
+{
+  unsigned char *b = (unsigned char*)header;
+
   /* See [1] for header references:
    * [1] https://vipaar.atlassian.net/wiki/spaces/DT/pages/53379103/Chunked+Message+Framing+CMF+Library
    */
@@ -139,12 +220,6 @@ gpointer build_chunk(const void *data, size_t length, int32_t id,
   // 5-8 is the 32-bit ID in MSB
   guint id_be = g_htonl(id);
   memcpy(b, &id_be, 4);
-  b += 4;
-
-  // copy data into b
-  memcpy(b, data, length);
-
-  return chunk;
 }
 
 int calculate_priority(int priority) {
@@ -155,3 +230,45 @@ int calculate_priority(int priority) {
   else
     return priority;
 }
+
+static int libcmf_decode_header(const unsigned char *b, size_t length, CMFFrame *frame)
+{
+  if (length < 8) {
+    return 0; // not enough data to even parse the header
+  }
+
+  /** start FLAGS **/
+  unsigned char flags = b[0];
+  if ((flags & 0x80) != 0) {
+    /* first bit should be 0 */
+    return -1;
+  }
+  /* next flag is begin then end */
+  frame->begin = (flags & BEGIN) == BEGIN;
+  frame->end = (flags & END) == END;
+  /* the lower 4 bits are the priority */
+  frame->priority = flags & 0x0f;
+  /** end FLAGS **/
+
+  /* skip ignored */
+
+  /* next 16-bits are the length */
+  gushort msg_length_be;
+  memcpy(&msg_length_be, b + 2, 2);
+  gushort msg_length = g_ntohs(msg_length_be);
+
+  /* next 32-bits are the id */
+  guint id_be;
+  memcpy(&id_be, b + 4, 4);
+  guint id = g_ntohl(id_be);
+
+  if (msg_length + 8 > length) {
+    return 0;
+  }
+
+  frame->offset = 8;
+  frame->size = msg_length;
+  frame->id = id;
+
+  return 1;
+}
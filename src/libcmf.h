@@ -22,6 +22,8 @@
 #include <glib.h>
 
 #define LIBCMF_CHUNK_SIZE 1024
+#define LIBCMF_HEADER_SIZE 8
+#define LIBCMF_PRIORITIES 16 /* 0 is the highest, 15 the lowest */
 
 typedef struct _CMFChunk {
   size_t size;
@@ -37,6 +39,40 @@ typedef struct _CMFDecodedChunk {
   gint32 id;
 } CMFDecodedChunk;
 
+/**
+ * A chunk found by libcmf_index. It doesn't own any
+ *  memory, the payload lives at data + offset in the
+ *  buffer that was indexed.
+ */
+typedef struct _CMFFrame {
+  size_t offset;
+  size_t size;
+  gboolean begin;
+  gboolean end;
+  int priority;
+  gint32 id;
+} CMFFrame;
+
+/**
+ * A message being put back together from its chunks.
+ *
+ * Each chunk's payload is appended straight into one
+ *  buffer, which grows geometrically.
+ */
+typedef struct _CMFMessage {
+  gint32 id;
+  size_t size;
+  size_t capacity;
+  guchar *buffer;
+} CMFMessage;
+
+/**
+ * All the messages currently in flight, keyed by CMF id
+ */
+typedef struct _CMFReassembler {
+  GHashTable *messages;
+} CMFReassembler;
+
 /**
  * Split a message into chunks for delivery.
  *
@@ -50,6 +86,17 @@ typedef struct _CMFDecodedChunk {
 GList *libcmf_encode(const void *data, size_t length);
 GList *libcmf_encode_priority(const void *data, size_t length, int priority);
 
+/**
+ * Write the 8 byte header for a chunk of length bytes, for
+ *  callers that lay out the payload themselves.
+ *
+ * Every chunk of a message shares the id from
+ *  libcmf_next_id.
+ */
+gint32 libcmf_next_id();
+void libcmf_write_header(void *header, size_t length, gint32 id,
+                         gboolean begin, gboolean end, int priority);
+
 /**
  * Return to decode a CMF chunk
  *
@@ -60,4 +107,43 @@ GList *libcmf_encode_priority(const void *data, size_t length, int priority);
  */
 int libcmf_decode(const void *data, size_t length, CMFDecodedChunk* chunk);
 
+/**
+ * Index all the complete CMF chunks in a buffer in
+ *  a single pass without copying any payloads.
+ *
+ * Up to max_frames descriptors are filled in and consumed
+ *  is set to the number of bytes they cover, so the
+ *  caller can drop them from its buffer.
+ *
+ * Indexing stops at a malformed header. The frames before
+ *  it are still returned, and malformed (if not NULL) is
+ *  set to TRUE, otherwise FALSE.
+ *
+ * Returns the number of frames found (0 if there isn't
+ *  a complete chunk yet).
+ */
+int libcmf_index(const void *data, size_t length,
+                 CMFFrame *frames, int max_frames, size_t *consumed,
+                 gboolean *malformed);
+
+/**
+ * Reassemble messages that span multiple chunks.
+ */
+CMFReassembler *libcmf_reassembler_new();
+void libcmf_reassembler_free(CMFReassembler *r);
+
+/**
+ * Append a chunk's payload to the message it belongs to.
+ *
+ * Returns NULL until the final chunk of the message is
+ *  added. Then the complete message is returned, and the
+ *  caller must free it with libcmf_message_free.
+ *
+ * A message that fits in a single chunk (begin and end)
+ *  doesn't need to be added at all.
+ */
+CMFMessage *libcmf_reassembler_add(CMFReassembler *r, const CMFFrame *frame,
+                                   const void *payload);
+void libcmf_message_free(CMFMessage *m);
+
 #endif
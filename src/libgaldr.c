@@ -18,14 +18,15 @@
 
 #include "libgaldr.h"
 #include "libgaldr_handler.h"
+#include "libgaldr_single_flight.h"
 
 #include <debug.h>
 
 void libgaldr_connected_cb(PurpleConnection *gc);
-DeferredResponse *libgaldr_do_auth_cb(BallyhooAccount* ba, gpointer resp,
+DeferredResponse libgaldr_do_auth_cb(BallyhooAccount* ba, gpointer resp,
+                                     gpointer user_data);
+DeferredResponse libgaldr_do_auth_err(BallyhooAccount *ba, gpointer fault,
                                       gpointer user_data);
-DeferredResponse *libgaldr_do_auth_err(BallyhooAccount *ba, gpointer fault,
-                                       gpointer user_data);
 
 GaldrAccount* libgaldr_init(PurpleAccount *acct, PurplePlugin *plugin)
 {
@@ -43,6 +44,8 @@ GaldrAccount* libgaldr_init(PurpleAccount *acct, PurplePlugin *plugin)
   ba->parent = ga; // set us as the parent
   ba->handler = libgaldr_handler_dispatch; // set our handler
   ga->ba = ba;
+  libgaldr_handler_init(ga);
+  ga->session_lookups = libgaldr_single_flight_new(libgaldr_session_get_by_id);
 
   // register some signals
   purple_signal_register(ga, HELPLIGHTNING_SIGNAL_CONNECTED,
@@ -100,6 +103,8 @@ void libgaldr_shutdown(GaldrAccount *ga)
 
   g_hash_table_destroy(ga->contacts);
   g_hash_table_destroy(ga->sessions);
+  libgaldr_handler_free(ga);
+  libgaldr_single_flight_free(ga->session_lookups);
 
   // unregister signals
   purple_signal_unregister(ga, HELPLIGHTNING_SIGNAL_CONNECTED);
@@ -136,8 +141,8 @@ void libgaldr_connected_cb(PurpleConnection *gc)
                                      libgaldr_do_auth_err);
 }
 
-DeferredResponse *libgaldr_do_auth_cb(BallyhooAccount* ba, gpointer resp,
-                                      gpointer user_data)
+DeferredResponse libgaldr_do_auth_cb(BallyhooAccount* ba, gpointer resp,
+                                     gpointer user_data)
 {
   purple_debug_info("helplightning", "Auth CB!!!\n");
   purple_connection_update_progress(ba->gc, "Authenticated",
@@ -151,8 +156,8 @@ DeferredResponse *libgaldr_do_auth_cb(BallyhooAccount* ba, gpointer resp,
   return libgaldr_make_deferred_responseb(TRUE);
 }
 
-DeferredResponse *libgaldr_do_auth_err(BallyhooAccount *ba, gpointer fault,
-                                       gpointer user_data)
+DeferredResponse libgaldr_do_auth_err(BallyhooAccount *ba, gpointer fault,
+                                      gpointer user_data)
 {
   purple_debug_info("helplightning", "Auth ERR!!!\n");
   GaldrAccount *ga = ba->parent;
@@ -31,6 +31,8 @@
 #define HELPLIGHTNING_SIGNAL_INCOMING_MESSAGE "helplightning-incoming-message"
 #define HELPLIGHTNING_SIGNAL_REFRESH_CONTACTS "helplightning-refresh-contacts"
 
+struct _GaldrSingleFlight;
+
 typedef struct _GaldrAccount {
   PurplePlugin *plugin;
   PurpleAccount *account;
@@ -46,8 +48,18 @@ typedef struct _GaldrAccount {
 
   /* private members */
   BallyhooAccount *ba;
+  GHashTable *handlers; /* method name -> GaldrHandler */
+  struct _GaldrSingleFlight *session_lookups; /* session_get_by_id in flight */
 } GaldrAccount;
 
+/**
+ * Handles a method call pushed to us by the server. The
+ *  return value is sent back as the response.
+ */
+typedef gboolean (*GaldrHandlerFunction)(GaldrAccount *ga, guint64 uuid,
+                                         struct _BallyhooXMLRPC *brpc,
+                                         gpointer user_data);
+
 typedef struct _GaldrContact {
   gint32 id;
   const char *name;
@@ -59,7 +71,8 @@ typedef struct _GaldrContact {
 typedef struct _GaldrSession {
   const char *id;
   const char *token;
-  GList *users;
+  GList *users; /* the users we have as contacts */
+  int num_users; /* everyone in the session, including us */
   char *last_message_id;
 } GaldrSession;
 
@@ -89,6 +102,9 @@ Deferred *libgaldr_workspace_switch(GaldrAccount *acct, int workspace_id);
 /* contacts */
 Deferred *libgaldr_get_contacts(GaldrAccount *acct);
 
+/* Operations that take a BallyhooCancellable (which can be
+ *  NULL) are cancelled along with it, including any retries. */
+
 /* messaging */
 Deferred *libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
                               const char *message);
@@ -96,17 +112,35 @@ Deferred *libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
 GaldrSession *libgaldr_session_find(GaldrAccount *acct, const char *session_id);
 
 Deferred *libgaldr_session_create_with(GaldrAccount *acct, const char *username);
+/* Returns NULL if there is no workspace token to look it up with yet */
 Deferred *libgaldr_session_get_by_id(GaldrAccount *acct, const char *session_id);
-Deferred *libgaldr_session_mark_as_read(GaldrAccount *acct, GaldrSession *session);
+Deferred *libgaldr_session_mark_as_read(GaldrAccount *acct, GaldrSession *session,
+                                        BallyhooCancellable *cancel);
+
+/* Handlers */
+
+/**
+ * Handle every call to method_name with func, replacing any
+ *  handler already registered for it. Calls with no handler
+ *  are logged and answered with TRUE.
+ */
+void libgaldr_handler_register(GaldrAccount *ga, const char *method_name,
+                               GaldrHandlerFunction func, gpointer user_data);
+void libgaldr_handler_unregister(GaldrAccount *ga, const char *method_name);
+/**
+ * The number of calls to method_name that have been
+ *  dispatched to its handler.
+ */
+guint64 libgaldr_handler_calls(GaldrAccount *ga, const char *method_name);
 
 /* Misc */
 
-void libgaldr_add_retry(Deferred *d, GaldrMarshal *m);
+void libgaldr_add_retry(Deferred *d, GaldrClosure *c);
 
 /* Response Helpers */
-DeferredResponse *libgaldr_make_deferred_responseb(gboolean val);
-DeferredResponse *libgaldr_make_deferred_response(gpointer value);
-DeferredResponse *libgaldr_make_deferred_deferred(gpointer value);
-DeferredResponse *libgaldr_make_deferred_fault(gpointer value);
+DeferredResponse libgaldr_make_deferred_responseb(gboolean val);
+DeferredResponse libgaldr_make_deferred_response(gpointer value);
+DeferredResponse libgaldr_make_deferred_deferred(gpointer value);
+DeferredResponse libgaldr_make_deferred_fault(gpointer value);
 
 #endif
@@ -21,8 +21,8 @@
 
 #include <debug.h>
 
-DeferredResponse *libgaldr_auth_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_auth_err(BallyhooAccount *ba, gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_auth_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_auth_err(BallyhooAccount *ba, gpointer fault, gpointer user_data);
 
 Deferred *libgaldr_auth(GaldrAccount *acct, const char *username,
                         const char *password, const char *device_id)
@@ -33,9 +33,9 @@ Deferred *libgaldr_auth(GaldrAccount *acct, const char *username,
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "user_authenticate", "(sss)",
-                                                   username, password, device_id);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "user_authenticate", "(sss)",
+                                                           username, password, device_id);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
@@ -43,15 +43,12 @@ Deferred *libgaldr_auth(GaldrAccount *acct, const char *username,
 
   libballyhoo_deferred_add_callbacks(d, libgaldr_auth_cb, libgaldr_auth_err);
   
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
 
-DeferredResponse *libgaldr_auth_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_auth_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning", "galdr_auth_cb!!\n");
   GaldrAccount *ga = ba->parent;
@@ -97,7 +94,7 @@ DeferredResponse *libgaldr_auth_cb(BallyhooAccount *ba, gpointer resp, gpointer
   return libgaldr_make_deferred_deferred(d);
 }
 
-DeferredResponse *libgaldr_auth_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_auth_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning", "galdr_auth_err!!\n");
   ba->authenticated = FALSE;
@@ -20,26 +20,67 @@
 
 #include <debug.h>
 
-Deferred *_libgaldr_get_contacts(GaldrAccount *acct);
-DeferredResponse *libgaldr_get_contacts_cb(BallyhooAccount *ba,
-                                           gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_get_contacts_err(BallyhooAccount *ba,
-                                            gpointer fault, gpointer user_data);
+#define LIBGALDR_CONTACTS_PAGE_SIZE 100
+#define LIBGALDR_CONTACTS_MAX_PAGES 100 // pages of contacts we'll ask for at once
+
+/* one page of the response to user_search_team */
+typedef struct _GaldrContactsPage {
+  GList *contacts;
+  gint32 total_pages;
+} GaldrContactsPage;
+
+Deferred *_libgaldr_get_contacts(GaldrAccount *acct, int page);
+DeferredResponse libgaldr_get_contacts_cb(BallyhooAccount *ba,
+                                          gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_get_contacts_err(BallyhooAccount *ba,
+                                           gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_get_contacts_rest_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_get_contacts_join_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data);
+static void libgaldr_contacts_page_free(GaldrContactsPage *page);
+
+/**
+ * Decode the response to user_search_team straight into
+ *  a page of GaldrContacts.
+ */
+typedef struct _ContactsDecoder {
+  GList *contacts;
+  gint32 total_pages;
+  GaldrContact *current;
+  gboolean have_entries;
+  gboolean in_entries;
+  gboolean invalid;
+} ContactsDecoder;
+
+static gpointer libgaldr_contacts_decoder_begin(BallyhooAccount *ba);
+static gboolean libgaldr_contacts_decoder_event(const BallyhooXMLEvent *ev,
+                                                gpointer user_data);
+static gboolean libgaldr_contacts_decoder_finish(gpointer state, gboolean success,
+                                                 gpointer *result);
+
+static const BallyhooDecoder libgaldr_contacts_decoder = {
+  libgaldr_contacts_decoder_begin,
+  libgaldr_contacts_decoder_event,
+  libgaldr_contacts_decoder_finish
+};
 
 Deferred *libgaldr_get_contacts(GaldrAccount *acct)
 {
-  Deferred *d = _libgaldr_get_contacts(acct);
+  Deferred *d = _libgaldr_get_contacts(acct, 1);
   
   // register our internal callbacks so they get called first...
   // libballyhoo_deferred_add_callbacks(d, NULL, retry);
   libballyhoo_deferred_add_callbacks(d,
                                      libgaldr_get_contacts_cb,
                                      libgaldr_get_contacts_err);
+  // then fetch any other pages
+  libballyhoo_deferred_add_callbacks(d, libgaldr_get_contacts_rest_cb, NULL);
 
   return d;
 }
 
-Deferred *_libgaldr_get_contacts(GaldrAccount *acct)
+Deferred *_libgaldr_get_contacts(GaldrAccount *acct, int page)
 {
   if (!acct->workspace_token) {
     Deferred *dfr = libballyhoo_deferred_build(0);
@@ -53,104 +94,203 @@ Deferred *_libgaldr_get_contacts(GaldrAccount *acct)
   
   // encode a message
   guint64 uuid;
-  // !mwd - TODO: This is WRONG, we are only getting the
-  //  first `min(100, server_max_page_size)` contacts!
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "user_search_team", "(ssii)",
-                                                   acct->workspace_token, "", 1, 100);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call_priority(&uuid, LIBBALLYHOO_PRIORITY_BULK,
+                                                                    "user_search_team", "(ssii)",
+                                                                    acct->workspace_token, "", page,
+                                                                    LIBGALDR_CONTACTS_PAGE_SIZE);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_set_decoder(d, &libgaldr_contacts_decoder);
   libballyhoo_add_deferred(acct->ba, uuid, d);
 
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
 
-DeferredResponse *libgaldr_get_contacts_cb(BallyhooAccount *ba,
-                                           gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_get_contacts_cb(BallyhooAccount *ba,
+                                          gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning", "get_contacts_cb\n");
   GaldrAccount *ga = ba->parent;
 
-  // lets build some contacts!
-  xmlrpc_env env;
-  xmlrpc_env_init(&env);
-  if (xmlrpc_value_type(resp) != XMLRPC_TYPE_STRUCT) {
-    // invalid response
-    purple_debug_info("helplightning", "Invalid response to get_contacts\n");
-    return libgaldr_make_deferred_fault(g_strdup("Invalid response to get_contacts"));
+  // the contacts were already built by our decoder,
+  //  store them internally
+  GaldrContactsPage *page = resp;
+  for (GList *it = page->contacts; it != NULL; it = it->next) {
+    GaldrContact *c = it->data;
+    g_hash_table_insert(ga->contacts, g_strdup(c->username), c);
   }
   
-  xmlrpc_value *entries;
-  xmlrpc_struct_find_value(&env, resp, "entries", &entries);
-  if (!entries) {
-    purple_debug_info("helplightning", "Unable to find entries\n");
-    return libgaldr_make_deferred_fault(g_strdup("Unable to find entries"));
+  return libgaldr_make_deferred_response(page);
+}
+
+DeferredResponse libgaldr_get_contacts_err(BallyhooAccount *ba,
+                                           gpointer fault, gpointer user_data)
+{
+  purple_debug_info("helplightning", "galdr_get_contacts_err: %s!!\n", (char*)fault);
+
+  // keep propagating errors
+  return libgaldr_make_deferred_fault(fault);
+}
+
+DeferredResponse libgaldr_get_contacts_rest_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data)
+{
+  GaldrAccount *ga = ba->parent;
+  GaldrContactsPage *first = resp;
+
+  if (first->total_pages <= 1) {
+    GList *contacts = first->contacts;
+    g_free(first);
+    return libgaldr_make_deferred_response(contacts);
   }
 
-  // entries should be an array
-  if (xmlrpc_value_type(entries) != XMLRPC_TYPE_ARRAY) {
-    purple_debug_info("helplightning", "entries isn't an array\n");
-    return libgaldr_make_deferred_fault(g_strdup("Entries isn't an array"));
+  // the other pages don't depend on each other, so ask for
+  //  all of them at once. Don't take the server's word for
+  //  how many there are, as each one is a request in flight.
+  int total_pages = first->total_pages;
+  if (total_pages > LIBGALDR_CONTACTS_MAX_PAGES) {
+    purple_debug_info("helplightning", "only fetching %d of %d pages of contacts\n",
+                      LIBGALDR_CONTACTS_MAX_PAGES, total_pages);
+    total_pages = LIBGALDR_CONTACTS_MAX_PAGES;
+  }
+  purple_debug_info("helplightning", "fetching %d more pages of contacts\n",
+                    total_pages - 1);
+  int count = total_pages - 1;
+  Deferred **pages = g_new(Deferred*, count);
+  for (int i = 0; i < count; i++) {
+    pages[i] = _libgaldr_get_contacts(ga, i + 2);
+    libballyhoo_deferred_add_callbacks(pages[i],
+                                       libgaldr_get_contacts_cb,
+                                       libgaldr_get_contacts_err);
   }
 
-  GList *contacts = NULL;
-  
-  int num_entries = xmlrpc_array_size(&env, entries);
-  for (int i = 0; i < num_entries; i++) {
-    GaldrContact *c = g_new0(GaldrContact, 1);
-
-    // parse
-    xmlrpc_value *current;
-    xmlrpc_array_read_item(&env, entries, i, &current);
-
-    xmlrpc_value *v;
-
-    // id
-    xmlrpc_struct_find_value(&env, current, "id", &v);
-    xmlrpc_read_int(&env, v, &(c->id));
-    xmlrpc_DECREF(v);
-
-    // name
-    xmlrpc_struct_find_value(&env, current, "name", &v);
-    xmlrpc_read_string(&env, v, &(c->name));
-    xmlrpc_DECREF(v);
-
-    // username
-    xmlrpc_struct_find_value(&env, current, "username", &v);
-    xmlrpc_read_string(&env, v, &(c->username));
-    xmlrpc_DECREF(v);
-    
-    // reachable
-    xmlrpc_bool reachable;
-    xmlrpc_struct_find_value(&env, current, "reachable", &v);
-    xmlrpc_read_bool(&env, v, &reachable);
-    xmlrpc_DECREF(v);
-    c->reachable = reachable;
-    
-    xmlrpc_DECREF(current);
-    
-    // add to the list we return and store internally
-    contacts = g_list_append(contacts, c);
-    g_hash_table_insert(ga->contacts, g_strdup(c->username), c);
+  // if any page fails, so does the whole roster
+  Deferred *d = libballyhoo_deferred_list(pages, count, TRUE,
+                                          (GDestroyNotify)libgaldr_contacts_page_free);
+  libballyhoo_deferred_add_callbacks_notify(d, libgaldr_get_contacts_join_cb, NULL, first,
+                                            (GDestroyNotify)libgaldr_contacts_page_free);
+  g_free(pages);
+
+  return libgaldr_make_deferred_deferred(d);
+}
+
+DeferredResponse libgaldr_get_contacts_join_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data)
+{
+  DeferredListResult *r = resp;
+  GaldrContactsPage *first = user_data;
+
+  // put the pages together in order
+  GList *contacts = first->contacts;
+  g_free(first);
+  for (int i = 0; i < r->count; i++) {
+    GaldrContactsPage *page = r->results[i];
+    contacts = g_list_concat(contacts, page->contacts);
+    g_free(page);
   }
-  
-  xmlrpc_DECREF(entries);
-  
+
   return libgaldr_make_deferred_response(contacts);
 }
 
-DeferredResponse *libgaldr_get_contacts_err(BallyhooAccount *ba,
-                                            gpointer fault, gpointer user_data)
+static void libgaldr_contact_free(GaldrContact *c)
 {
-  purple_debug_info("helplightning", "galdr_get_contacts_err: %s!!\n", (char*)fault);
+  g_free((char*)c->name);
+  g_free((char*)c->username);
+  g_free(c);
+}
 
-  // keep propagating errors
-  return libgaldr_make_deferred_fault(fault);
+static gpointer libgaldr_contacts_decoder_begin(BallyhooAccount *ba)
+{
+  return g_new0(ContactsDecoder, 1);
+}
+
+static gboolean libgaldr_contacts_decoder_event(const BallyhooXMLEvent *ev,
+                                                gpointer user_data)
+{
+  ContactsDecoder *cd = user_data;
+
+  // the response is a struct, with an array of entries.
+  //  Each entry is a struct describing a contact.
+  if (ev->depth == 0) {
+    if (ev->type != BXML_EVENT_STRUCT_BEGIN && ev->type != BXML_EVENT_STRUCT_END) {
+      purple_debug_info("helplightning", "Invalid response to get_contacts\n");
+      cd->invalid = TRUE;
+      return FALSE;
+    }
+  } else if (ev->depth == 1) {
+    if (ev->type == BXML_EVENT_ARRAY_BEGIN && libballyhoo_xml_event_is(ev, 1, "entries")) {
+      cd->have_entries = TRUE;
+      cd->in_entries = TRUE;
+    } else if (ev->type == BXML_EVENT_ARRAY_END) {
+      cd->in_entries = FALSE;
+    } else if (ev->type == BXML_EVENT_SCALAR && libballyhoo_xml_event_is(ev, 1, "total_pages")) {
+      libballyhoo_xml_event_int(ev, &(cd->total_pages));
+    }
+  } else if (cd->in_entries && ev->depth == 2) {
+    if (ev->type == BXML_EVENT_STRUCT_BEGIN) {
+      cd->current = g_new0(GaldrContact, 1);
+    } else if (ev->type == BXML_EVENT_STRUCT_END && cd->current) {
+      // we key contacts by username, so skip any without one
+      if (cd->current->username) {
+        cd->contacts = g_list_prepend(cd->contacts, cd->current);
+      } else {
+        libgaldr_contact_free(cd->current);
+      }
+      cd->current = NULL;
+    }
+  } else if (cd->current && ev->depth == 3 && ev->type == BXML_EVENT_SCALAR) {
+    GaldrContact *c = cd->current;
+
+    if (libballyhoo_xml_event_is(ev, 3, "id")) {
+      libballyhoo_xml_event_int(ev, &(c->id));
+    } else if (libballyhoo_xml_event_is(ev, 3, "name") && !c->name) {
+      c->name = libballyhoo_xml_event_dup(ev);
+    } else if (libballyhoo_xml_event_is(ev, 3, "username") && !c->username) {
+      c->username = libballyhoo_xml_event_dup(ev);
+    } else if (libballyhoo_xml_event_is(ev, 3, "reachable")) {
+      libballyhoo_xml_event_bool(ev, &(c->reachable));
+    }
+  }
+
+  return TRUE;
 }
 
+static gboolean libgaldr_contacts_decoder_finish(gpointer state, gboolean success,
+                                                 gpointer *result)
+{
+  ContactsDecoder *cd = state;
+
+  if (cd->current) {
+    libgaldr_contact_free(cd->current);
+  }
+
+  // entries should be an array
+  if (!cd->have_entries) {
+    purple_debug_info("helplightning", "Unable to find entries\n");
+    success = FALSE;
+  }
+
+  if (!success || cd->invalid) {
+    g_list_free_full(cd->contacts, (GDestroyNotify)libgaldr_contact_free);
+    g_free(cd);
+    return FALSE;
+  }
+
+  GaldrContactsPage *page = g_new0(GaldrContactsPage, 1);
+  page->contacts = g_list_reverse(cd->contacts);
+  page->total_pages = cd->total_pages;
+  *result = page;
+  g_free(cd);
+
+  return TRUE;
+}
+
+/* the contacts themselves belong to ga->contacts */
+static void libgaldr_contacts_page_free(GaldrContactsPage *page)
+{
+  g_list_free(page->contacts);
+  g_free(page);
+}
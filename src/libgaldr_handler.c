@@ -18,22 +18,82 @@
 
 #include "libgaldr_handler.h"
 #include "libgaldr.h"
+#include "libgaldr_single_flight.h"
+#include "libballyhoo_xml.h"
 #include <debug.h>
+#include <string.h>
 
 gboolean libgaldr_handler_conn_pong(GaldrAccount *ga, guint64 uuid,
-                                    BallyhooXMLRPC *brpc);
+                                    BallyhooXMLRPC *brpc, gpointer user_data);
 gboolean libgaldr_handler_session_created(GaldrAccount *ga, guint64 uuid,
-                                          BallyhooXMLRPC *brpc);
+                                          BallyhooXMLRPC *brpc, gpointer user_data);
 gboolean libgaldr_handler_session_message_received(GaldrAccount *ba,
                                                    guint64 uuid,
-                                                   BallyhooXMLRPC *brpc);
+                                                   BallyhooXMLRPC *brpc,
+                                                   gpointer user_data);
 gboolean libgaldr_handler_enterprise_refresh_contacts(GaldrAccount *ga, guint64 uid,
-                                                      BallyhooXMLRPC *brpc);
+                                                      BallyhooXMLRPC *brpc,
+                                                      gpointer user_data);
 gboolean libgaldr_handler_unknown(GaldrAccount *ba, guint64 uuid,
                                   BallyhooXMLRPC *brpc);
-DeferredResponse *libballyhoo_handler_dispatch_message(BallyhooAccount *ba,
-                                                       gpointer resp, gpointer user_data);
+DeferredResponse libballyhoo_handler_dispatch_message(BallyhooAccount *ba,
+                                                      gpointer resp, gpointer user_data);
 
+/**
+ * A registered handler, and how many calls
+ *  have been dispatched to it.
+ */
+typedef struct _GaldrHandler {
+  GaldrHandlerFunction func;
+  gpointer user_data;
+  guint64 calls;
+} GaldrHandler;
+
+static GaldrMessage *libgaldr_message_read(xmlrpc_value *params);
+static void libgaldr_message_free(GaldrMessage *im);
+
+
+void libgaldr_handler_init(GaldrAccount *ga)
+{
+  ga->handlers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  libgaldr_handler_register(ga, "conn_pong",
+                            libgaldr_handler_conn_pong, NULL);
+  libgaldr_handler_register(ga, "session_message_received",
+                            libgaldr_handler_session_message_received, NULL);
+  libgaldr_handler_register(ga, "session_created",
+                            libgaldr_handler_session_created, NULL);
+  libgaldr_handler_register(ga, "enterprise_contact_refresh",
+                            libgaldr_handler_enterprise_refresh_contacts, NULL);
+}
+
+void libgaldr_handler_free(GaldrAccount *ga)
+{
+  g_hash_table_destroy(ga->handlers);
+  ga->handlers = NULL;
+}
+
+void libgaldr_handler_register(GaldrAccount *ga, const char *method_name,
+                               GaldrHandlerFunction func, gpointer user_data)
+{
+  GaldrHandler *h = g_new0(GaldrHandler, 1);
+  h->func = func;
+  h->user_data = user_data;
+
+  g_hash_table_replace(ga->handlers, g_strdup(method_name), h);
+}
+
+void libgaldr_handler_unregister(GaldrAccount *ga, const char *method_name)
+{
+  g_hash_table_remove(ga->handlers, method_name);
+}
+
+guint64 libgaldr_handler_calls(GaldrAccount *ga, const char *method_name)
+{
+  GaldrHandler *h = g_hash_table_lookup(ga->handlers, method_name);
+
+  return h ? h->calls : 0;
+}
 
 gboolean libgaldr_handler_dispatch(BallyhooAccount *ba, guint64 uuid,
                                    BallyhooXMLRPC *brpc)
@@ -41,39 +101,35 @@ gboolean libgaldr_handler_dispatch(BallyhooAccount *ba, guint64 uuid,
   purple_debug_info("helplightning", "libgaldr_handler_dispatch %s\n", brpc->method_name);
   GaldrAccount *ga = ba->parent;
 
-  gboolean ret;
-  if (strcmp(brpc->method_name, "conn_pong") == 0) {
-    ret = libgaldr_handler_conn_pong(ga, uuid, brpc);
-  } else if (strcmp(brpc->method_name, "session_message_received") == 0) {
-    ret = libgaldr_handler_session_message_received(ga, uuid, brpc);
-  } else if (strcmp(brpc->method_name, "session_created") == 0) {
-    ret = libgaldr_handler_session_created(ga, uuid, brpc);
-  } else if (strcmp(brpc->method_name, "enterprise_contact_refresh") == 0) {
-    ret = libgaldr_handler_enterprise_refresh_contacts(ga, uuid, brpc);
-  } else {
-    ret = libgaldr_handler_unknown(ga, uuid, brpc);
+  GaldrHandler *h = g_hash_table_lookup(ga->handlers, brpc->method_name);
+  if (!h) {
+    return libgaldr_handler_unknown(ga, uuid, brpc);
   }
-  
-  return ret;
+
+  // the handler may unregister itself, so don't
+  //  touch h once it has been called
+  h->calls++;
+  return h->func(ga, uuid, brpc, h->user_data);
 }
 
 gboolean libgaldr_handler_conn_pong(GaldrAccount *ga, guint64 uuid,
-                                    BallyhooXMLRPC *brpc)
+                                    BallyhooXMLRPC *brpc, gpointer user_data)
 {
   purple_debug_info("helplightning", "conn_pong\n");
   return TRUE;
 }
 
 gboolean libgaldr_handler_session_created(GaldrAccount *ga, guint64 uuid,
-                                          BallyhooXMLRPC *brpc)
+                                          BallyhooXMLRPC *brpc, gpointer user_data)
 {
   purple_debug_info("helplightning", "session_created!\n");
   
-  xmlrpc_value *resp = brpc->method_params;
+  xmlrpc_value *resp = libballyhoo_xml_params(brpc);
   
   xmlrpc_env env;
   xmlrpc_env_init(&env);
-  if (xmlrpc_value_type(resp) != XMLRPC_TYPE_ARRAY ||
+  if (resp == NULL ||
+      xmlrpc_value_type(resp) != XMLRPC_TYPE_ARRAY ||
       xmlrpc_array_size(&env, resp) != 2) {
     // invalid response
     purple_debug_info("helplightning", "Invalid parameters to session_created\n");
@@ -177,94 +233,59 @@ gboolean libgaldr_handler_session_created(GaldrAccount *ga, guint64 uuid,
 
 gboolean libgaldr_handler_session_message_received(GaldrAccount *ga,
                                                    guint64 uuid,
-                                                   BallyhooXMLRPC *brpc)
+                                                   BallyhooXMLRPC *brpc,
+                                                   gpointer user_data)
 {
-  xmlrpc_value *resp = brpc->method_params;
-  
-  xmlrpc_env env;
-  xmlrpc_env_init(&env);
-  if (xmlrpc_value_type(resp) != XMLRPC_TYPE_ARRAY ||
-      xmlrpc_array_size(&env, resp) != 2) {
+  // the call was already parsed when it was decoded, so read
+  //  the message from its params rather than the xml again
+  GaldrMessage *im = libgaldr_message_read(libballyhoo_xml_params(brpc));
+  if (!im) {
     // invalid response
     purple_debug_info("helplightning", "Invalid parameters to session_message_received\n");
     return FALSE;
   }
 
-  xmlrpc_value *message_v, *v;
-  // second item is the message struct
-  xmlrpc_array_read_item(&env, resp, 1, &message_v);
-  if (env.fault_occurred) {
-    return FALSE;
-  }
-
-  const char *session_id;
-  purple_debug_info("helplightning", "getting session_id\n");
-  xmlrpc_struct_find_value(&env, message_v, "session_id", &v);
-  if (!v) {
+  if (!im->session_id) {
     purple_debug_info("helplightning", "uh-oh, something is wrong\n");
+    libgaldr_message_free(im);
     return TRUE;
   }
-  xmlrpc_read_string(&env, v, &session_id);
-  purple_debug_info("helplightning", "read SESSION_ID=%s\n", session_id);
-  xmlrpc_DECREF(v);
-
-  const char *id;
-  xmlrpc_struct_find_value(&env, message_v, "id", &v);
-  xmlrpc_read_string(&env, v, &id);
-  xmlrpc_DECREF(v);
-  
-  const char *body;
-  xmlrpc_struct_find_value(&env, message_v, "body", &v);
-  xmlrpc_read_string(&env, v, &body);
-  xmlrpc_DECREF(v);
-
-  gint32 from;
-  xmlrpc_struct_find_value(&env, message_v, "owner_id", &v);
-  xmlrpc_read_int(&env, v, &from);
-  xmlrpc_DECREF(v);
+  purple_debug_info("helplightning", "read SESSION_ID=%s\n", im->session_id);
 
   // find the session
-  GaldrSession *session = g_hash_table_lookup(ga->sessions, session_id);
-
-  GaldrMessage *im = g_new(GaldrMessage, 1);
-  im->session_id = g_strdup(session_id);
-  im->message_id = g_strdup(id);
-  im->owner_id = from;
-  im->body = g_strdup(body);
+  GaldrSession *session = g_hash_table_lookup(ga->sessions, im->session_id);
   
   if (session) {
     // set the most recent message id
     if (session->last_message_id)
       g_free(session->last_message_id);
-    session->last_message_id = g_strdup(id);
+    session->last_message_id = g_strdup(im->message_id);
 
     // emit a signal
     purple_signal_emit(ga, HELPLIGHTNING_SIGNAL_INCOMING_MESSAGE, ga->ba->gc, im);
+    libgaldr_message_free(im);
   } else {
-    // fetch this session
-    Deferred *d = libgaldr_session_get_by_id(ga, session_id);
-
-    CallbackPair *cp = g_new0(CallbackPair, 1);
-    cp->cb = libballyhoo_handler_dispatch_message;
-
-
-    cp->user_data = im;
-
-    libballyhoo_deferred_add_callback_pair(d, cp);
+    // fetch this session. A burst of messages for a new
+    //  session shares one lookup, and they are delivered
+    //  in the order they arrived.
+    Deferred *d = libgaldr_single_flight_get(ga->session_lookups, ga, im->session_id);
+    if (!d) {
+      purple_debug_info("helplightning", "can't look up session %s, dropping message\n",
+                        im->session_id);
+      libgaldr_message_free(im);
+      return TRUE;
+    }
 
-    return TRUE;
+    libballyhoo_deferred_add_callbacks_notify(d, libballyhoo_handler_dispatch_message,
+                                              NULL, im, (GDestroyNotify)libgaldr_message_free);
   }
   
-  free((char*)session_id);
-  free((char*)id);
-  free((char*)body);
-  xmlrpc_DECREF(message_v);
-  
   return TRUE;
 }
 
 gboolean libgaldr_handler_enterprise_refresh_contacts(GaldrAccount *ga, guint64 uid,
-                                                      BallyhooXMLRPC *brpc)
+                                                      BallyhooXMLRPC *brpc,
+                                                      gpointer user_data)
 {
   /* emit a signal the app that we are connected */
   purple_signal_emit(ga, HELPLIGHTNING_SIGNAL_REFRESH_CONTACTS, ga);
@@ -279,21 +300,97 @@ gboolean libgaldr_handler_unknown(GaldrAccount *ba, guint64 uuid,
   return TRUE;
 }
 
-DeferredResponse *libballyhoo_handler_dispatch_message(BallyhooAccount *ba,
-                                                       gpointer resp, gpointer user_data)
+DeferredResponse libballyhoo_handler_dispatch_message(BallyhooAccount *ba,
+                                                      gpointer resp, gpointer user_data)
 {
   GaldrMessage *im = user_data;
   GaldrAccount *ga = ba->parent;
   GaldrSession *session = g_hash_table_lookup(ga->sessions, im->session_id);
+  if (!session) {
+    // the lookup didn't add the session under this id
+    purple_debug_info("helplightning", "no session %s, dropping message\n", im->session_id);
+    libgaldr_message_free(im);
+    return libgaldr_make_deferred_responseb(FALSE);
+  }
 
   if (session->last_message_id)
     g_free(session->last_message_id);
   session->last_message_id = g_strdup(im->message_id);
 
-  // emit a signal
-  // !mwd - Do I need to make a copy of im?
+  // emit a signal. The handlers are done with im
+  //  once it returns.
   purple_signal_emit(ga, HELPLIGHTNING_SIGNAL_INCOMING_MESSAGE,
                      ba->gc, im);
+  libgaldr_message_free(im);
 
   return libgaldr_make_deferred_responseb(TRUE);
 }
+
+static char *libgaldr_message_read_string(xmlrpc_env *env, xmlrpc_value *message_v,
+                                         const char *key)
+{
+  xmlrpc_value *v;
+  const char *str;
+
+  xmlrpc_struct_find_value(env, message_v, key, &v);
+  if (!v) {
+    return NULL;
+  }
+  xmlrpc_read_string(env, v, &str);
+  xmlrpc_DECREF(v);
+  if (env->fault_occurred) {
+    return NULL;
+  }
+
+  char *copy = g_strdup(str);
+  free((char*)str);
+  return copy;
+}
+
+static GaldrMessage *libgaldr_message_read(xmlrpc_value *params)
+{
+  xmlrpc_env env;
+  xmlrpc_env_init(&env);
+  if (xmlrpc_value_type(params) != XMLRPC_TYPE_ARRAY ||
+      xmlrpc_array_size(&env, params) != 2) {
+    xmlrpc_env_clean(&env);
+    return NULL;
+  }
+
+  xmlrpc_value *message_v, *v;
+  // second item is the message struct
+  xmlrpc_array_read_item(&env, params, 1, &message_v);
+  if (env.fault_occurred) {
+    xmlrpc_env_clean(&env);
+    return NULL;
+  }
+  if (xmlrpc_value_type(message_v) != XMLRPC_TYPE_STRUCT) {
+    xmlrpc_DECREF(message_v);
+    xmlrpc_env_clean(&env);
+    return NULL;
+  }
+
+  GaldrMessage *im = g_new0(GaldrMessage, 1);
+  im->session_id = libgaldr_message_read_string(&env, message_v, "session_id");
+  im->message_id = libgaldr_message_read_string(&env, message_v, "id");
+  im->body = libgaldr_message_read_string(&env, message_v, "body");
+
+  xmlrpc_struct_find_value(&env, message_v, "owner_id", &v);
+  if (v) {
+    xmlrpc_read_int(&env, v, &(im->owner_id));
+    xmlrpc_DECREF(v);
+  }
+
+  xmlrpc_DECREF(message_v);
+  xmlrpc_env_clean(&env);
+
+  return im;
+}
+
+static void libgaldr_message_free(GaldrMessage *im)
+{
+  g_free((char*)im->session_id);
+  g_free((char*)im->message_id);
+  g_free((char*)im->body);
+  g_free(im);
+}
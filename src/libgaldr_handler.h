@@ -17,10 +17,18 @@
  */
 
 #include "libballyhoo.h"
+#include "libgaldr.h"
 
 #ifndef _LIBGALDR_HANDLER_H_
 #define _LIBGALDR_HANDLER_H_
 
+/**
+ * Create the handler table and register the
+ *  built-in handlers.
+ */
+void libgaldr_handler_init(GaldrAccount *ga);
+void libgaldr_handler_free(GaldrAccount *ga);
+
 gboolean libgaldr_handler_dispatch(BallyhooAccount *ba, guint64 uuid,
                                    BallyhooXMLRPC *brpc);
 
@@ -28,20 +28,17 @@ Deferred *libgaldr_refresh_workspace(GaldrAccount *acct) {
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "user_refresh_token", "(ss)",
-                                                   acct->workspace_token,
-                                                   acct->workspace_refresh_token);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "user_refresh_token", "(ss)",
+                                                           acct->workspace_token,
+                                                           acct->workspace_refresh_token);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
   libballyhoo_add_deferred(acct->ba, uuid, d);
   libballyhoo_deferred_add_callbacks(d, libgaldr_refresh_workspace_cb, NULL);
   
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
@@ -53,33 +50,34 @@ void libgaldr_conn_register(GaldrAccount *acct) {
   guint64 uuid;
   purple_debug_info("helplightning", "registering %s: %s\n", acct->primary_token,
                     acct->device_id);
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "conn_register", "(ss)",
-                                                   acct->primary_token, acct->device_id);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "conn_register", "(ss)",
+                                                           acct->primary_token, acct->device_id);
 
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 }
 
-DeferredResponse *libgaldr_default_cb(BallyhooAccount *ba,
-                                      gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_default_cb(BallyhooAccount *ba,
+                                     gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_default_cb\n");
+  // no more retries are needed
+  galdr_closure_free(user_data);
+
   // continue...
   return libgaldr_make_deferred_response(resp);
 }
 
-DeferredResponse *libgaldr_default_err(BallyhooAccount *ba,
-                                       gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_default_err(BallyhooAccount *ba,
+                                      gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_default_err\n");
   GaldrAccount *ga = ba->parent;
   
+  GaldrClosure *c = user_data;
   BallyhooXMLRPC *resp = (BallyhooXMLRPC*)fault;
   purple_debug_info("helplightning", "!!libgaldr_default_err %d!!\n", resp->fault_code);
-  if (resp->fault_code == 1003) {
+  if (resp->fault_code == 1003 && galdr_closure_can_retry(c)) {
     purple_debug_info("helplightning", "REFRESHING TOKENS\n");
     // we need to refresh...
     // !mwd - TODO: how do we know if we should refresh
@@ -87,30 +85,42 @@ DeferredResponse *libgaldr_default_err(BallyhooAccount *ba,
     Deferred *d = libgaldr_refresh_workspace(ga);
 
     // add in the callbacks that upon success, we call the original function
-    CallbackPair *cp = g_new0(CallbackPair, 1);
-    cp->user_data = user_data;
-    cp->cb = libgaldr_retry_cb;
-    libballyhoo_deferred_add_callback_pair(d, cp);
+    libballyhoo_deferred_add_callbacks_notify(d, libgaldr_retry_cb, libgaldr_retry_err, c,
+                                              (GDestroyNotify)galdr_closure_free);
 
     // and return a deferred...
     return libgaldr_make_deferred_deferred(d);
   } else {
+    galdr_closure_free(c);
     return libgaldr_make_deferred_fault((gpointer)(resp->fault_string));
   }
 }
 
-DeferredResponse *libgaldr_retry_cb(BallyhooAccount *ba,
-                                    gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_retry_cb(BallyhooAccount *ba,
+                                   gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_retry_cb\n");
-  GaldrMarshal *m = user_data;
-  Deferred *d = galdr_marshal_emit(m);
+  GaldrClosure *c = user_data;
+  Deferred *d = galdr_closure_invoke(c);
+
+  // the retry can be retried too, until we run out
+  libgaldr_add_retry(d, c);
 
   return libgaldr_make_deferred_deferred(d);
 }
 
-DeferredResponse *libgaldr_refresh_workspace_cb(BallyhooAccount *ba,
-                                                gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_retry_err(BallyhooAccount *ba,
+                                    gpointer fault, gpointer user_data)
+{
+  purple_debug_info("helplightning->", "libgaldr_retry_err\n");
+  // the refresh failed, so there won't be a retry
+  galdr_closure_free(user_data);
+
+  return libgaldr_make_deferred_fault(fault);
+}
+
+DeferredResponse libgaldr_refresh_workspace_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_refresh_workspace_cb\n");
   GaldrAccount *ga = ba->parent;
@@ -149,13 +159,10 @@ DeferredResponse *libgaldr_refresh_workspace_cb(BallyhooAccount *ba,
   return libgaldr_make_deferred_responseb(TRUE);
 }
 
-void libgaldr_add_retry(Deferred *d, GaldrMarshal *m)
+void libgaldr_add_retry(Deferred *d, GaldrClosure *c)
 {
   purple_debug_info("helplightning->", "libgaldr_add_retry\n");
-  CallbackPair *cp = g_new0(CallbackPair, 1);
-  cp->user_data = m;
-  cp->cb = libgaldr_default_cb;
-  cp->err = libgaldr_default_err;
-
-  libballyhoo_deferred_add_callback_pair(d, cp);
+  libballyhoo_deferred_add_callbacks_notify(d, libgaldr_default_cb,
+                                            libgaldr_default_err, c,
+                                            (GDestroyNotify)galdr_closure_free);
 }
@@ -24,15 +24,17 @@
 #include "libgaldr_signals.h"
 
 void libgaldr_conn_register(GaldrAccount *acct);
-void libgaldr_add_retry(Deferred *d, GaldrMarshal *m);
+void libgaldr_add_retry(Deferred *d, GaldrClosure *c);
 
-DeferredResponse *libgaldr_default_cb(BallyhooAccount *ba,
-                                      gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_default_err(BallyhooAccount *ba,
-                                       gpointer fault, gpointer user_data);
-DeferredResponse *libgaldr_retry_cb(BallyhooAccount *ba,
-                                    gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_refresh_workspace_cb(BallyhooAccount *ba,
-                                                gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_default_cb(BallyhooAccount *ba,
+                                     gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_default_err(BallyhooAccount *ba,
+                                      gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_retry_cb(BallyhooAccount *ba,
+                                   gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_retry_err(BallyhooAccount *ba,
+                                    gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_refresh_workspace_cb(BallyhooAccount *ba,
+                                               gpointer resp, gpointer user_data);
 
 #endif
@@ -25,30 +25,29 @@ typedef struct _GaldrPendingIM {
   const char* what;
 } GaldrPendingIM;
 
+static void libgaldr_pending_im_free(GaldrPendingIM *im);
+
 Deferred *_libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
                                const char *message);
-DeferredResponse *libgaldr_do_send_im(BallyhooAccount *ba,
-                                      gpointer resp, gpointer user_data);
-DeferredResponse *_libgaldr_messaging_err(BallyhooAccount *ba,
-                                          gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_do_send_im(BallyhooAccount *ba,
+                                     gpointer resp, gpointer user_data);
+DeferredResponse _libgaldr_messaging_err(BallyhooAccount *ba,
+                                         gpointer fault, gpointer user_data);
 
 Deferred *libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
                               const char *message)
 {
   purple_debug_info("helplightning->", "libgaldr_send_im_to\n");
   Deferred *d = _libgaldr_send_im_to(acct, contact, message);
-  GaldrMarshal *m = galdr_marshal_build(GALDR_CALLBACK(_libgaldr_send_im_to),
-                                        galdr_marshal_POINTER__POINTER_POINTER_POINTER,
-                                        3,
-                                        acct, contact, message);
+  GaldrClosure *c = galdr_closure_new3(GALDR_CLOSURE_FUNC3(_libgaldr_send_im_to),
+                                       acct, GALDR_ARG_BORROW,
+                                       contact, GALDR_ARG_BORROW,
+                                       (gpointer)message, GALDR_ARG_STRING);
   
   // add a custom error handler for when the session token is expired
-  CallbackPair *cp = g_new0(CallbackPair, 1);
-  cp->err = _libgaldr_messaging_err;
-  cp->user_data = contact;
-  libballyhoo_deferred_add_callback_pair(d, cp);
+  libballyhoo_deferred_add_callbacks_full(d, NULL, _libgaldr_messaging_err, contact);
   
-  libgaldr_add_retry(d, m);
+  libgaldr_add_retry(d, c);
 
   return d;
   
@@ -67,16 +66,12 @@ Deferred *_libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
     purple_debug_info("helplightning", "make session first!!\n");
     Deferred *d = libgaldr_session_create_with(acct, contact->username);
 
-    CallbackPair *cp = g_new0(CallbackPair, 1);
-    cp->cb = libgaldr_do_send_im;
-
     GaldrPendingIM *im = g_new0(GaldrPendingIM, 1);
     im->contact = contact;
     im->what = g_strdup(message);
-    
-    cp->user_data = im;
 
-    libballyhoo_deferred_add_callback_pair(d, cp);
+    libballyhoo_deferred_add_callbacks_notify(d, libgaldr_do_send_im, NULL, im,
+                                              (GDestroyNotify)libgaldr_pending_im_free);
     
     return d;
   } 
@@ -85,34 +80,32 @@ Deferred *_libgaldr_send_im_to(GaldrAccount *acct, GaldrContact *contact,
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "session_send_message", "(ss)",
-                                                   session->token, message);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call_priority(&uuid, LIBBALLYHOO_PRIORITY_INTERACTIVE,
+                                                                    "session_send_message", "(ss)",
+                                                                    session->token, message);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
   libballyhoo_add_deferred(acct->ba, uuid, d);
   
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
 
-DeferredResponse *libgaldr_do_send_im(BallyhooAccount *ba,
-                                      gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_do_send_im(BallyhooAccount *ba,
+                                     gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_do_send_im\n");
   GaldrPendingIM *im = user_data;
   Deferred *dfr = _libgaldr_send_im_to(ba->parent, im->contact, im->what);
+  libgaldr_pending_im_free(im);
 
   return libgaldr_make_deferred_deferred(dfr);
 }
 
-DeferredResponse *_libgaldr_messaging_err(BallyhooAccount *ba,
-                                          gpointer fault, gpointer user_data)
+DeferredResponse _libgaldr_messaging_err(BallyhooAccount *ba,
+                                         gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning->", "libgaldr_messaging_err\n");
   GaldrAccount *ga = ba->parent;
@@ -137,3 +130,9 @@ DeferredResponse *_libgaldr_messaging_err(BallyhooAccount *ba,
   // propagate the failure up
   return libgaldr_make_deferred_fault((gpointer)(resp));
 }
+
+static void libgaldr_pending_im_free(GaldrPendingIM *im)
+{
+  g_free((char*)im->what);
+  g_free(im);
+}
@@ -21,41 +21,25 @@
 #include <debug.h>
 
 
-DeferredResponse *libgaldr_make_deferred_responseb(gboolean val)
+DeferredResponse libgaldr_make_deferred_responseb(gboolean val)
 {
-  DeferredResponse *dfr = g_new0(DeferredResponse, 1);
-  dfr->type = DEFERRED_RESPONSE;
-
   gboolean *b = g_new(gboolean, 1);
   *b = val;
-  dfr->result = b;
-  
-  return dfr;
+
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, b);
 }
 
-DeferredResponse *libgaldr_make_deferred_response(gpointer value)
+DeferredResponse libgaldr_make_deferred_response(gpointer value)
 {
-  DeferredResponse *dfr = g_new0(DeferredResponse, 1);
-  dfr->type = DEFERRED_RESPONSE;
-  dfr->result = value;
-  
-  return dfr;
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, value);
 }
 
-DeferredResponse *libgaldr_make_deferred_deferred(gpointer value)
+DeferredResponse libgaldr_make_deferred_deferred(gpointer value)
 {
-  DeferredResponse *dfr = g_new0(DeferredResponse, 1);
-  dfr->type = DEFERRED_DEFERRED;
-  dfr->result = value;
-  
-  return dfr;
+  return libballyhoo_deferred_response(DEFERRED_DEFERRED, value);
 }
 
-DeferredResponse *libgaldr_make_deferred_fault(gpointer value)
+DeferredResponse libgaldr_make_deferred_fault(gpointer value)
 {
-  DeferredResponse *dfr = g_new0(DeferredResponse, 1);
-  dfr->type = DEFERRED_FAULT;
-  dfr->result = value;
-  
-  return dfr;
+  return libballyhoo_deferred_response(DEFERRED_FAULT, value);
 }
@@ -22,10 +22,33 @@
 
 Deferred *_libgaldr_session_create_with(GaldrAccount *acct, const char *username);
 Deferred *_libgaldr_session_get_by_id(GaldrAccount *acct, const char *session_id);
-DeferredResponse *libgaldr_session_create_with_cb(BallyhooAccount *ba,
-                                                  gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_session_create_with_err(BallyhooAccount *ba,
-                                                   gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_session_create_with_cb(BallyhooAccount *ba,
+                                                 gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_session_create_with_err(BallyhooAccount *ba,
+                                                  gpointer fault, gpointer user_data);
+
+/**
+ * Decode a session straight into a GaldrSession. Its users
+ *  are looked up in our contacts as they are read.
+ */
+typedef struct _SessionDecoder {
+  GaldrAccount *ga;
+  GaldrSession *session;
+  gboolean in_users;
+  gboolean invalid;
+} SessionDecoder;
+
+static gpointer libgaldr_session_decoder_begin(BallyhooAccount *ba);
+static gboolean libgaldr_session_decoder_event(const BallyhooXMLEvent *ev,
+                                               gpointer user_data);
+static gboolean libgaldr_session_decoder_finish(gpointer state, gboolean success,
+                                                gpointer *result);
+
+static const BallyhooDecoder libgaldr_session_decoder = {
+  libgaldr_session_decoder_begin,
+  libgaldr_session_decoder_event,
+  libgaldr_session_decoder_finish
+};
 
 
 GaldrSession *libgaldr_session_find(GaldrAccount *acct, const char *session_id) {
@@ -40,40 +63,41 @@ Deferred *libgaldr_session_create_with(GaldrAccount *acct, const char *username)
   Deferred *d = _libgaldr_session_create_with(acct, username);
   
   // register our internal callbacks so they get called first...
-  GaldrMarshal *m = galdr_marshal_build(GALDR_CALLBACK(_libgaldr_session_create_with),
-                                        galdr_marshal_POINTER__POINTER_POINTER,
-                                        2,
-                                        acct, username);
-  libgaldr_add_retry(d, m);
+  GaldrClosure *c = galdr_closure_new2(GALDR_CLOSURE_FUNC2(_libgaldr_session_create_with),
+                                       acct, GALDR_ARG_BORROW,
+                                       (gpointer)username, GALDR_ARG_STRING);
+  libgaldr_add_retry(d, c);
 
-  CallbackPair *cp = g_new0(CallbackPair, 1);
-  cp->cb = libgaldr_session_create_with_cb;
-  cp->err = libgaldr_session_create_with_err;
-  libballyhoo_deferred_add_callback_pair(d, cp);
+  libballyhoo_deferred_add_callbacks(d, libgaldr_session_create_with_cb,
+                                     libgaldr_session_create_with_err);
 
   return d;
 }
 
 Deferred *libgaldr_session_get_by_id(GaldrAccount *acct, const char *session_id) {
+  if (!acct->workspace_token) {
+    // nothing would ever fire the lookup, so don't start one
+    purple_debug_info("helplightning", "no workspace token to look up %s\n", session_id);
+    return NULL;
+  }
+
   Deferred *d = _libgaldr_session_get_by_id(acct, session_id);
   
   // register our internal callbacks so they get called first...
-  GaldrMarshal *m = galdr_marshal_build(GALDR_CALLBACK(_libgaldr_session_get_by_id),
-                                        galdr_marshal_POINTER__POINTER_POINTER,
-                                        2,
-                                        acct, session_id);
-  libgaldr_add_retry(d, m);
+  GaldrClosure *c = galdr_closure_new2(GALDR_CLOSURE_FUNC2(_libgaldr_session_get_by_id),
+                                       acct, GALDR_ARG_BORROW,
+                                       (gpointer)session_id, GALDR_ARG_STRING);
+  libgaldr_add_retry(d, c);
 
-  CallbackPair *cp = g_new0(CallbackPair, 1);
-  cp->cb = libgaldr_session_create_with_cb;
-  cp->err = libgaldr_session_create_with_err;
-  libballyhoo_deferred_add_callback_pair(d, cp);
+  libballyhoo_deferred_add_callbacks(d, libgaldr_session_create_with_cb,
+                                     libgaldr_session_create_with_err);
 
   return d;
 }
 
 
-Deferred *libgaldr_session_mark_as_read(GaldrAccount *acct, GaldrSession *session) {
+Deferred *libgaldr_session_mark_as_read(GaldrAccount *acct, GaldrSession *session,
+                                        BallyhooCancellable *cancel) {
   if (!session || !session->last_message_id) {
     Deferred *dfr = libballyhoo_deferred_build(0);
     // !mwd - TODO: we need to add this to helplightning
@@ -86,19 +110,17 @@ Deferred *libgaldr_session_mark_as_read(GaldrAccount *acct, GaldrSession *sessio
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "session_batch_set_message_flag", "(sssb)",
-                                                   session->token, session->last_message_id,
-                                                   "backward", TRUE);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "session_batch_set_message_flag", "(sssb)",
+                                                           session->token, session->last_message_id,
+                                                           "backward", TRUE);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
   libballyhoo_add_deferred(acct->ba, uuid, d);
+  libballyhoo_cancellable_add(cancel, d);
 
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
@@ -130,18 +152,16 @@ Deferred *_libgaldr_session_create_with(GaldrAccount *acct, const char *username
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "session_create_with_contact", "(si)",
-                                                   acct->workspace_token, contact->id);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call_priority(&uuid, LIBBALLYHOO_PRIORITY_INTERACTIVE,
+                                                                    "session_create_with_contact", "(si)",
+                                                                    acct->workspace_token, contact->id);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_set_decoder(d, &libgaldr_session_decoder);
   libballyhoo_add_deferred(acct->ba, uuid, d);
 
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
@@ -159,99 +179,130 @@ Deferred *_libgaldr_session_get_by_id(GaldrAccount *acct, const char *session_id
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "session_get_by_id", "(ss)",
-                                                   acct->workspace_token, session_id);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "session_get_by_id", "(ss)",
+                                                           acct->workspace_token, session_id);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_set_decoder(d, &libgaldr_session_decoder);
   libballyhoo_add_deferred(acct->ba, uuid, d);
 
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
 
-DeferredResponse *libgaldr_session_create_with_cb(BallyhooAccount *ba,
-                                                  gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_session_create_with_cb(BallyhooAccount *ba,
+                                                 gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning->", "session_create_with_cb\n");
   GaldrAccount *ga = ba->parent;
-
-  xmlrpc_env env;
-  xmlrpc_env_init(&env);
-  if (xmlrpc_value_type(resp) != XMLRPC_TYPE_STRUCT) {
-    // invalid response
-    purple_debug_info("helplightning", "Invalid response to make_session_with\n");
-    return libgaldr_make_deferred_fault(g_strdup("Invalid response to make_session_with"));
-  }
-
-  xmlrpc_value *v;
-  const char *id;
-  xmlrpc_struct_find_value(&env, resp, "id", &v);
-  xmlrpc_read_string(&env, v, &id);
-  xmlrpc_DECREF(v);
-  
-  const char *token;
-  xmlrpc_struct_find_value(&env, resp, "token", &v);
-  xmlrpc_read_string(&env, v, &token);
-  xmlrpc_DECREF(v);
-
-  // parse the users
-  xmlrpc_value *users_v;
-  GList *contacts = NULL;
-
-  xmlrpc_struct_find_value(&env, resp, "users", &users_v);
-  for (int i = 0; i < xmlrpc_array_size(&env, users_v); i++) {
-    xmlrpc_value *current, *v;
-    const char *username;
-
-    xmlrpc_array_read_item(&env, users_v, i, &current);
-    xmlrpc_struct_find_value(&env, current, "username", &v);
-    
-    xmlrpc_read_string(&env, v, &username);
-    GaldrContact *user = g_hash_table_lookup(ga->contacts, username);
-    if (user) {
-      if (xmlrpc_array_size(&env, users_v) <=2 ) {
-        user->session_id = g_strdup(id); // only do this if this user is the only user (besides us)
-      }
-
-      contacts = g_list_append(contacts, user);
+  GaldrSession *decoded = resp;
+
+  // only set the contact's session if they are the
+  //  only user (besides us)
+  if (decoded->num_users <= 2) {
+    for (GList *it = decoded->users; it != NULL; it = it->next) {
+      GaldrContact *user = it->data;
+      g_free((char*)user->session_id);
+      user->session_id = g_strdup(decoded->id);
     }
-
-    free((char*)username);
-    xmlrpc_DECREF(v);
-    xmlrpc_DECREF(current);
   }
-  xmlrpc_DECREF(users_v);
-  
 
   // look up the session id
   purple_debug_info("helplightning", "lookup up sessions\n");
-  GaldrSession *session = g_hash_table_lookup(ga->sessions, id);
+  GaldrSession *session = g_hash_table_lookup(ga->sessions, decoded->id);
   if (!session) {
-    purple_debug_info("helplightning", "creating a new session with id %s\n", id);
-    session = g_new0(GaldrSession, 1);
-    session->id = g_strdup(id);
-    session->users = contacts;
-    g_hash_table_insert(ga->sessions, g_strdup(id), session);
+    purple_debug_info("helplightning", "creating a new session with id %s\n", decoded->id);
+    g_hash_table_insert(ga->sessions, g_strdup(decoded->id), decoded);
+
+    return libgaldr_make_deferred_response((char*)decoded->token);
   }
-  session->token = g_strdup(token);
 
-  free((char*)id);
-  free((char*)token);
+  // we already have this session, just update its token
+  g_free((char*)session->token);
+  session->token = decoded->token;
+
+  g_free((char*)decoded->id);
+  g_list_free(decoded->users);
+  g_free(decoded);
   
-  return libgaldr_make_deferred_response((char*)token);
+  return libgaldr_make_deferred_response((char*)session->token);
 }
 
-DeferredResponse *libgaldr_session_create_with_err(BallyhooAccount *ba,
-                                                   gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_session_create_with_err(BallyhooAccount *ba,
+                                                  gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning->", "galdr_session_create_with_err!!\n");
 
   // keep propagating errors
   return libgaldr_make_deferred_fault(fault);
 }
+
+static gpointer libgaldr_session_decoder_begin(BallyhooAccount *ba)
+{
+  SessionDecoder *sd = g_new0(SessionDecoder, 1);
+  sd->ga = ba->parent;
+  sd->session = g_new0(GaldrSession, 1);
+
+  return sd;
+}
+
+static gboolean libgaldr_session_decoder_event(const BallyhooXMLEvent *ev,
+                                               gpointer user_data)
+{
+  SessionDecoder *sd = user_data;
+  GaldrSession *session = sd->session;
+
+  if (ev->depth == 0) {
+    if (ev->type != BXML_EVENT_STRUCT_BEGIN && ev->type != BXML_EVENT_STRUCT_END) {
+      purple_debug_info("helplightning", "Invalid response to make_session_with\n");
+      sd->invalid = TRUE;
+      return FALSE;
+    }
+  } else if (ev->depth == 1) {
+    if (libballyhoo_xml_event_is(ev, 1, "id") && !session->id) {
+      session->id = libballyhoo_xml_event_dup(ev);
+    } else if (libballyhoo_xml_event_is(ev, 1, "token") && !session->token) {
+      session->token = libballyhoo_xml_event_dup(ev);
+    } else if (ev->type == BXML_EVENT_ARRAY_BEGIN && libballyhoo_xml_event_is(ev, 1, "users")) {
+      sd->in_users = TRUE;
+    } else if (ev->type == BXML_EVENT_ARRAY_END) {
+      sd->in_users = FALSE;
+    }
+  } else if (sd->in_users) {
+    if (ev->depth == 2 && ev->type == BXML_EVENT_STRUCT_BEGIN) {
+      session->num_users++;
+    } else if (ev->type == BXML_EVENT_SCALAR && libballyhoo_xml_event_is(ev, 3, "username")) {
+      GaldrContact *user = g_hash_table_lookup(sd->ga->contacts, ev->text);
+      if (user) {
+        session->users = g_list_prepend(session->users, user);
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean libgaldr_session_decoder_finish(gpointer state, gboolean success,
+                                                gpointer *result)
+{
+  SessionDecoder *sd = state;
+  GaldrSession *session = sd->session;
+  success = success && !sd->invalid && session->id;
+  g_free(sd);
+
+  if (!success) {
+    g_free((char*)session->id);
+    g_free((char*)session->token);
+    g_list_free(session->users);
+    g_free(session);
+    return FALSE;
+  }
+
+  session->users = g_list_reverse(session->users);
+  *result = session;
+
+  return TRUE;
+}
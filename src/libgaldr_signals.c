@@ -17,117 +17,81 @@
  */
 
 #include "libgaldr_signals.h"
+#include "libballyhoo_pool.h"
 #include <glib.h>
 #include <debug.h>
-/* must include this to use G_VA_COPY */
-#include <string.h>
 
-GaldrMarshal *galdr_marshal_build(GaldrCallback cb,
-                                  GaldrMarshalFunc marshal,
-                                  int argc,
-                                  ...)
-{
-  GaldrMarshal *m = g_new0(GaldrMarshal, 1);
-  m->cb = cb;
-  m->marshal = marshal;
-
-  va_list args;
-  va_start(args, argc);
+static BallyhooPool closure_pool = LIBBALLYHOO_POOL_INIT(GaldrClosure, 16);
 
-  for (int i = 0; i < argc; i++) {
-    m->args = g_list_append(m->args, va_arg(args, void*));
+static void galdr_closure_set_arg(GaldrClosure *c, int i,
+                                  gpointer arg, GaldrArgPolicy policy)
+{
+  c->policies[i] = policy;
+  if (policy == GALDR_ARG_STRING) {
+    c->args[i] = g_strdup(arg);
+  } else {
+    c->args[i] = arg;
   }
-
-  va_end(args);
-
-  return m;
 }
 
-gpointer galdr_marshal_emit(GaldrMarshal *m)
+GaldrClosure *galdr_closure_new2(GaldrClosureFunc2 func,
+                                 gpointer arg1, GaldrArgPolicy policy1,
+                                 gpointer arg2, GaldrArgPolicy policy2)
 {
-  gpointer return_val;
-  purple_debug_info("helplightning", "galdr_marshal_emit %p\n", m);
-  m->marshal(m->cb, m->args, &return_val);
+  GaldrClosure *c = libballyhoo_pool_alloc0(&closure_pool);
+  c->argc = 2;
+  c->func.f2 = func;
+  galdr_closure_set_arg(c, 0, arg1, policy1);
+  galdr_closure_set_arg(c, 1, arg2, policy2);
 
-  return return_val;
+  return c;
 }
 
-void galdr_marshal_POINTER__POINTER_POINTER(
-                                            GaldrCallback cb,
-                                            GList *args,
-                                            void **return_val
-                                            )
+GaldrClosure *galdr_closure_new3(GaldrClosureFunc3 func,
+                                 gpointer arg1, GaldrArgPolicy policy1,
+                                 gpointer arg2, GaldrArgPolicy policy2,
+                                 gpointer arg3, GaldrArgPolicy policy3)
 {
-  purple_debug_info("helplightning", "galdr_marshal_POINTER__POINTER_POINTER\n");
-
-  if (g_list_length(args) != 2) {
-    purple_debug_error("helplightning", "galdr_marshal_POINTER__POINTER_POINTER: wrong number of arguments\n");
-    return;
-  }
-
-  GList *it = g_list_first(args);
-  gpointer ret_val;
-  void *arg1 = it->data;
-  purple_debug_info("helplightning", "arg1=%p\n", arg1);
-  it = it->next;
-  void *arg2 = it->data;
-  purple_debug_info("helplightning", "arg2=%p\n", arg2);
-  purple_debug_info("helplightning", "arg2=%s\n", (char*)arg2);
-
-  ret_val = ((gpointer(*)(void*, void*))cb)(arg1, arg2);
-
-  if (ret_val != NULL)
-    *return_val = ret_val;
+  GaldrClosure *c = libballyhoo_pool_alloc0(&closure_pool);
+  c->argc = 3;
+  c->func.f3 = func;
+  galdr_closure_set_arg(c, 0, arg1, policy1);
+  galdr_closure_set_arg(c, 1, arg2, policy2);
+  galdr_closure_set_arg(c, 2, arg3, policy3);
+
+  return c;
 }
 
-void galdr_marshal_POINTER__POINTER_POINTER_POINTER(
-                                                    GaldrCallback cb,
-                                                    GList *args,
-                                                    void **return_val
-                                                    )
+gpointer galdr_closure_invoke(GaldrClosure *c)
 {
-  if (g_list_length(args) != 3) {
-    purple_debug_error("helplightning", "galdr_marshal_POINTER__POINTER_POINTER_POINTER: wrong number of arguments\n");
-    return;
+  purple_debug_info("helplightning", "galdr_closure_invoke %p (retry %d)\n",
+                    c, c->retries + 1);
+  c->retries++;
+
+  if (c->argc == 2) {
+    return c->func.f2(c->args[0], c->args[1]);
+  } else {
+    return c->func.f3(c->args[0], c->args[1], c->args[2]);
   }
+}
 
-  GList *it = g_list_first(args);
-  gpointer ret_val;
-  void *arg1 = it->data;
-  it = it->next;
-  void *arg2 = it->data;
-  it = it->next;
-  void *arg3 = it->data;
-
-  ret_val = ((gpointer(*)(void*, void*, void*))cb)(arg1, arg2, arg3);
-
-  if (ret_val != NULL)
-    *return_val = ret_val;
+gboolean galdr_closure_can_retry(GaldrClosure *c)
+{
+  return c->retries < GALDR_CLOSURE_MAX_RETRIES;
 }
 
-void galdr_marshal_POINTER__POINTER_POINTER_POINTER_POINTER(
-                                                            GaldrCallback cb,
-                                                            GList *args,
-                                                            void **return_val
-                                                            )
+void galdr_closure_free(GaldrClosure *c)
 {
-  if (g_list_length(args) != 4) {
-    purple_debug_error("helplightning", "galdr_marshal_POINTER__POINTER_POINTER_POINTER_POINTER: wrong number of arguments\n");
-    return;
+  for (int i = 0; i < c->argc; i++) {
+    if (c->policies[i] == GALDR_ARG_STRING) {
+      g_free(c->args[i]);
+    }
   }
 
-  GList *it = g_list_first(args);
-  gpointer ret_val;
-  void *arg1 = it->data;
-  it = it->next;
-  void *arg2 = it->data;
-  it = it->next;
-  void *arg3 = it->data;
-  it = it->next;
-  void *arg4 = it->data;
-
-  ret_val = ((gpointer(*)(void*, void*, void*, void*))cb)(arg1, arg2, arg3, arg4);
+  libballyhoo_pool_free(&closure_pool, c);
+}
 
-  if (ret_val != NULL)
-    *return_val = ret_val;
+void galdr_closure_pool_drain(void)
+{
+  libballyhoo_pool_drain(&closure_pool);
 }
@@ -19,44 +19,72 @@
 #ifndef _LIBGALDR_SIGNALS_H_
 #define _LIBGALDR_SIGNALS_H_
 
-#include <stdlib.h>
-#include <stdarg.h>
 #include <glib.h>
 
-#define GALDR_CALLBACK(func) ((GaldrCallback)func)
-
-typedef void (*GaldrCallback)(void);
-typedef void (*GaldrMarshalFunc)(GaldrCallback cb, GList *args,
-                                 void **return_value);
-
-typedef struct _GaldrMarshal {
-  GaldrCallback cb;
-  GaldrMarshalFunc marshal;
-  GList *args;
-} GaldrMarshal;
-
-
-GaldrMarshal *galdr_marshal_build(GaldrCallback cb,
-                                  GaldrMarshalFunc marshal,
-                                  int argc,
-                                  ...);
-
-gpointer galdr_marshal_emit(GaldrMarshal *m);
-
-void galdr_marshal_POINTER__POINTER_POINTER(
-                                            GaldrCallback cb,
-                                            GList *args,
-                                            void **return_val
-                                            );
-void galdr_marshal_POINTER__POINTER_POINTER_POINTER(
-                                                    GaldrCallback cb,
-                                                    GList *args,
-                                                    void **return_val
-                                                    );
-void galdr_marshal_POINTER__POINTER_POINTER_POINTER_POINTER(
-                                                            GaldrCallback cb,
-                                                            GList *args,
-                                                            void **return_val
-                                                            );
+#define GALDR_CLOSURE_MAX_ARGS 3
+#define GALDR_CLOSURE_MAX_RETRIES 2 // calls after the first one
+
+#define GALDR_CLOSURE_FUNC2(func) ((GaldrClosureFunc2)func)
+#define GALDR_CLOSURE_FUNC3(func) ((GaldrClosureFunc3)func)
+
+typedef gpointer (*GaldrClosureFunc2)(gpointer arg1, gpointer arg2);
+typedef gpointer (*GaldrClosureFunc3)(gpointer arg1, gpointer arg2, gpointer arg3);
+
+/* How a closure holds on to an argument */
+typedef enum {
+  GALDR_ARG_BORROW, /* outlives the closure, kept as is */
+  GALDR_ARG_STRING  /* copied with g_strdup, freed with the closure */
+} GaldrArgPolicy;
+
+/**
+ * A call to make again with the same arguments, so an
+ *  operation can be retried after a token refresh.
+ *
+ * Closures come from a pool and keep their arguments
+ *  inline, so building one doesn't touch the heap
+ *  once the pool is warm.
+ */
+typedef struct _GaldrClosure {
+  int argc;
+  union {
+    GaldrClosureFunc2 f2;
+    GaldrClosureFunc3 f3;
+  } func;
+  gpointer args[GALDR_CLOSURE_MAX_ARGS];
+  GaldrArgPolicy policies[GALDR_CLOSURE_MAX_ARGS];
+  int retries;
+} GaldrClosure;
+
+GaldrClosure *galdr_closure_new2(GaldrClosureFunc2 func,
+                                 gpointer arg1, GaldrArgPolicy policy1,
+                                 gpointer arg2, GaldrArgPolicy policy2);
+GaldrClosure *galdr_closure_new3(GaldrClosureFunc3 func,
+                                 gpointer arg1, GaldrArgPolicy policy1,
+                                 gpointer arg2, GaldrArgPolicy policy2,
+                                 gpointer arg3, GaldrArgPolicy policy3);
+
+/**
+ * Call the function again and return its result. Each
+ *  call counts towards the closure's retries.
+ */
+gpointer galdr_closure_invoke(GaldrClosure *c);
+
+/**
+ * TRUE if the closure can still be invoked without going
+ *  over GALDR_CLOSURE_MAX_RETRIES.
+ */
+gboolean galdr_closure_can_retry(GaldrClosure *c);
+
+/**
+ * Free any arguments the closure copied and give it back
+ *  to the pool.
+ */
+void galdr_closure_free(GaldrClosure *c);
+
+/**
+ * Release the idle closures kept for reuse. Called when
+ *  the plugin is unloaded.
+ */
+void galdr_closure_pool_drain(void);
 
 #endif
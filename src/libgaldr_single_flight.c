@@ -0,0 +1,136 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libgaldr_single_flight.h"
+#include "libballyhoo_deferred.h"
+
+#include <debug.h>
+
+/* a lookup in flight, and the Deferreds waiting on it */
+typedef struct _GaldrFlight {
+  GaldrSingleFlight *sf;
+  char *key;
+  GQueue waiters;
+} GaldrFlight;
+
+static void libgaldr_flight_free(GaldrFlight *f);
+static void libgaldr_flight_drop(GaldrFlight *f);
+static void libgaldr_flight_fire(GaldrFlight *f, BallyhooAccount *ba,
+                                 gboolean success, gpointer result);
+static DeferredResponse libgaldr_flight_cb(BallyhooAccount *ba,
+                                           gpointer resp, gpointer user_data);
+static DeferredResponse libgaldr_flight_err(BallyhooAccount *ba,
+                                            gpointer fault, gpointer user_data);
+
+GaldrSingleFlight *libgaldr_single_flight_new(GaldrFlightFunc func)
+{
+  GaldrSingleFlight *sf = g_new0(GaldrSingleFlight, 1);
+  sf->func = func;
+  // flights are keyed by their own copy of the key
+  sf->flights = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                      (GDestroyNotify)libgaldr_flight_free);
+
+  return sf;
+}
+
+void libgaldr_single_flight_free(GaldrSingleFlight *sf)
+{
+  g_hash_table_destroy(sf->flights);
+  g_free(sf);
+}
+
+Deferred *libgaldr_single_flight_get(GaldrSingleFlight *sf, GaldrAccount *ga,
+                                     const char *key)
+{
+  GaldrFlight *f = g_hash_table_lookup(sf->flights, key);
+
+  if (f) {
+    purple_debug_info("helplightning", "joining lookup of %s\n", key);
+  } else {
+    Deferred *d = sf->func(ga, key);
+    if (!d) {
+      return NULL;
+    }
+
+    f = g_new0(GaldrFlight, 1);
+    f->sf = sf;
+    f->key = g_strdup(key);
+    g_queue_init(&(f->waiters));
+    g_hash_table_insert(sf->flights, f->key, f);
+
+    libballyhoo_deferred_add_callbacks_notify(d, libgaldr_flight_cb,
+                                              libgaldr_flight_err, f,
+                                              (GDestroyNotify)libgaldr_flight_drop);
+  }
+
+  Deferred *w = libballyhoo_deferred_build(0);
+  g_queue_push_tail(&(f->waiters), w);
+
+  return w;
+}
+
+static void libgaldr_flight_free(GaldrFlight *f)
+{
+  Deferred *w;
+  while ((w = g_queue_pop_head(&(f->waiters))) != NULL) {
+    libballyhoo_deferred_free(w);
+  }
+
+  g_free(f->key);
+  g_free(f);
+}
+
+/* the lookup was cancelled, so its waiters never run */
+static void libgaldr_flight_drop(GaldrFlight *f)
+{
+  g_hash_table_remove(f->sf->flights, f->key);
+}
+
+static void libgaldr_flight_fire(GaldrFlight *f, BallyhooAccount *ba,
+                                 gboolean success, gpointer result)
+{
+  // the lookup is done, so anyone asking for the key
+  //  from here on starts a new one
+  g_hash_table_steal(f->sf->flights, f->key);
+
+  Deferred *w;
+  while ((w = g_queue_pop_head(&(f->waiters))) != NULL) {
+    DeferredResponse r = libballyhoo_deferred_run(w, ba, success, result);
+    if (r.type != DEFERRED_DEFERRED) {
+      libballyhoo_deferred_free(w);
+    }
+  }
+
+  libgaldr_flight_free(f);
+}
+
+static DeferredResponse libgaldr_flight_cb(BallyhooAccount *ba,
+                                           gpointer resp, gpointer user_data)
+{
+  libgaldr_flight_fire(user_data, ba, TRUE, resp);
+
+  return libgaldr_make_deferred_response(resp);
+}
+
+static DeferredResponse libgaldr_flight_err(BallyhooAccount *ba,
+                                            gpointer fault, gpointer user_data)
+{
+  libgaldr_flight_fire(user_data, ba, FALSE, fault);
+
+  return libgaldr_make_deferred_fault(fault);
+}
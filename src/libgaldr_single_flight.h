@@ -0,0 +1,67 @@
+/*
+ * Help Lighting Plugin for libpurple/Pidgin
+ * Copyright (c) 2022 Marcus Dillavou <line72@line72.net>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIBGALDR_SINGLE_FLIGHT_H_
+#define _LIBGALDR_SINGLE_FLIGHT_H_
+
+#include "libballyhoo.h"
+#include "libgaldr.h"
+
+#include <glib.h>
+
+/* Starts a lookup of key, returning its Deferred, or
+ *  NULL if it can't be started */
+typedef Deferred *(*GaldrFlightFunc)(GaldrAccount *ga, const char *key);
+
+/**
+ * Coalesces concurrent lookups of the same key, so that
+ *  only one request for it is in flight at a time.
+ *
+ * The lookup must be idempotent. Everyone asking for a key
+ *  while it's in flight shares its result.
+ */
+typedef struct _GaldrSingleFlight {
+  GaldrFlightFunc func;
+  GHashTable *flights; /* key -> GaldrFlight */
+} GaldrSingleFlight;
+
+GaldrSingleFlight *libgaldr_single_flight_new(GaldrFlightFunc func);
+/**
+ * Free sf and the Deferreds still waiting in it, without
+ *  running them. The lookups they wait on must already be
+ *  gone, so call this after libballyhoo_shutdown. A lookup
+ *  that's cancelled frees its waiters the same way.
+ */
+void libgaldr_single_flight_free(GaldrSingleFlight *sf);
+
+/**
+ * Look up key, starting a lookup only if one isn't
+ *  already in flight.
+ *
+ * Each caller gets its own Deferred. Once the lookup
+ *  finishes, those Deferreds run in the order they were
+ *  asked for, with the lookup's result or fault. Like a
+ *  call's Deferred, each one is freed once it has run.
+ *
+ * Returns NULL if the lookup can't be started, in which
+ *  case nothing is left in flight for key.
+ */
+Deferred *libgaldr_single_flight_get(GaldrSingleFlight *sf, GaldrAccount *ga,
+                                     const char *key);
+
+#endif
@@ -20,18 +20,23 @@
 
 #include <debug.h>
 
-DeferredResponse *libgaldr_conn_ping_err(BallyhooAccount *ba,
-                                         gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_conn_ping_err(BallyhooAccount *ba,
+                                        gpointer fault, gpointer user_data);
 
 Deferred *libgaldr_ping(GaldrAccount *acct)
 {
   purple_debug_info("helplightning", "ping...\n");
-  PurpleSslConnection *gsc = acct->ba->gsc;
+
+  // a ping queued behind a backed up socket would just time
+  //  out, and the socket is clearly still being written to
+  if (libballyhoo_is_congested(acct->ba)) {
+    purple_debug_info("helplightning", "skipping ping, output is congested\n");
+    return NULL;
+  }
   
-  // encode a message
-  guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "conn_ping", "()");
+  // the ping never changes, so it's only encoded once
+  guint64 uuid = libballyhoo_send_constant_call(acct->ba, LIBBALLYHOO_PRIORITY_INTERACTIVE,
+                                                "conn_ping");
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(5); // 5 second timeout for pings
@@ -39,17 +44,12 @@ Deferred *libgaldr_ping(GaldrAccount *acct)
 
   libballyhoo_deferred_add_callbacks(d, NULL,
                                      libgaldr_conn_ping_err);
-  
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
 
   return d;
 }
 
-DeferredResponse *libgaldr_conn_ping_err(BallyhooAccount *ba,
-                                         gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_conn_ping_err(BallyhooAccount *ba,
+                                        gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning", "---TIMEOUT during ping\n");
   purple_connection_error_reason(ba->gc,
@@ -22,14 +22,14 @@
 
 Deferred *_libgaldr_get_workspaces(GaldrAccount *acct);
 Deferred *_libgaldr_workspace_switch(GaldrAccount *acct, int workspace_id);
-DeferredResponse *libgaldr_get_workspaces_cb(BallyhooAccount *ba,
-                                             gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_get_workspaces_err(BallyhooAccount *ba,
-                                              gpointer fault, gpointer user_data);
-DeferredResponse *libgaldr_workspace_switch_cb(BallyhooAccount *ba,
-                                               gpointer resp, gpointer user_data);
-DeferredResponse *libgaldr_workspace_switch_err(BallyhooAccount *ba,
-                                                gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_get_workspaces_cb(BallyhooAccount *ba,
+                                            gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_get_workspaces_err(BallyhooAccount *ba,
+                                             gpointer fault, gpointer user_data);
+DeferredResponse libgaldr_workspace_switch_cb(BallyhooAccount *ba,
+                                              gpointer resp, gpointer user_data);
+DeferredResponse libgaldr_workspace_switch_err(BallyhooAccount *ba,
+                                               gpointer fault, gpointer user_data);
 Deferred *libgaldr_get_workspaces(GaldrAccount *acct)
 {
   Deferred *d = _libgaldr_get_workspaces(acct);
@@ -54,18 +54,15 @@ Deferred *_libgaldr_get_workspaces(GaldrAccount *acct)
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "user_get_workspaces", "(s)",
-                                                   acct->primary_token);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "user_get_workspaces", "(s)",
+                                                           acct->primary_token);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
   libballyhoo_add_deferred(acct->ba, uuid, d);
   
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
@@ -76,23 +73,20 @@ Deferred *_libgaldr_workspace_switch(GaldrAccount *acct, int workspace_id)
   
   // encode a message
   guint64 uuid;
-  GList *messages = libballyhoo_encode_method_call(&uuid,
-                                                   "workspace_switch", "(si)",
-                                                   acct->primary_token, workspace_id);
+  BallyhooOutMessage *out = libballyhoo_encode_method_call(&uuid,
+                                                           "workspace_switch", "(si)",
+                                                           acct->primary_token, workspace_id);
 
   // create a deferred
   Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
   libballyhoo_add_deferred(acct->ba, uuid, d);
   
-  libballyhoo_send_chunks(acct->ba, gsc, messages);
-  
-  // !mwd - TODO: clean up chunks
-  g_list_free(messages);
+  libballyhoo_send_message(acct->ba, gsc, out);
 
   return d;
 }
 
-DeferredResponse *libgaldr_get_workspaces_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_get_workspaces_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
 {
   purple_debug_info("helplightning", "got workspaces!\n");
   GaldrAccount *ga = ba->parent;
@@ -178,13 +172,13 @@ DeferredResponse *libgaldr_get_workspaces_cb(BallyhooAccount *ba, gpointer resp,
   return libgaldr_make_deferred_deferred(d);
 }
  
-DeferredResponse *libgaldr_get_workspaces_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_get_workspaces_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
 {
   // keep propagating errors
   return libgaldr_make_deferred_fault(fault);
 }
 
-DeferredResponse *libgaldr_workspace_switch_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
+DeferredResponse libgaldr_workspace_switch_cb(BallyhooAccount *ba, gpointer resp, gpointer user_data)
 {
   GaldrAccount *ga = ba->parent;
   purple_debug_info("helplightning", "galdr_workspace_switch_cb!!\n");
@@ -222,7 +216,7 @@ DeferredResponse *libgaldr_workspace_switch_cb(BallyhooAccount *ba, gpointer res
   return libgaldr_make_deferred_responseb(TRUE);
 }
 
-DeferredResponse *libgaldr_workspace_switch_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
+DeferredResponse libgaldr_workspace_switch_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
 {
   purple_debug_info("helplightning", "galdr_workspace_switch_err!!\n");
   ba->authenticated = FALSE;
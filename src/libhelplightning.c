@@ -35,15 +35,19 @@
 
 PurplePlugin *_helplightning_plugin = NULL;
 
+// the conversation data holding what it has in flight
+#define CONVERSATION_CANCELLABLE "helplightning-cancellable"
+
 void libhelplightning_connected_cb(GaldrAccount *ga);
 void libhelplightning_incoming_message_cb(PurpleConnection *gc, GaldrMessage *message);
 void libhelplightning_conversation_updated_cb(PurpleConversation *conv, PurpleConvUpdateType type,
                                               void *data);
+void libhelplightning_deleting_conversation_cb(PurpleConversation *conv, void *data);
 void libhelplightning_refresh_contacts_cb(GaldrAccount *ga);
-DeferredResponse *libhelplightning_contacts_cb(BallyhooAccount *ba, gpointer resp,
+DeferredResponse libhelplightning_contacts_cb(BallyhooAccount *ba, gpointer resp,
+                                              gpointer user_data);
+DeferredResponse libhelplightning_contacts_err(BallyhooAccount *ba, gpointer fault,
                                                gpointer user_data);
-DeferredResponse *libhelplightning_contacts_err(BallyhooAccount *ba, gpointer fault,
-                                                gpointer user_data);
 
 
 static void libhelplightning_login(PurpleAccount *acct)
@@ -69,6 +73,10 @@ static void libhelplightning_login(PurpleAccount *acct)
   purple_signal_connect(purple_conversations_get_handle(), "conversation-updated",
                         gc->prpl,
                         PURPLE_CALLBACK(libhelplightning_conversation_updated_cb), NULL);
+
+  purple_signal_connect(purple_conversations_get_handle(), "deleting-conversation",
+                        gc->prpl,
+                        PURPLE_CALLBACK(libhelplightning_deleting_conversation_cb), NULL);
   
   libgaldr_connect(ga);
 }
@@ -92,8 +100,8 @@ static void libhelplightning_keep_alive(PurpleConnection *gc) {
   libgaldr_update(ga);
 }
 
-DeferredResponse *libhelplightning_contacts_cb(BallyhooAccount *ba, gpointer resp,
-                                               gpointer user_data)
+DeferredResponse libhelplightning_contacts_cb(BallyhooAccount *ba, gpointer resp,
+                                              gpointer user_data)
 {
   purple_debug_info("helplightning", "got contacts\n");
   GaldrAccount *ga = ba->parent;
@@ -151,8 +159,8 @@ DeferredResponse *libhelplightning_contacts_cb(BallyhooAccount *ba, gpointer res
   return libgaldr_make_deferred_responseb(TRUE);
 }
 
-DeferredResponse *libhelplightning_contacts_err(BallyhooAccount *ba, gpointer fault,
-                                                gpointer user_data)
+DeferredResponse libhelplightning_contacts_err(BallyhooAccount *ba, gpointer fault,
+                                               gpointer user_data)
 {
   purple_debug_info("helplightning", "Error with contacts\n");
 
@@ -251,6 +259,22 @@ void libhelplightning_incoming_message_cb(PurpleConnection *gc, GaldrMessage *me
   }
 }
 
+/**
+ * Work for a conversation that's only worth doing while it's
+ *  open, like read marks, which is cancelled once it's
+ *  closed. Sends aren't added, they always finish.
+ */
+static BallyhooCancellable *libhelplightning_conversation_cancellable(PurpleConversation *conv)
+{
+  BallyhooCancellable *c = purple_conversation_get_data(conv, CONVERSATION_CANCELLABLE);
+  if (!c) {
+    c = libballyhoo_cancellable_new();
+    purple_conversation_set_data(conv, CONVERSATION_CANCELLABLE, c);
+  }
+
+  return c;
+}
+
 void libhelplightning_conversation_updated_cb(PurpleConversation *conv, PurpleConvUpdateType type,
                                               void *data) {
   purple_debug_info("helplightning", "===CONVERSATION UPDATED===\n");
@@ -264,7 +288,8 @@ void libhelplightning_conversation_updated_cb(PurpleConversation *conv, PurpleCo
           // get the associated session
           GaldrSession * session = libgaldr_session_find(ga, session_id);
           if (session) {
-            libgaldr_session_mark_as_read(ga, session);
+            libgaldr_session_mark_as_read(ga, session,
+                                          libhelplightning_conversation_cancellable(conv));
           }
         }
       }
@@ -272,6 +297,25 @@ void libhelplightning_conversation_updated_cb(PurpleConversation *conv, PurpleCo
   }
 }
 
+void libhelplightning_deleting_conversation_cb(PurpleConversation *conv, void *data)
+{
+  BallyhooCancellable *c = purple_conversation_get_data(conv, CONVERSATION_CANCELLABLE);
+  if (!c) {
+    return;
+  }
+  purple_debug_info("helplightning", "===CONVERSATION CLOSED===\n");
+  purple_conversation_set_data(conv, CONVERSATION_CANCELLABLE, NULL);
+
+  // if we're still connected, nobody is waiting on what
+  //  it has in flight anymore. Otherwise it was all
+  //  cancelled when we closed.
+  if (conv->account && conv->account->gc && conv->account->gc->proto_data) {
+    GaldrAccount* ga = (GaldrAccount*)(conv->account->gc->proto_data);
+    libballyhoo_cancellable_cancel(ga->ba, c);
+  }
+  libballyhoo_cancellable_free(c);
+}
+
 void libhelplightning_refresh_contacts_cb(GaldrAccount *ga) {
   purple_debug_info("helplightning", "refresh_contacts\n");
 
@@ -337,7 +381,10 @@ int libhelplightning_send_im(PurpleConnection *gc, const char *who, const char *
   // strip out <br> and replace with new lines
   char* escaped = purple_unescape_html(what);
 
+  // the send keeps its own copy. It isn't cancelled with
+  //  the conversation, so closing the window doesn't drop it.
   Deferred *d = libgaldr_send_im_to(ga, contact, escaped);
+  g_free(escaped);
   // do callbacks?
   
   return 1;
@@ -353,6 +400,16 @@ static gboolean helplightning_load_plugin(PurplePlugin *plugin)
   return TRUE;
 }
 
+static gboolean helplightning_unload_plugin(PurplePlugin *plugin)
+{
+  // every account is gone by now, so give back what
+  //  the pools kept for reuse
+  libballyhoo_deferred_pool_drain();
+  galdr_closure_pool_drain();
+
+  return TRUE;
+}
+
 /*
  * prpl stuff. see prpl.h for more information.
  */
@@ -466,7 +523,7 @@ static PurplePluginInfo info = {
   "https://github.com/line72/helplightning-libpurple",
   
   helplightning_load_plugin, /* load */
-  NULL, /* unload */
+  helplightning_unload_plugin, /* unload */
   NULL, /* destroy */
 
   NULL, /* ui_info */
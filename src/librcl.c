@@ -28,7 +28,6 @@ const int32_t _librcl_timeout_ms = 1000 * 60 * 10; /* 10 minutes */
 
 gpointer librcl_encode(const void *data, size_t length, guint64 uuid,
                        gboolean response, gboolean streamed, size_t *output_size);
-guint64 librcl_generate_uuid();
 
 gpointer librcl_encode_request(const void *data, size_t length, guint64 *uuid, size_t *output_size)
 {
@@ -54,11 +53,11 @@ gpointer librcl_encode_response_streamed(const void *data, size_t length, guint6
   return librcl_encode(data, length, uuid, TRUE, TRUE, output_size);
 }
 
-int librcl_decode(const void *data, size_t length, RCLDecoded *decoded)
+int librcl_decode(const BallyhooSlice *data, RCLDecoded *decoded)
 {
   gboolean response;
-  unsigned char *b = (unsigned char*)data;
-  if (length < 16) {
+  const unsigned char *b = data->data;
+  if (data->length < 16) {
     return 0; // not enough data to parse the header
   }
 
@@ -83,9 +82,7 @@ int librcl_decode(const void *data, size_t length, RCLDecoded *decoded)
   decoded->uuid = uuid;
   decoded->response = response;
   decoded->timeout = timeout;
-  decoded->size = length - 16;
-  decoded->buffer = g_malloc0(decoded->size);
-  memcpy(decoded->buffer, b + 16, decoded->size);
+  decoded->body = libballyhoo_slice_sub(data, 16, data->length - 16);
 
   return 1;
 }
@@ -94,10 +91,24 @@ int librcl_decode(const void *data, size_t length, RCLDecoded *decoded)
 gpointer librcl_encode(const void *data, size_t length, guint64 uuid,
                        gboolean response, gboolean streamed, size_t *output_size)
 {
-  *output_size = 16 + length;
+  *output_size = LIBRCL_HEADER_SIZE + length;
   gpointer buffer = g_malloc0(*output_size);
   unsigned char *b = (unsigned char*)buffer;
 
+  librcl_write_header(b, uuid, response, streamed);
+  b += LIBRCL_HEADER_SIZE;
+
+  // copy the data
+  memcpy(b, data, length);
+
+  return buffer;
+}
+
+void librcl_write_header(void *header, guint64 uuid,
+                         gboolean response, gboolean streamed)
+{
+  unsigned char *b = (unsigned char*)header;
+
   /* See [1] for header references:
    * [1] https://vipaar.atlassian.net/wiki/spaces/DT/pages/54329501/Reliable+Connection+Layer+RCL
    */
@@ -120,12 +131,6 @@ gpointer librcl_encode(const void *data, size_t length, guint64 uuid,
   // 9-16 is 64-bit uuid
   guint64 uuid_be = GUINT64_TO_BE(uuid);
   memcpy(b, &uuid_be, 8);
-  b += 8;
-
-  // copy the data
-  memcpy(b, data, length);
-
-  return buffer;
 }
 
 guint64 librcl_generate_uuid()
@@ -19,14 +19,17 @@
 #ifndef _LIBRCL_H_
 #define _LIBRCL_H_
 
+#include "libballyhoo_slice.h"
+
 #include <glib.h>
 
+#define LIBRCL_HEADER_SIZE 16
+
 typedef struct _RCLDecoded {
   guint64 uuid;
   gboolean response;
   guint timeout;
-  size_t size;
-  gpointer buffer;
+  BallyhooSlice body; /* the payload, pointing into the input */
 } RCLDecoded;
 
 /**
@@ -48,14 +51,27 @@ gpointer librcl_encode_request_streamed(const void *data, size_t length, guint64
 gpointer librcl_encode_response(const void *data, size_t length, guint64 uuid, size_t *output_size);
 gpointer librcl_encode_response_streamed(const void *data, size_t length, guint64 uuid, size_t *output_size);
 
+/* Generate a uuid for a new request */
+guint64 librcl_generate_uuid();
+/**
+ * Write the 16 byte rcl header in front of a payload the
+ *  caller has laid out itself, instead of copying it.
+ */
+void librcl_write_header(void *header, guint64 uuid,
+                         gboolean response, gboolean streamed);
+
 /**
  * Decode an rcl message
  *
+ * No bytes are copied, the decoded body is a slice of
+ *  data sharing its owner. Clear it with
+ *  libballyhoo_slice_clear when finished.
+ *
  * A return status of:
  *  1 = success
  *  0 = not enough data (shouldn't happen with cmf)
  * -1 = error (malformed data)
  */
-int librcl_decode(const void *data, size_t length, RCLDecoded *decoded);
+int librcl_decode(const BallyhooSlice *data, RCLDecoded *decoded);
 
 #endif
@@ -65,6 +65,15 @@ int main(void)
   srunner_add_suite(sr, ballyhoo_message_suite());
   srunner_add_suite(sr, ballyhoo_deflate_suite());
   srunner_add_suite(sr, ballyhoo_xml_suite());
+  srunner_add_suite(sr, ballyhoo_xml_stream_suite());
+  srunner_add_suite(sr, ballyhoo_outmsg_suite());
+  srunner_add_suite(sr, ballyhoo_helo_suite());
+  srunner_add_suite(sr, ballyhoo_sched_suite());
+  srunner_add_suite(sr, ballyhoo_timers_suite());
+  srunner_add_suite(sr, ballyhoo_deferred_suite());
+  srunner_add_suite(sr, ballyhoo_pending_suite());
+  srunner_add_suite(sr, ballyhoo_ringbuf_suite());
+  srunner_add_suite(sr, galdr_single_flight_suite());
 
   libhelplightning_check_init();
 
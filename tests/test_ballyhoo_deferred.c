@@ -0,0 +1,575 @@
+#include "tests.h"
+
+#include "../libballyhoo_deferred.h"
+#include "../libballyhoo_pool.h"
+
+// the order callbacks (upper case) and errbacks (lower
+//  case) ran in, each tagged by its user_data
+static GString *trace = NULL;
+
+static DeferredResponse trace_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result + 1);
+}
+
+static DeferredResponse trace_err(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, g_ascii_tolower(GPOINTER_TO_INT(user_data)));
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result);
+}
+
+static DeferredResponse fault_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+  return libballyhoo_deferred_response(DEFERRED_FAULT, result);
+}
+
+static Deferred *chained = NULL;
+
+static DeferredResponse chain_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+  return libballyhoo_deferred_response(DEFERRED_DEFERRED, chained);
+}
+
+START_TEST(test_ballyhoo_deferred_many_pairs) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  // more pairs than fit inline
+  const char *tags = "ABCDEFGHIJ";
+  for (const char *t = tags; *t; t++) {
+    libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER(*t));
+  }
+  ck_assert(d->pairs != d->inline_pairs);
+
+  DeferredResponse r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_string_equal(tags, trace->str);
+  assert_int_equal(DEFERRED_RESPONSE, r.type);
+  ck_assert(r.result == (gpointer)10);
+  assert_int_equal(0, d->count);
+  ck_assert(d->fired);
+
+  // and a fired Deferred won't run again
+  r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_int_equal(DEFERRED_DEFERRED, r.type);
+  ck_assert(r.result == NULL);
+
+  libballyhoo_deferred_free(d);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_fault) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  // a fault runs the errback of the same pair, then
+  //  goes back to the callbacks from the next one
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, fault_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('C'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('D'));
+
+  DeferredResponse r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_string_equal("ABbCD", trace->str);
+  assert_int_equal(DEFERRED_RESPONSE, r.type);
+  ck_assert(r.result == (gpointer)3);
+
+  libballyhoo_deferred_free(d);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_chain) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  libballyhoo_deferred_add_callbacks_full(d, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_add_callbacks_full(chained, trace_cb, trace_err, GINT_TO_POINTER('C'));
+
+  // the rest of d waits on the chained Deferred
+  DeferredResponse r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_int_equal(DEFERRED_DEFERRED, r.type);
+  ck_assert(r.result == chained);
+  assert_string_equal("A", trace->str);
+
+  r = libballyhoo_deferred_callback(chained, NULL, NULL);
+  assert_string_equal("ACB", trace->str);
+  assert_int_equal(DEFERRED_RESPONSE, r.type);
+  ck_assert(r.result == (gpointer)1);
+
+  // d was freed once it finished, only chained is left
+  libballyhoo_deferred_free(chained);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_chain_fault) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  libballyhoo_deferred_add_callbacks_full(d, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_callback(d, NULL, NULL);
+
+  // a fault in the chained Deferred goes to d's errbacks
+  DeferredResponse r = libballyhoo_deferred_errback(chained, NULL, NULL);
+  assert_string_equal("Ab", trace->str);
+  assert_int_equal(DEFERRED_FAULT, r.type);
+
+  libballyhoo_deferred_free(chained);
+  g_string_free(trace, TRUE);
+}
+
+static DeferredResponse wait_on_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  return libballyhoo_deferred_response(DEFERRED_DEFERRED, user_data);
+}
+
+START_TEST(test_ballyhoo_deferred_chain_deep) {
+  trace = g_string_new(NULL);
+
+  // each Deferred waits on the next, more deeply than the
+  //  frames kept on the stack
+  const int depth = LIBBALLYHOO_CHAIN_DEPTH * 20;
+  Deferred *d[depth];
+  for (int i = 0; i < depth; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+  for (int i = 0; i < depth - 1; i++) {
+    libballyhoo_deferred_add_callbacks_full(d[i], wait_on_cb, NULL, d[i + 1]);
+    libballyhoo_deferred_add_callbacks_full(d[i], trace_cb, NULL, GINT_TO_POINTER('x'));
+
+    DeferredResponse r = libballyhoo_deferred_callback(d[i], NULL, NULL);
+    assert_int_equal(DEFERRED_DEFERRED, r.type);
+  }
+  libballyhoo_deferred_add_callbacks_full(d[depth - 1], trace_cb, NULL, GINT_TO_POINTER('x'));
+
+  // the last one unwinds all of them, innermost first
+  DeferredResponse r = libballyhoo_deferred_callback(d[depth - 1], NULL, NULL);
+  assert_int_equal(depth, (int)trace->len);
+  ck_assert(r.result == (gpointer)1);
+
+  libballyhoo_deferred_free(d[depth - 1]);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_cancel) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('A'));
+
+  // we own d, so it's left for us to free
+  libballyhoo_deferred_cancel(NULL, d);
+  ck_assert(d->cancelled);
+  assert_int_equal(0, d->count);
+
+  DeferredResponse r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_int_equal(DEFERRED_FAULT, r.type);
+  assert_string_equal("", trace->str);
+
+  libballyhoo_deferred_free(d);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_cancel_chain) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  libballyhoo_deferred_add_callbacks_full(d, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_add_callbacks_full(chained, trace_cb, trace_err, GINT_TO_POINTER('C'));
+  libballyhoo_deferred_callback(d, NULL, NULL);
+  ck_assert(d->waiting_on == chained);
+
+  // cancelling d frees it and cancels what it waits on
+  libballyhoo_deferred_cancel(NULL, d);
+  ck_assert(chained->cancelled);
+
+  libballyhoo_deferred_callback(chained, NULL, NULL);
+  assert_string_equal("A", trace->str);
+  libballyhoo_deferred_free(chained);
+
+  // cancelling what d waits on cancels (and frees) d
+  d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_full(d, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_callback(d, NULL, NULL);
+
+  libballyhoo_deferred_cancel(NULL, chained);
+  assert_int_equal(0, chained->count);
+  assert_string_equal("AA", trace->str);
+
+  libballyhoo_deferred_free(chained);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_cancel_shared) {
+  trace = g_string_new(NULL);
+  Deferred *d1 = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  Deferred *d2 = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  libballyhoo_deferred_add_callbacks_full(d1, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d1, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_add_callbacks_full(d2, chain_cb, trace_err, GINT_TO_POINTER('C'));
+  libballyhoo_deferred_add_callbacks_full(d2, trace_cb, trace_err, GINT_TO_POINTER('D'));
+  libballyhoo_deferred_callback(d1, NULL, NULL);
+  libballyhoo_deferred_callback(d2, NULL, NULL);
+
+  // d2 still waits on chained, so it carries on
+  libballyhoo_deferred_cancel(NULL, d1);
+  ck_assert(!chained->cancelled);
+
+  libballyhoo_deferred_callback(chained, NULL, NULL);
+  assert_string_equal("ACD", trace->str);
+
+  libballyhoo_deferred_free(chained);
+  g_string_free(trace, TRUE);
+}
+
+static DeferredResponse cancel_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, 'X');
+  libballyhoo_deferred_cancel(NULL, user_data);
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result);
+}
+
+START_TEST(test_ballyhoo_deferred_cancel_running) {
+  trace = g_string_new(NULL);
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(d, cancel_cb, NULL, d);
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('B'));
+
+  // the rest of the chain is dropped once it's cancelled
+  DeferredResponse r = libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_int_equal(DEFERRED_FAULT, r.type);
+  assert_string_equal("AX", trace->str);
+  ck_assert(!d->is_firing);
+
+  libballyhoo_deferred_free(d);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_cancellable) {
+  BallyhooCancellable *c = libballyhoo_cancellable_new();
+  Deferred *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+    libballyhoo_cancellable_add(c, d[i]);
+  }
+  assert_int_equal(3, g_queue_get_length(&c->deferreds));
+
+  // a freed Deferred leaves it
+  libballyhoo_deferred_free(d[1]);
+  assert_int_equal(2, g_queue_get_length(&c->deferreds));
+
+  libballyhoo_cancellable_cancel(NULL, c);
+  ck_assert(d[0]->cancelled && d[2]->cancelled);
+  ck_assert(d[0]->cancellable == NULL);
+  ck_assert(g_queue_is_empty(&c->deferreds));
+
+  // and it can be used again
+  Deferred *again = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_cancellable_add(c, again);
+  libballyhoo_cancellable_free(c);
+  ck_assert(again->cancellable == NULL);
+  ck_assert(!again->cancelled);
+
+  libballyhoo_deferred_free(again);
+  libballyhoo_deferred_free(d[0]);
+  libballyhoo_deferred_free(d[2]);
+}
+
+static void destroy_tag(gpointer user_data)
+{
+  g_string_append_c(trace, '-');
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+}
+
+START_TEST(test_ballyhoo_deferred_cancel_destroy) {
+  trace = g_string_new(NULL);
+
+  // a pair that's skipped frees its user_data
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_notify(d, trace_cb, NULL, GINT_TO_POINTER('A'), destroy_tag);
+  libballyhoo_deferred_add_callbacks_notify(d, NULL, trace_err, GINT_TO_POINTER('B'), destroy_tag);
+  libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_string_equal("A-B", trace->str);
+  libballyhoo_deferred_free(d);
+
+  // but not one whose callback faulted, it already had it
+  g_string_truncate(trace, 0);
+  d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_notify(d, fault_cb, NULL, GINT_TO_POINTER('C'), destroy_tag);
+  libballyhoo_deferred_callback(d, NULL, NULL);
+  assert_string_equal("C", trace->str);
+  libballyhoo_deferred_free(d);
+
+  // cancelling drops the pairs
+  g_string_truncate(trace, 0);
+  d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_notify(d, trace_cb, trace_err, GINT_TO_POINTER('D'), destroy_tag);
+  libballyhoo_deferred_add_callbacks_full(d, trace_cb, trace_err, GINT_TO_POINTER('E'));
+  libballyhoo_deferred_cancel(NULL, d);
+  assert_string_equal("-D", trace->str);
+  libballyhoo_deferred_free(d);
+  assert_string_equal("-D", trace->str);
+
+  // and so does freeing a Deferred that never ran
+  d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  libballyhoo_deferred_add_callbacks_notify(d, trace_cb, trace_err, GINT_TO_POINTER('F'), destroy_tag);
+  libballyhoo_deferred_free(d);
+  assert_string_equal("-D-F", trace->str);
+
+  g_string_free(trace, TRUE);
+}
+
+static DeferredResponse gather_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  DeferredListResult *r = result;
+  g_string_append_c(trace, 'L');
+  for (int i = 0; i < r->count; i++) {
+    g_string_append_c(trace, GPOINTER_TO_INT(r->results[i]));
+  }
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, NULL);
+}
+
+static DeferredResponse list_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
+{
+  g_string_append_c(trace, 'l');
+  return libballyhoo_deferred_response(DEFERRED_FAULT, fault);
+}
+
+START_TEST(test_ballyhoo_deferred_list_gather) {
+  trace = g_string_new(NULL);
+  Deferred *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+
+  Deferred *list = libballyhoo_deferred_list(d, 3, TRUE, NULL);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  // the Deferreds keep their own results
+  libballyhoo_deferred_add_callbacks_full(d[0], trace_cb, trace_err, GINT_TO_POINTER('A'));
+
+  // answered out of order, the results stay in order
+  libballyhoo_deferred_callback(d[2], NULL, GINT_TO_POINTER('z'));
+  libballyhoo_deferred_callback(d[1], NULL, GINT_TO_POINTER('y'));
+  assert_string_equal("", trace->str);
+  DeferredResponse r = libballyhoo_deferred_callback(d[0], NULL, GINT_TO_POINTER('x'));
+  assert_string_equal("LxyzA", trace->str);
+  ck_assert(r.result == GINT_TO_POINTER('x' + 1));
+
+  for (int i = 0; i < 3; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_list_fault) {
+  trace = g_string_new(NULL);
+  Deferred *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+
+  Deferred *list = libballyhoo_deferred_list(d, 3, FALSE, NULL);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+
+  // the first fault fails the list right away, and the rest
+  //  don't fire it again
+  libballyhoo_deferred_callback(d[0], NULL, NULL);
+  DeferredResponse r = libballyhoo_deferred_errback(d[1], NULL, NULL);
+  assert_int_equal(DEFERRED_FAULT, r.type);
+  assert_string_equal("l", trace->str);
+  libballyhoo_deferred_callback(d[2], NULL, NULL);
+  assert_string_equal("l", trace->str);
+
+  for (int i = 0; i < 3; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_list_destroy) {
+  trace = g_string_new(NULL);
+  Deferred *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+
+  // a list that fails frees the results it was given, and
+  //  the ones that come after
+  Deferred *list = libballyhoo_deferred_list(d, 3, TRUE, destroy_tag);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  libballyhoo_deferred_callback(d[0], NULL, GINT_TO_POINTER('x'));
+  libballyhoo_deferred_errback(d[1], NULL, NULL);
+  assert_string_equal("-xl", trace->str);
+  libballyhoo_deferred_callback(d[2], NULL, GINT_TO_POINTER('z'));
+  assert_string_equal("-xl-z", trace->str);
+
+  for (int i = 0; i < 3; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+
+  // and so does a cancelled one
+  g_string_truncate(trace, 0);
+  for (int i = 0; i < 2; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+  list = libballyhoo_deferred_list(d, 2, TRUE, destroy_tag);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  libballyhoo_deferred_callback(d[0], NULL, GINT_TO_POINTER('x'));
+  libballyhoo_deferred_cancel(NULL, list);
+  assert_string_equal("-x", trace->str);
+  ck_assert(d[1]->cancelled);
+
+  // one that succeeds hands them over
+  g_string_truncate(trace, 0);
+  for (int i = 0; i < 2; i++) {
+    libballyhoo_deferred_free(d[i]);
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+  list = libballyhoo_deferred_list(d, 2, TRUE, destroy_tag);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  libballyhoo_deferred_callback(d[0], NULL, GINT_TO_POINTER('x'));
+  libballyhoo_deferred_callback(d[1], NULL, GINT_TO_POINTER('y'));
+  assert_string_equal("Lxy", trace->str);
+
+  for (int i = 0; i < 2; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_list_cancel) {
+  trace = g_string_new(NULL);
+  Deferred *d[3];
+  for (int i = 0; i < 3; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+
+  // cancelling one of them cancels the list, which cancels
+  //  the rest
+  Deferred *list = libballyhoo_deferred_list(d, 3, TRUE, NULL);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  libballyhoo_deferred_callback(d[0], NULL, NULL);
+  libballyhoo_deferred_cancel(NULL, d[1]);
+  ck_assert(d[2]->cancelled);
+  assert_int_equal(0, d[2]->count);
+  assert_string_equal("", trace->str);
+
+  for (int i = 0; i < 3; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+
+  // cancelling the list leaves one something else waits on
+  for (int i = 0; i < 2; i++) {
+    d[i] = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  }
+  Deferred *waiting = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  chained = d[1];
+  libballyhoo_deferred_add_callbacks_full(waiting, chain_cb, trace_err, GINT_TO_POINTER('A'));
+  libballyhoo_deferred_add_callbacks_full(waiting, trace_cb, trace_err, GINT_TO_POINTER('B'));
+  libballyhoo_deferred_callback(waiting, NULL, NULL);
+
+  list = libballyhoo_deferred_list(d, 2, TRUE, NULL);
+  libballyhoo_deferred_add_callbacks(list, gather_cb, list_err);
+  libballyhoo_deferred_cancel(NULL, list);
+  ck_assert(d[0]->cancelled);
+  ck_assert(!d[1]->cancelled);
+
+  libballyhoo_deferred_callback(d[1], NULL, NULL);
+  assert_string_equal("AB", trace->str);
+
+  for (int i = 0; i < 2; i++) {
+    libballyhoo_deferred_free(d[i]);
+  }
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_ballyhoo_deferred_recycle) {
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  for (int i = 0; i < 8; i++) {
+    libballyhoo_deferred_add_callbacks(d, trace_cb, trace_err);
+  }
+  libballyhoo_deferred_free(d);
+
+  // a recycled Deferred comes back empty, with its pairs inline
+  Deferred *again = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  ck_assert(again == d);
+  ck_assert(again->pairs == again->inline_pairs);
+  assert_int_equal(0, again->count);
+  ck_assert(!again->fired);
+
+  libballyhoo_deferred_free(again);
+}
+
+START_TEST(test_ballyhoo_pool_max_idle) {
+  BallyhooPool pool = LIBBALLYHOO_POOL_INIT(guint64[4], 2);
+
+  guint64 *objs[3];
+  for (int i = 0; i < 3; i++) {
+    objs[i] = libballyhoo_pool_alloc0(&pool);
+    objs[i][3] = 42;
+  }
+
+  // only two are kept, the last one freed comes back first
+  for (int i = 0; i < 3; i++) {
+    libballyhoo_pool_free(&pool, objs[i]);
+  }
+  assert_int_equal(2, pool.idle);
+
+  guint64 *obj = libballyhoo_pool_alloc0(&pool);
+  ck_assert(obj == objs[1]);
+  ck_assert(obj[0] == 0 && obj[3] == 0);
+  assert_int_equal(1, pool.idle);
+  libballyhoo_pool_free(&pool, obj);
+
+  libballyhoo_pool_drain(&pool);
+  assert_int_equal(0, pool.idle);
+  ck_assert(pool.free_list == NULL);
+}
+
+Suite *ballyhoo_deferred_suite(void) {
+  Suite *s = suite_create("BALLYHOO_deferred Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Callbacks");
+  tcase_add_test(tc, test_ballyhoo_deferred_many_pairs);
+  tcase_add_test(tc, test_ballyhoo_deferred_fault);
+  tcase_add_test(tc, test_ballyhoo_deferred_chain);
+  tcase_add_test(tc, test_ballyhoo_deferred_chain_fault);
+  tcase_add_test(tc, test_ballyhoo_deferred_chain_deep);
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("Cancel");
+  tcase_add_test(tc, test_ballyhoo_deferred_cancel);
+  tcase_add_test(tc, test_ballyhoo_deferred_cancel_chain);
+  tcase_add_test(tc, test_ballyhoo_deferred_cancel_shared);
+  tcase_add_test(tc, test_ballyhoo_deferred_cancel_running);
+  tcase_add_test(tc, test_ballyhoo_cancellable);
+  tcase_add_test(tc, test_ballyhoo_deferred_cancel_destroy);
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("List");
+  tcase_add_test(tc, test_ballyhoo_deferred_list_gather);
+  tcase_add_test(tc, test_ballyhoo_deferred_list_fault);
+  tcase_add_test(tc, test_ballyhoo_deferred_list_destroy);
+  tcase_add_test(tc, test_ballyhoo_deferred_list_cancel);
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("Pool");
+  tcase_add_test(tc, test_ballyhoo_deferred_recycle);
+  tcase_add_test(tc, test_ballyhoo_pool_max_idle);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
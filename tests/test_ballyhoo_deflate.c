@@ -3,6 +3,7 @@
 #include "../libballyhoo_deflate.h"
 
 #include <stdio.h>
+#include <string.h>
 
 START_TEST(test_ballyhoo_deflate_decompress) {
   char in[4096];
@@ -26,12 +27,123 @@ START_TEST(test_ballyhoo_deflate_decompress) {
   ck_assert(output_length == 961);
 }
 
+START_TEST(test_ballyhoo_deflate_inflater) {
+  char in[4096];
+  FILE *f = fopen("message.bin", "rb");
+  size_t r = fread(in, 1, 4096, f);
+  fclose(f);
+  ck_assert(r == 680);
+
+  char *body = in + 8 + 16 + 65;
+  size_t size = 680 - 8 - 16 - 65;
+
+  size_t expected_length;
+  gpointer expected = libballyhoo_deflate_decompress(body, size, &expected_length);
+  ck_assert(expected != NULL);
+
+  // the same stream is reused, fed in different sized
+  //  pieces, and starting from a tiny output buffer
+  BallyhooInflater *i = libballyhoo_inflater_new();
+  size_t pieces[] = { 1, 7, 100, 1024 };
+  for (int p = 0; p < 4; p++) {
+    libballyhoo_inflater_reset(i, 0);
+
+    int ret = 0;
+    for (size_t offset = 0; offset < size; offset += pieces[p]) {
+      ck_assert(ret == 0);
+      ret = libballyhoo_inflater_feed(i, body + offset, MIN(pieces[p], size - offset));
+    }
+    assert_int_equal(1, ret);
+
+    size_t length;
+    gpointer output = libballyhoo_inflater_steal(i, &length);
+    ck_assert(length == expected_length);
+    ck_assert(memcmp(output, expected, length) == 0);
+    g_free(output);
+  }
+
+  // garbage is an error, until the next reset
+  libballyhoo_inflater_reset(i, 0);
+  assert_int_equal(-1, libballyhoo_inflater_feed(i, "garbage!", 8));
+  assert_int_equal(-1, libballyhoo_inflater_feed(i, body, size));
+  libballyhoo_inflater_reset(i, 0);
+  assert_int_equal(1, libballyhoo_inflater_feed(i, body, size));
+
+  libballyhoo_inflater_free(i);
+  g_free(expected);
+}
+
+START_TEST(test_ballyhoo_deflate_compress) {
+  GString *xml = g_string_new("<?xml version=\"1.0\" encoding=\"UTF-8\"?><methodCall><params>");
+  for (int i = 0; i < 50; i++) {
+    g_string_append_printf(xml, "<param><value><i4>%d</i4></value></param>", i);
+  }
+  g_string_append(xml, "</params></methodCall>");
+
+  // compressed onto the end of what's already there
+  GString *out = g_string_new("head");
+  ck_assert(libballyhoo_deflate_compress(xml->str, xml->len, out, FALSE));
+  ck_assert(out->len < xml->len);
+  ck_assert(memcmp(out->str, "head", 4) == 0);
+
+  size_t output_length;
+  gpointer back = libballyhoo_deflate_decompress(out->str + 4, out->len - 4, &output_length);
+  ck_assert(back != NULL);
+  ck_assert(output_length == xml->len);
+  ck_assert(memcmp(back, xml->str, xml->len) == 0);
+  g_free(back);
+
+  // too short to get any smaller
+  g_string_truncate(out, 4);
+  ck_assert(!libballyhoo_deflate_compress("<a/>", 4, out, FALSE));
+  ck_assert(out->len == 4);
+
+  g_string_free(out, TRUE);
+  g_string_free(xml, TRUE);
+}
+
+START_TEST(test_ballyhoo_deflate_dictionary) {
+  const char *xml =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n<methodCall>\r\n"
+    "<methodName>session_send_message</methodName>\r\n<params>\r\n"
+    "<param><value><string>abc</string></value></param>\r\n"
+    "<param><value><string>hi</string></value></param>\r\n"
+    "</params>\r\n</methodCall>\r\n";
+  size_t length = strlen(xml);
+
+  GString *plain = g_string_new(NULL);
+  GString *preset = g_string_new(NULL);
+  ck_assert(libballyhoo_deflate_compress(xml, length, plain, FALSE));
+  ck_assert(libballyhoo_deflate_compress(xml, length, preset, TRUE));
+
+  // the boilerplate comes from the dictionary
+  ck_assert(preset->len < plain->len / 2);
+
+  // and the inflater knows to use it
+  size_t output_length;
+  gpointer back = libballyhoo_deflate_decompress(preset->str, preset->len, &output_length);
+  ck_assert(back != NULL);
+  ck_assert(output_length == length);
+  ck_assert(memcmp(back, xml, length) == 0);
+  g_free(back);
+
+  // a dictionary we don't know is still an error
+  preset->str[2] ^= 0xff;
+  ck_assert(libballyhoo_deflate_decompress(preset->str, preset->len, &output_length) == NULL);
+
+  g_string_free(plain, TRUE);
+  g_string_free(preset, TRUE);
+}
+
 Suite *ballyhoo_deflate_suite(void) {
   Suite *s = suite_create("BALLYHOO_deflate Suite");
   TCase *tc = NULL;
 
   tc = tcase_create("Decode");
   tcase_add_test(tc, test_ballyhoo_deflate_decompress);
+  tcase_add_test(tc, test_ballyhoo_deflate_inflater);
+  tcase_add_test(tc, test_ballyhoo_deflate_compress);
+  tcase_add_test(tc, test_ballyhoo_deflate_dictionary);
   suite_add_tcase(s, tc);
 
   return s;
@@ -0,0 +1,91 @@
+#include "tests.h"
+
+#include "../libballyhoo_helo.h"
+
+#include <string.h>
+
+START_TEST(test_ballyhoo_helo_preamble) {
+  GString *p = libballyhoo_helo_preamble("401", "425", "Encoding: text\n");
+
+  const char expected[] = "BALLYHOO\0" "401\0" "425\0" "Encoding: text\nREADY";
+  ck_assert(p->len == sizeof(expected));
+  ck_assert(memcmp(p->str, expected, sizeof(expected)) == 0);
+
+  g_string_free(p, TRUE);
+}
+
+START_TEST(test_ballyhoo_helo_feed) {
+  const char server[] = "BALLYHOO\0" "401\0" "OK\0"
+    "Encoding: text, deflate\nX-Server:  ballyhoo\r\nREADY\0" "\x20\x00";
+  size_t consumed;
+
+  // feed it a byte at a time, like a slow connection
+  BallyhooHelo *h = libballyhoo_helo_new();
+  size_t offset = 0;
+  int ret = 0;
+  for (size_t i = 1; i <= sizeof(server) - 1 && ret == 0; i++) {
+    ret = libballyhoo_helo_feed(h, server + offset, i - offset, &consumed);
+    offset += consumed;
+  }
+  assert_int_equal(1, ret);
+  // the first cmf bytes are left alone
+  ck_assert(offset == sizeof(server) - 1 - 2);
+
+  ck_assert(h->state == BALLYHOO_HELO_DONE);
+  assert_string_equal("401", h->protocol);
+  assert_string_equal("text, deflate", libballyhoo_helo_header(h, "encoding"));
+  assert_string_equal("ballyhoo", libballyhoo_helo_header(h, "X-Server"));
+  ck_assert(libballyhoo_helo_header(h, "ready") == NULL);
+  ck_assert(libballyhoo_helo_header_has(h, "Encoding", "deflate"));
+  ck_assert(libballyhoo_helo_header_has(h, "encoding", "TEXT"));
+  ck_assert(!libballyhoo_helo_header_has(h, "encoding", "gzip"));
+  ck_assert(!libballyhoo_helo_header_has(h, "x-missing", "deflate"));
+
+  libballyhoo_helo_free(h);
+
+  // all at once
+  h = libballyhoo_helo_new();
+  assert_int_equal(1, libballyhoo_helo_feed(h, server, sizeof(server) - 1, &consumed));
+  ck_assert(consumed == sizeof(server) - 1 - 2);
+  libballyhoo_helo_free(h);
+}
+
+START_TEST(test_ballyhoo_helo_invalid) {
+  size_t consumed;
+
+  BallyhooHelo *h = libballyhoo_helo_new();
+  assert_int_equal(-1, libballyhoo_helo_feed(h, "HTTP/1.1\0", 9, &consumed));
+  assert_string_equal("Invalid Handshake", h->error);
+  libballyhoo_helo_free(h);
+
+  const char bad_protocol[] = "BALLYHOO\0" "999\0" "NO\0";
+  h = libballyhoo_helo_new();
+  assert_int_equal(-1, libballyhoo_helo_feed(h, bad_protocol, sizeof(bad_protocol) - 1, &consumed));
+  assert_string_equal("Unsupported Protocol", h->error);
+  libballyhoo_helo_free(h);
+
+  const char no_ready[] = "BALLYHOO\0" "401\0" "OK\0" "Encoding: text\0";
+  h = libballyhoo_helo_new();
+  assert_int_equal(-1, libballyhoo_helo_feed(h, no_ready, sizeof(no_ready) - 1, &consumed));
+  libballyhoo_helo_free(h);
+
+  // a missing null terminator
+  char garbage[64];
+  memset(garbage, 'x', sizeof(garbage));
+  h = libballyhoo_helo_new();
+  assert_int_equal(-1, libballyhoo_helo_feed(h, garbage, sizeof(garbage), &consumed));
+  libballyhoo_helo_free(h);
+}
+
+Suite *ballyhoo_helo_suite(void) {
+  Suite *s = suite_create("BALLYHOO_helo Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Handshake");
+  tcase_add_test(tc, test_ballyhoo_helo_preamble);
+  tcase_add_test(tc, test_ballyhoo_helo_feed);
+  tcase_add_test(tc, test_ballyhoo_helo_invalid);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
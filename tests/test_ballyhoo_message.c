@@ -4,6 +4,7 @@
 #include "../libballyhoo_deflate.h"
 
 #include <stdio.h>
+#include <string.h>
 
 START_TEST(test_ballyhoo_message_decode) {
   char in[4096];
@@ -17,18 +18,20 @@ START_TEST(test_ballyhoo_message_decode) {
   char *i = in + 8 + 16;
   int size = 680 - 8 - 16;
   
-  BallyhooMessage *bm = libballyhoo_message_decode(i, size);
-  ck_assert(bm != NULL);
+  BallyhooSlice data = libballyhoo_slice_borrow(i, size);
+  BallyhooMessage m, *bm = &m;
+  ck_assert(libballyhoo_message_decode(&data, bm));
 
   ck_assert(bm->length == 591);
+  ck_assert(bm->xmlrpc.length == 591);
+  ck_assert((const char*)bm->xmlrpc.data == i + 65);
 
   // verify some headers
-  gpointer content_type = g_hash_table_lookup(bm->headers, "encoding");
-  assert_string_equal_free("deflate", content_type);
-  gpointer message_length = g_hash_table_lookup(bm->headers, "message-length");
-  assert_string_equal_free("591", message_length);
-  gpointer message_type = g_hash_table_lookup(bm->headers, "content-type");
-  assert_string_equal_free("message", message_type);
+  ck_assert(bm->encoding == BALLYHOO_ENCODING_DEFLATE);
+  ck_assert(bm->content_type.length == 7);
+  ck_assert(memcmp(bm->content_type.data, "message", 7) == 0);
+  ck_assert(bm->api_key.length == 0);
+  ck_assert(bm->extra_count == 0);
 
   // verify the binary data in xmlrpc
   const char expected[591] = {
@@ -73,7 +76,7 @@ START_TEST(test_ballyhoo_message_decode) {
   };
 
   for (int i = 0; i < 591; i++) {
-    ck_assert_msg(expected[i] == ((char*)(bm->xmlrpc))[i], "Byte %d doesn't match %x vs %x", i, expected[i], ((char*)(bm->xmlrpc))[i]);
+    ck_assert_msg(expected[i] == ((char*)(bm->xmlrpc.data))[i], "Byte %d doesn't match %x vs %x", i, expected[i], ((char*)(bm->xmlrpc.data))[i]);
   }
   
   /* size_t output_leng */
@@ -85,7 +88,93 @@ START_TEST(test_ballyhoo_message_decode) {
   
   /* ck_assert(output_length == 961); */
   
-  g_free(bm);
+  libballyhoo_message_clear(bm);
+}
+
+START_TEST(test_ballyhoo_message_headers) {
+  const char *in =
+    "Message-Length: 5\r\n"
+    "encoding:text\r\n"
+    "no colon\r\n"
+    "X-Helplightning-Api-Key:  abc \r\n"
+    "x-Other: value\r\n"
+    "\r\n"
+    "hello";
+  BallyhooSlice data = libballyhoo_slice_borrow(in, strlen(in));
+
+  BallyhooMessage bm;
+  ck_assert(libballyhoo_message_decode(&data, &bm));
+
+  ck_assert(bm.length == 5);
+  ck_assert(bm.encoding == BALLYHOO_ENCODING_TEXT);
+  ck_assert(bm.content_type.length == 0);
+  ck_assert(bm.api_key.length == 3);
+  ck_assert(memcmp(bm.api_key.data, "abc", 3) == 0);
+  ck_assert(memcmp(bm.xmlrpc.data, "hello", 5) == 0);
+
+  ck_assert(bm.extra_count == 1);
+  const BallyhooSlice *v = libballyhoo_message_header(&bm, "X-OTHER");
+  ck_assert(v != NULL);
+  ck_assert(v->length == 5);
+  ck_assert(memcmp(v->data, "value", 5) == 0);
+  ck_assert(libballyhoo_message_header(&bm, "missing") == NULL);
+
+  libballyhoo_message_clear(&bm);
+}
+
+START_TEST(test_ballyhoo_message_invalid) {
+  BallyhooMessage bm;
+
+  // no end to the headers
+  const char *in = "message-length: 5\r\nencoding: text\r\n";
+  BallyhooSlice data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode(&data, &bm));
+
+  // body is shorter than message-length
+  in = "message-length: 50\r\n\r\nhello";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode(&data, &bm));
+
+  // missing message-length
+  in = "encoding: text\r\n\r\nhello";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode(&data, &bm));
+
+  // a message-length that would overflow
+  in = "message-length: 18446744073709551621\r\n\r\nhello";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode_head(&data, &bm));
+
+  // or is just too long
+  in = "message-length: 1073741824\r\n\r\nhello";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode_head(&data, &bm));
+}
+
+START_TEST(test_ballyhoo_message_head) {
+  BallyhooMessage bm;
+
+  // only the start of the body has arrived
+  const char *in = "message-length: 50\r\nencoding: deflate\r\n\r\nhello";
+  BallyhooSlice data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(libballyhoo_message_decode_head(&data, &bm));
+  ck_assert(bm.length == 50);
+  ck_assert(bm.encoding == BALLYHOO_ENCODING_DEFLATE);
+  ck_assert(bm.xmlrpc.length == 5);
+  ck_assert(memcmp(bm.xmlrpc.data, "hello", 5) == 0);
+  libballyhoo_message_clear(&bm);
+
+  // anything past message-length isn't part of the body
+  in = "message-length: 2\r\n\r\nhello";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(libballyhoo_message_decode_head(&data, &bm));
+  ck_assert(bm.xmlrpc.length == 2);
+  libballyhoo_message_clear(&bm);
+
+  // the headers still have to be complete
+  in = "message-length: 50\r\nencod";
+  data = libballyhoo_slice_borrow(in, strlen(in));
+  ck_assert(!libballyhoo_message_decode_head(&data, &bm));
 }
 
 Suite *ballyhoo_message_suite(void) {
@@ -94,6 +183,9 @@ Suite *ballyhoo_message_suite(void) {
 
   tc = tcase_create("Decode");
   tcase_add_test(tc, test_ballyhoo_message_decode);
+  tcase_add_test(tc, test_ballyhoo_message_headers);
+  tcase_add_test(tc, test_ballyhoo_message_invalid);
+  tcase_add_test(tc, test_ballyhoo_message_head);
   suite_add_tcase(s, tc);
 
   return s;
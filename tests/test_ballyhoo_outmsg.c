@@ -0,0 +1,166 @@
+#include "tests.h"
+
+#include "../libballyhoo_outmsg.h"
+#include "../libcmf.h"
+#include "../librcl.h"
+
+#include <string.h>
+
+/* concatenate all the segments, as they'd be written */
+static GString *wire_bytes(BallyhooOutMessage *m)
+{
+  GString *wire = g_string_new(NULL);
+  for (int i = 0; i < m->segment_count; i++) {
+    g_string_append_len(wire, (const gchar*)m->segments[i].data, m->segments[i].length);
+  }
+
+  return wire;
+}
+
+/* frame length bytes of body both ways, and compare the chunks */
+static void check_framing(size_t length)
+{
+  guchar *body = g_malloc(length + 1);
+  for (size_t i = 0; i < length + 1; i++) {
+    body[i] = i % 251;
+  }
+
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
+  g_string_append_len(libballyhoo_out_message_body(m), (const gchar*)body, length);
+  ck_assert(libballyhoo_out_message_length(m) == length);
+  librcl_write_header(libballyhoo_out_message_prepend(m, LIBRCL_HEADER_SIZE), 7, FALSE, FALSE);
+  libballyhoo_out_message_frame(m, 0);
+  GString *wire = wire_bytes(m);
+  ck_assert(wire->len == libballyhoo_out_message_wire_length(m));
+
+  // libcmf_encode always leaves off the last byte it's given
+  size_t rcl_size;
+  guint64 uuid;
+  gpointer rcl = librcl_encode_request(body, length + 1, &uuid, &rcl_size);
+  GList *chunks = libcmf_encode(rcl, rcl_size);
+  GString *expected = g_string_new(NULL);
+  for (GList *it = chunks; it != NULL; it = it->next) {
+    CMFChunk *c = it->data;
+    g_string_append_len(expected, c->buffer, c->size);
+    g_free(c->buffer);
+    g_free(c);
+  }
+  g_list_free(chunks);
+  g_free(rcl);
+
+  CMFFrame a[16], b[16];
+  size_t consumed_a, consumed_b;
+  int count = libcmf_index(wire->str, wire->len, a, 16, &consumed_a, NULL);
+  assert_int_equal(libcmf_index(expected->str, expected->len, b, 16, &consumed_b, NULL), count);
+  ck_assert(consumed_a == wire->len);
+  ck_assert(consumed_b == expected->len);
+
+  for (int i = 0; i < count; i++) {
+    ck_assert(a[i].size == b[i].size);
+    ck_assert(a[i].begin == b[i].begin);
+    ck_assert(a[i].end == b[i].end);
+    ck_assert(a[i].priority == b[i].priority);
+    ck_assert(a[i].id == a[0].id);
+
+    // skip the rcl uuid
+    size_t skip = i == 0 ? LIBRCL_HEADER_SIZE : 0;
+    ck_assert(memcmp(wire->str + a[i].offset + skip,
+                     expected->str + b[i].offset + skip,
+                     a[i].size - skip) == 0);
+  }
+
+  g_string_free(wire, TRUE);
+  g_string_free(expected, TRUE);
+  libballyhoo_out_message_free(m);
+  g_free(body);
+}
+
+START_TEST(test_ballyhoo_outmsg_frame) {
+  check_framing(100);
+  check_framing(LIBCMF_CHUNK_SIZE - LIBRCL_HEADER_SIZE - 1);
+  // exactly one chunk, which is followed by an empty one
+  check_framing(LIBCMF_CHUNK_SIZE - LIBRCL_HEADER_SIZE);
+  check_framing(LIBCMF_CHUNK_SIZE * 3 + 17);
+}
+
+START_TEST(test_ballyhoo_outmsg_segments) {
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
+  GString *body = libballyhoo_out_message_body(m);
+  for (int i = 0; i < 300; i++) {
+    g_string_append(body, "0123456789");
+  }
+
+  guchar *header = libballyhoo_out_message_prepend(m, 4);
+  memcpy(header, "HEAD", 4);
+  ck_assert(libballyhoo_out_message_length(m) == 3004);
+
+  libballyhoo_out_message_frame(m, 0);
+
+  // the first chunk is one segment, the rest are a header
+  //  and a payload that point into the body
+  assert_int_equal(5, m->segment_count);
+  ck_assert(m->segments[0].length == LIBCMF_HEADER_SIZE + LIBCMF_CHUNK_SIZE);
+  ck_assert(memcmp(m->segments[0].data + LIBCMF_HEADER_SIZE, "HEAD0123", 8) == 0);
+  ck_assert(m->segments[1].length == LIBCMF_HEADER_SIZE);
+  ck_assert(m->segments[2].data == (const guchar*)body->str + m->start + LIBCMF_HEADER_SIZE + LIBCMF_CHUNK_SIZE);
+  ck_assert(m->segments[4].length == 3004 - 2 * LIBCMF_CHUNK_SIZE);
+  ck_assert(libballyhoo_out_message_wire_length(m) == 3004 + 3 * LIBCMF_HEADER_SIZE);
+
+  libballyhoo_out_message_free(m);
+}
+
+START_TEST(test_ballyhoo_outmsg_template) {
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
+  g_string_append(libballyhoo_out_message_body(m), "<ping/>");
+  librcl_write_header(libballyhoo_out_message_prepend(m, LIBRCL_HEADER_SIZE), 1, FALSE, FALSE);
+  libballyhoo_out_message_frame(m, 3);
+
+  BallyhooOutTemplate *t = libballyhoo_out_template_new(m);
+  ck_assert(t != NULL);
+  ck_assert(t->length == libballyhoo_out_message_wire_length(m));
+  libballyhoo_out_message_free(m);
+
+  // each stamp is a new cmf message with a new uuid
+  CMFFrame frames[2];
+  size_t consumed;
+  gint32 ids[2];
+  for (int i = 0; i < 2; i++) {
+    libballyhoo_out_template_stamp(t, 100 + i);
+    assert_int_equal(1, libcmf_index(t->data, t->length, frames, 2, &consumed, NULL));
+    ck_assert(consumed == t->length);
+    ck_assert(frames[0].begin && frames[0].end);
+    assert_int_equal(3, frames[0].priority);
+    ids[i] = frames[0].id;
+
+    BallyhooSlice body = libballyhoo_slice_borrow(t->data + frames[0].offset, frames[0].size);
+    RCLDecoded rcl;
+    assert_int_equal(1, librcl_decode(&body, &rcl));
+    ck_assert(rcl.uuid == 100 + i);
+    ck_assert(!rcl.response);
+    ck_assert(rcl.body.length == 7);
+    ck_assert(memcmp(rcl.body.data, "<ping/>", 7) == 0);
+    libballyhoo_slice_clear(&rcl.body);
+  }
+  ck_assert(ids[0] != ids[1]);
+  libballyhoo_out_template_free(t);
+
+  // only single chunk messages can be templates
+  m = libballyhoo_out_message_new();
+  g_string_set_size(libballyhoo_out_message_body(m), LIBBALLYHOO_OUT_HEADROOM + LIBCMF_CHUNK_SIZE * 2);
+  libballyhoo_out_message_frame(m, 0);
+  ck_assert(libballyhoo_out_template_new(m) == NULL);
+  libballyhoo_out_message_free(m);
+}
+
+Suite *ballyhoo_outmsg_suite(void) {
+  Suite *s = suite_create("BALLYHOO_outmsg Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Frame");
+  tcase_add_test(tc, test_ballyhoo_outmsg_frame);
+  tcase_add_test(tc, test_ballyhoo_outmsg_segments);
+  tcase_add_test(tc, test_ballyhoo_outmsg_template);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
@@ -0,0 +1,86 @@
+#include "tests.h"
+
+#include "../libballyhoo_pending.h"
+
+static void count_entry(guint64 uuid, gpointer value, gpointer user_data)
+{
+  ck_assert(GPOINTER_TO_SIZE(value) == uuid + 1);
+  (*(int*)user_data)++;
+}
+
+START_TEST(test_ballyhoo_pending_sequential) {
+  BallyhooPending *p = libballyhoo_pending_new();
+
+  // enough in flight to grow a few times
+  for (guint64 uuid = 1000; uuid < 1500; uuid++) {
+    libballyhoo_pending_insert(p, uuid, GSIZE_TO_POINTER(uuid + 1));
+  }
+  assert_int_equal(500, p->count);
+  ck_assert(p->capacity >= 1000);
+
+  for (guint64 uuid = 1000; uuid < 1500; uuid++) {
+    ck_assert(libballyhoo_pending_lookup(p, uuid) == GSIZE_TO_POINTER(uuid + 1));
+  }
+  ck_assert(libballyhoo_pending_lookup(p, 999) == NULL);
+  ck_assert(libballyhoo_pending_lookup(p, 1500) == NULL);
+
+  // answered out of order
+  for (guint64 uuid = 1000; uuid < 1500; uuid += 2) {
+    ck_assert(libballyhoo_pending_remove(p, uuid) == GSIZE_TO_POINTER(uuid + 1));
+  }
+  ck_assert(libballyhoo_pending_remove(p, 1000) == NULL);
+  assert_int_equal(250, p->count);
+
+  int count = 0;
+  libballyhoo_pending_foreach(p, count_entry, &count);
+  assert_int_equal(250, count);
+
+  for (guint64 uuid = 1001; uuid < 1500; uuid += 2) {
+    ck_assert(libballyhoo_pending_lookup(p, uuid) == GSIZE_TO_POINTER(uuid + 1));
+  }
+
+  libballyhoo_pending_free(p);
+}
+
+START_TEST(test_ballyhoo_pending_collisions) {
+  BallyhooPending *p = libballyhoo_pending_new();
+  guint64 size = LIBBALLYHOO_PENDING_SIZE;
+
+  // all of these want the last slot, so the run wraps around
+  guint64 uuids[] = { size - 1, 2 * size - 1, 3 * size - 1, 4 * size - 1 };
+  for (int i = 0; i < 4; i++) {
+    libballyhoo_pending_insert(p, uuids[i], GSIZE_TO_POINTER(uuids[i] + 1));
+  }
+  // and this one's own slot is taken by the run
+  libballyhoo_pending_insert(p, size, GSIZE_TO_POINTER(size + 1));
+  assert_int_equal(LIBBALLYHOO_PENDING_SIZE, p->capacity);
+
+  // removing from the middle of the run keeps the rest
+  //  reachable
+  ck_assert(libballyhoo_pending_remove(p, uuids[1]) != NULL);
+  ck_assert(libballyhoo_pending_lookup(p, uuids[1]) == NULL);
+  for (int i = 0; i < 4; i++) {
+    if (i != 1) {
+      ck_assert(libballyhoo_pending_lookup(p, uuids[i]) == GSIZE_TO_POINTER(uuids[i] + 1));
+    }
+  }
+  ck_assert(libballyhoo_pending_lookup(p, size) == GSIZE_TO_POINTER(size + 1));
+
+  // replacing doesn't add another entry
+  libballyhoo_pending_insert(p, size, GSIZE_TO_POINTER(size + 1));
+  assert_int_equal(4, p->count);
+
+  libballyhoo_pending_free(p);
+}
+
+Suite *ballyhoo_pending_suite(void) {
+  Suite *s = suite_create("BALLYHOO_pending Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Table");
+  tcase_add_test(tc, test_ballyhoo_pending_sequential);
+  tcase_add_test(tc, test_ballyhoo_pending_collisions);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
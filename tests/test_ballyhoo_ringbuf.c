@@ -0,0 +1,111 @@
+#include "tests.h"
+
+#include "../libballyhoo_ringbuf.h"
+
+#include <string.h>
+
+START_TEST(test_ballyhoo_ringbuf_write_read) {
+  BallyhooRingBuf *rb = libballyhoo_ringbuf_new(16, 64);
+
+  size_t available;
+  gpointer tail = libballyhoo_ringbuf_reserve(rb, &available);
+  ck_assert(tail != NULL);
+  ck_assert(available == 16);
+
+  memcpy(tail, "0123456789", 10);
+  libballyhoo_ringbuf_commit(rb, 10);
+
+  size_t length;
+  gpointer head = libballyhoo_ringbuf_peek(rb, &length);
+  ck_assert(length == 10);
+  ck_assert(memcmp(head, "0123456789", 10) == 0);
+
+  // consuming doesn't move the remaining data
+  libballyhoo_ringbuf_consume(rb, 4);
+  gpointer head2 = libballyhoo_ringbuf_peek(rb, &length);
+  ck_assert(length == 6);
+  ck_assert(head2 == (char*)head + 4);
+  ck_assert(memcmp(head2, "456789", 6) == 0);
+
+  // draining resets to the start of the buffer
+  libballyhoo_ringbuf_consume(rb, 6);
+  ck_assert(rb->used == 0);
+  ck_assert(rb->head == 0);
+
+  libballyhoo_ringbuf_free(rb);
+}
+
+START_TEST(test_ballyhoo_ringbuf_wrap) {
+  BallyhooRingBuf *rb = libballyhoo_ringbuf_new(16, 16);
+  size_t available, length;
+
+  gpointer tail = libballyhoo_ringbuf_reserve(rb, &available);
+  memcpy(tail, "abcdefghijklmn", 14);
+  libballyhoo_ringbuf_commit(rb, 14);
+  libballyhoo_ringbuf_consume(rb, 12);
+
+  // 2 bytes left at the end, then we wrap to the start
+  tail = libballyhoo_ringbuf_reserve(rb, &available);
+  ck_assert(available == 2);
+  memcpy(tail, "op", 2);
+  libballyhoo_ringbuf_commit(rb, 2);
+
+  tail = libballyhoo_ringbuf_reserve(rb, &available);
+  ck_assert(tail == rb->buffer);
+  ck_assert(available == 12);
+  memcpy(tail, "qrst", 4);
+  libballyhoo_ringbuf_commit(rb, 4);
+
+  // peek makes it contiguous
+  gpointer head = libballyhoo_ringbuf_peek(rb, &length);
+  ck_assert(length == 8);
+  ck_assert(memcmp(head, "mnopqrst", 8) == 0);
+
+  libballyhoo_ringbuf_free(rb);
+}
+
+START_TEST(test_ballyhoo_ringbuf_grow_shrink) {
+  BallyhooRingBuf *rb = libballyhoo_ringbuf_new(8, 32);
+  size_t available, length;
+
+  // fill it past the initial size
+  for (int i = 0; i < 4; i++) {
+    gpointer tail = libballyhoo_ringbuf_reserve(rb, &available);
+    ck_assert(tail != NULL);
+    ck_assert(available >= 8);
+    memset(tail, 'a' + i, 8);
+    libballyhoo_ringbuf_commit(rb, 8);
+  }
+  ck_assert(rb->capacity == 32);
+
+  // we are at the max
+  ck_assert(libballyhoo_ringbuf_reserve(rb, &available) == NULL);
+
+  gpointer head = libballyhoo_ringbuf_peek(rb, &length);
+  ck_assert(length == 32);
+  ck_assert(((char*)head)[0] == 'a');
+  ck_assert(((char*)head)[31] == 'd');
+
+  // can't shrink while there is data
+  libballyhoo_ringbuf_shrink(rb);
+  ck_assert(rb->capacity == 32);
+
+  libballyhoo_ringbuf_consume(rb, 32);
+  libballyhoo_ringbuf_shrink(rb);
+  ck_assert(rb->capacity == 8);
+
+  libballyhoo_ringbuf_free(rb);
+}
+
+Suite *ballyhoo_ringbuf_suite(void) {
+  Suite *s = suite_create("BALLYHOO_ringbuf Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Buffer");
+  tcase_add_test(tc, test_ballyhoo_ringbuf_write_read);
+  tcase_add_test(tc, test_ballyhoo_ringbuf_wrap);
+  tcase_add_test(tc, test_ballyhoo_ringbuf_grow_shrink);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
@@ -0,0 +1,127 @@
+#include "tests.h"
+
+#include "../libballyhoo_sched.h"
+#include "../libcmf.h"
+
+#include <string.h>
+
+static void append_cb(gconstpointer data, size_t length, gpointer user_data)
+{
+  g_string_append_len((GString*)user_data, data, length);
+}
+
+/* a framed message with length bytes of body */
+static BallyhooOutMessage *build(size_t length, int priority)
+{
+  BallyhooOutMessage *m = libballyhoo_out_message_new();
+  GString *body = libballyhoo_out_message_body(m);
+  for (size_t i = 0; i < length; i++) {
+    g_string_append_c(body, 'a' + i % 26);
+  }
+  libballyhoo_out_message_frame(m, priority);
+
+  return m;
+}
+
+/* take everything, and index the frames that were written */
+static int take_all(BallyhooScheduler *s, CMFFrame *frames, int max)
+{
+  GString *wire = g_string_new(NULL);
+  size_t taken = libballyhoo_scheduler_take(s, G_MAXSIZE, append_cb, wire);
+  ck_assert(taken == wire->len);
+  ck_assert(s->pending == 0);
+
+  size_t consumed;
+  int count = libcmf_index(wire->str, wire->len, frames, max, &consumed, NULL);
+  ck_assert(consumed == wire->len);
+  g_string_free(wire, TRUE);
+
+  return count;
+}
+
+START_TEST(test_ballyhoo_sched_priority) {
+  BallyhooScheduler *s = libballyhoo_scheduler_new();
+
+  libballyhoo_scheduler_push(s, build(100, 12));
+  libballyhoo_scheduler_push(s, build(100, 4));
+  libballyhoo_scheduler_push(s, build(100, 0));
+  ck_assert(s->pending == 3 * (100 + LIBCMF_HEADER_SIZE));
+
+  // pushed lowest first, taken highest first
+  CMFFrame frames[8];
+  assert_int_equal(3, take_all(s, frames, 8));
+  assert_int_equal(0, frames[0].priority);
+  assert_int_equal(4, frames[1].priority);
+  assert_int_equal(12, frames[2].priority);
+  ck_assert(frames[0].id > frames[1].id);
+  ck_assert(frames[1].id > frames[2].id);
+
+  libballyhoo_scheduler_free(s);
+}
+
+START_TEST(test_ballyhoo_sched_round_robin) {
+  BallyhooScheduler *s = libballyhoo_scheduler_new();
+
+  // three chunks and two chunks at the same priority
+  libballyhoo_scheduler_push(s, build(LIBCMF_CHUNK_SIZE * 2 + 10, 4));
+  libballyhoo_scheduler_push(s, build(LIBCMF_CHUNK_SIZE + 10, 4));
+
+  CMFFrame frames[8];
+  assert_int_equal(5, take_all(s, frames, 8));
+  gint32 a_id = frames[0].id;
+  gint32 b_id = frames[1].id;
+  ck_assert(a_id != b_id);
+  ck_assert(frames[2].id == a_id);
+  ck_assert(frames[3].id == b_id);
+  ck_assert(frames[4].id == a_id);
+  ck_assert(frames[3].end);
+  ck_assert(frames[4].end);
+
+  libballyhoo_scheduler_free(s);
+}
+
+START_TEST(test_ballyhoo_sched_budget) {
+  BallyhooScheduler *s = libballyhoo_scheduler_new();
+  GString *wire = g_string_new(NULL);
+
+  libballyhoo_scheduler_push(s, build(LIBCMF_CHUNK_SIZE * 3, 4));
+  size_t total = s->pending;
+
+  // whole chunks are taken, so one byte of budget takes the first
+  size_t taken = libballyhoo_scheduler_take(s, 1, append_cb, wire);
+  ck_assert(taken == LIBCMF_HEADER_SIZE + LIBCMF_CHUNK_SIZE);
+  ck_assert(s->pending == total - taken);
+
+  // an urgent message overtakes the rest of it
+  libballyhoo_scheduler_push(s, build(10, 0));
+  taken = libballyhoo_scheduler_take(s, 1, append_cb, wire);
+  ck_assert(taken == LIBCMF_HEADER_SIZE + 10);
+
+  CMFFrame frames[4];
+  size_t consumed;
+  assert_int_equal(2, libcmf_index(wire->str, wire->len, frames, 4, &consumed, NULL));
+  ck_assert(frames[1].id != frames[0].id);
+  assert_int_equal(0, frames[1].priority);
+  ck_assert(frames[1].end);
+
+  // nothing is left once cleared
+  libballyhoo_scheduler_clear(s);
+  ck_assert(s->pending == 0);
+  ck_assert(libballyhoo_scheduler_take(s, G_MAXSIZE, append_cb, wire) == 0);
+
+  g_string_free(wire, TRUE);
+  libballyhoo_scheduler_free(s);
+}
+
+Suite *ballyhoo_sched_suite(void) {
+  Suite *s = suite_create("BALLYHOO_sched Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Schedule");
+  tcase_add_test(tc, test_ballyhoo_sched_priority);
+  tcase_add_test(tc, test_ballyhoo_sched_round_robin);
+  tcase_add_test(tc, test_ballyhoo_sched_budget);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
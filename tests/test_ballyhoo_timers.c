@@ -0,0 +1,77 @@
+#include "tests.h"
+
+#include "../libballyhoo_timers.h"
+
+START_TEST(test_ballyhoo_timers_order) {
+  BallyhooTimers *timers = libballyhoo_timers_new();
+
+  // more than the initial capacity, in a scrambled order
+  BallyhooTimer t[100];
+  for (int i = 0; i < 100; i++) {
+    libballyhoo_timer_init(&t[i], (i * 37) % 100, &t[i]);
+    libballyhoo_timers_add(timers, &t[i]);
+  }
+  assert_int_equal(100, timers->count);
+
+  // nothing has expired before the first deadline
+  ck_assert(libballyhoo_timers_pop_expired(timers, -1) == NULL);
+
+  for (int i = 0; i < 100; i++) {
+    BallyhooTimer *next = libballyhoo_timers_pop_expired(timers, 1000);
+    ck_assert(next != NULL);
+    ck_assert(next->deadline == i);
+    assert_int_equal(-1, next->index);
+  }
+  ck_assert(libballyhoo_timers_peek(timers) == NULL);
+
+  libballyhoo_timers_free(timers);
+}
+
+START_TEST(test_ballyhoo_timers_remove) {
+  BallyhooTimers *timers = libballyhoo_timers_new();
+
+  BallyhooTimer t[10];
+  for (int i = 0; i < 10; i++) {
+    libballyhoo_timer_init(&t[i], 100 - i * 10, NULL);
+    libballyhoo_timers_add(timers, &t[i]);
+  }
+  ck_assert(libballyhoo_timers_peek(timers) == &t[9]);
+
+  // from the middle, the root and the end
+  libballyhoo_timers_remove(timers, &t[4]);
+  libballyhoo_timers_remove(timers, &t[9]);
+  libballyhoo_timers_remove(timers, &t[0]);
+  assert_int_equal(7, timers->count);
+  assert_int_equal(-1, t[4].index);
+
+  // removing twice does nothing
+  libballyhoo_timers_remove(timers, &t[4]);
+  assert_int_equal(7, timers->count);
+
+  // only what has expired comes out, in order
+  int expected[] = { 8, 7, 6, 5 };
+  for (int i = 0; i < 4; i++) {
+    ck_assert(libballyhoo_timers_pop_expired(timers, 60) == &t[expected[i]]);
+  }
+  ck_assert(libballyhoo_timers_pop_expired(timers, 60) == NULL);
+  ck_assert(libballyhoo_timers_peek(timers) == &t[3]);
+
+  // and a removed timer can be added again
+  libballyhoo_timers_add(timers, &t[4]);
+  ck_assert(libballyhoo_timers_pop_expired(timers, 60) == &t[4]);
+
+  libballyhoo_timers_free(timers);
+  assert_int_equal(-1, t[1].index);
+}
+
+Suite *ballyhoo_timers_suite(void) {
+  Suite *s = suite_create("BALLYHOO_timers Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Heap");
+  tcase_add_test(tc, test_ballyhoo_timers_order);
+  tcase_add_test(tc, test_ballyhoo_timers_remove);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
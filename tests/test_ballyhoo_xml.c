@@ -3,7 +3,9 @@
 #include "../libballyhoo_deflate.h"
 #include "../libballyhoo_xml.h"
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 START_TEST(test_ballyhoo_xml_decode) {
   char in[4096];
@@ -53,12 +55,116 @@ START_TEST(test_ballyhoo_xml_decode) {
   xmlrpc_DECREF(arr);
 }
 
+START_TEST(test_ballyhoo_xml_sniff) {
+  const char *call = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+    "<methodCall><methodName>ping</methodName></methodCall>";
+  ck_assert(libballyhoo_xml_sniff(call, strlen(call)) == BXML_ROOT_CALL);
+
+  const char *response = "\xef\xbb\xbf<?xml version=\"1.0\"?>\n"
+    "<!-- a comment with <methodCall> in it -->\n"
+    "<methodResponse>\n<params></params></methodResponse>";
+  ck_assert(libballyhoo_xml_sniff(response, strlen(response)) == BXML_ROOT_RESPONSE);
+
+  const char *other = "<?xml version=\"1.0\"?><methodCallback/>";
+  ck_assert(libballyhoo_xml_sniff(other, strlen(other)) == BXML_ROOT_UNKNOWN);
+
+  const char *truncated = "<?xml version=\"1.0\"";
+  ck_assert(libballyhoo_xml_sniff(truncated, strlen(truncated)) == BXML_ROOT_UNKNOWN);
+  ck_assert(libballyhoo_xml_sniff("", 0) == BXML_ROOT_UNKNOWN);
+}
+
+START_TEST(test_ballyhoo_xml_decode_call) {
+  const char *call = "<?xml version=\"1.0\"?>\n"
+    "<methodCall><methodName>conn_pong</methodName>"
+    "<params><param><value><string>a</string></value></param></params>"
+    "</methodCall>";
+  BallyhooXMLRPC *b = libballyhoo_xml_decode(call, strlen(call));
+  ck_assert(b != NULL);
+  ck_assert(b->type == BXMLRPC_CALL);
+  assert_string_equal("conn_pong", b->method_name);
+  ck_assert(xmlrpc_value_type(libballyhoo_xml_params(b)) == XMLRPC_TYPE_ARRAY);
+  libballyhoo_xml_free(b);
+
+  // a call with a method name but broken params isn't accepted
+  const char *malformed = "<?xml version=\"1.0\"?>\n"
+    "<methodCall><methodName>conn_pong</methodName>"
+    "<params><param><value><int>x</int></param></params>"
+    "</methodCall>";
+  ck_assert(libballyhoo_xml_decode(malformed, strlen(malformed)) == NULL);
+}
+
+static gchar *encode_request(const char *method_name, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  GString *out = g_string_new(NULL);
+  libballyhoo_xml_append_request(out, method_name, format, args);
+  va_end(args);
+
+  return g_string_free(out, FALSE);
+}
+
+static gchar *encode_request_xmlrpc(const char *method_name, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  xmlrpc_env env;
+  xmlrpc_value *values;
+  const char *suffix;
+
+  xmlrpc_env_init(&env);
+  xmlrpc_mem_block *c = XMLRPC_MEMBLOCK_NEW(char, &env, 0);
+  xmlrpc_build_value_va(&env, format, args, &values, &suffix);
+  xmlrpc_serialize_call(&env, c, method_name, values);
+  va_end(args);
+
+  gchar *xml = g_strndup(xmlrpc_mem_block_contents(c), xmlrpc_mem_block_size(c));
+  xmlrpc_DECREF(values);
+  xmlrpc_mem_block_free(c);
+  xmlrpc_env_clean(&env);
+
+  return xml;
+}
+
+START_TEST(test_ballyhoo_xml_encode_request) {
+  assert_string_equal_free("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+                           "<methodCall>\r\n"
+                           "<methodName>session_send_message</methodName>\r\n"
+                           "<params>\r\n"
+                           "<param><value><string>tok</string></value></param>\r\n"
+                           "<param><value><string>a &lt;b&gt; &amp; c&#x0d;\n</string></value></param>\r\n"
+                           "<param><value><i4>-12</i4></value></param>\r\n"
+                           "<param><value><boolean>1</boolean></value></param>\r\n"
+                           "</params>\r\n"
+                           "</methodCall>\r\n",
+                           encode_request("session_send_message", "(ssib)",
+                                          "tok", "a <b> & c\r\n", -12, TRUE));
+
+  // the fast path must match xmlrpc-c exactly
+  gchar *fast = encode_request("conn_register", "(sssb)", "x", "\"y\"", "\xc3\xa9", FALSE);
+  assert_string_equal_free(fast,
+                           encode_request_xmlrpc("conn_register", "(sssb)", "x", "\"y\"", "\xc3\xa9", FALSE));
+  g_free(fast);
+
+  fast = encode_request("conn_ping", "()");
+  assert_string_equal_free(fast, encode_request_xmlrpc("conn_ping", "()"));
+  g_free(fast);
+
+  // anything else still goes through xmlrpc-c
+  fast = encode_request("workspace_switch", "(s{s:i})", "t", "id", 3);
+  assert_string_equal_free(fast, encode_request_xmlrpc("workspace_switch", "(s{s:i})", "t", "id", 3));
+  g_free(fast);
+}
+
 Suite *ballyhoo_xml_suite(void) {
   Suite *s = suite_create("BALLYHOO_xml Suite");
   TCase *tc = NULL;
 
   tc = tcase_create("Decode");
   tcase_add_test(tc, test_ballyhoo_xml_decode);
+  tcase_add_test(tc, test_ballyhoo_xml_decode_call);
+  tcase_add_test(tc, test_ballyhoo_xml_sniff);
+  tcase_add_test(tc, test_ballyhoo_xml_encode_request);
   suite_add_tcase(s, tc);
 
   return s;
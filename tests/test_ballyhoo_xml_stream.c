@@ -0,0 +1,127 @@
+#include "tests.h"
+
+#include "../libballyhoo_xml_stream.h"
+
+#include <string.h>
+
+typedef struct {
+  GString *log;
+  int stop_after;
+} StreamLog;
+
+static gboolean log_event(const BallyhooXMLEvent *ev, gpointer user_data)
+{
+  StreamLog *l = user_data;
+  const char *names[] = { "{", "}", "[", "]", "=" };
+
+  g_string_append_printf(l->log, "%d%s", ev->depth, names[ev->type]);
+  if (ev->member)
+    g_string_append_printf(l->log, "%s", ev->member);
+  else if (ev->index >= 0)
+    g_string_append_printf(l->log, "#%d", ev->index);
+  if (ev->type == BXML_EVENT_SCALAR)
+    g_string_append_printf(l->log, ":%d:%.*s", ev->scalar, (int)ev->length, ev->text);
+  g_string_append_c(l->log, ' ');
+
+  return --l->stop_after != 0;
+}
+
+START_TEST(test_ballyhoo_xml_stream_response) {
+  const char *xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+    "<methodResponse>\r\n<params>\r\n<param><value><struct>\r\n"
+    "<member><name>id</name><value><i4>42</i4></value></member>\r\n"
+    "<member><name>name</name><value>Tom &amp; Jerry</value></member>\r\n"
+    "<member><name>users</name><value><array><data>\r\n"
+    "<value><string>a</string></value>\r\n"
+    "<value><boolean>1</boolean></value>\r\n"
+    "</data></array></value></member>\r\n"
+    "</struct></value></param>\r\n</params>\r\n</methodResponse>\r\n";
+
+  StreamLog l = { g_string_new(NULL), -1 };
+  ck_assert(libballyhoo_xml_stream(xml, strlen(xml), log_event, &l) == BXML_STREAM_OK);
+  assert_string_equal("0{#0 1=id:1:42 1=name:0:Tom & Jerry 1[users "
+                      "2=#0:0:a 2=#1:2:1 1] 0}#0 ", l.log->str);
+
+  // stopping early isn't an error
+  g_string_truncate(l.log, 0);
+  l.stop_after = 2;
+  ck_assert(libballyhoo_xml_stream(xml, strlen(xml), log_event, &l) == BXML_STREAM_OK);
+  assert_string_equal("0{#0 1=id:1:42 ", l.log->str);
+
+  g_string_free(l.log, TRUE);
+}
+
+START_TEST(test_ballyhoo_xml_stream_call) {
+  const char *xml = "\xef\xbb\xbf<?xml version=\"1.0\"?>"
+    "<methodCall><methodName>session_message_received</methodName><params>"
+    "<param><value><string>abc</string></value></param>"
+    "<param><value><struct><member><name>owner_id</name>"
+    "<value><int>-7</int></value></member></struct></value></param>"
+    "</params></methodCall>";
+
+  StreamLog l = { g_string_new(NULL), -1 };
+  ck_assert(libballyhoo_xml_stream(xml, strlen(xml), log_event, &l) == BXML_STREAM_OK);
+  assert_string_equal("0=#0:0:abc 0{#1 1=owner_id:1:-7 0}#1 ", l.log->str);
+
+  g_string_free(l.log, TRUE);
+}
+
+START_TEST(test_ballyhoo_xml_stream_fault) {
+  const char *xml = "<?xml version=\"1.0\"?><methodResponse><fault><value><struct>"
+    "<member><name>faultCode</name><value><int>4</int></value></member>"
+    "</struct></value></fault></methodResponse>";
+
+  StreamLog l = { g_string_new(NULL), -1 };
+  ck_assert(libballyhoo_xml_stream(xml, strlen(xml), log_event, &l) == BXML_STREAM_FAULT);
+  ck_assert(l.log->len == 0);
+
+  const char *bad = "<?xml version=\"1.0\"?><methodResponse><params>";
+  ck_assert(libballyhoo_xml_stream(bad, strlen(bad), log_event, &l) == BXML_STREAM_ERROR);
+
+  g_string_free(l.log, TRUE);
+}
+
+START_TEST(test_ballyhoo_xml_stream_helpers) {
+  BallyhooXMLEvent ev;
+  memset(&ev, 0, sizeof(BallyhooXMLEvent));
+  ev.type = BXML_EVENT_SCALAR;
+  ev.depth = 1;
+  ev.member = "reachable";
+  ev.index = -1;
+
+  ck_assert(libballyhoo_xml_event_is(&ev, 1, "reachable"));
+  ck_assert(!libballyhoo_xml_event_is(&ev, 2, "reachable"));
+  ck_assert(!libballyhoo_xml_event_is(&ev, 1, "reach"));
+
+  gboolean b = FALSE;
+  ev.scalar = BXML_SCALAR_BOOLEAN;
+  ev.text = "1";
+  ev.length = 1;
+  ck_assert(libballyhoo_xml_event_bool(&ev, &b));
+  ck_assert(b == TRUE);
+
+  gint32 i = 0;
+  ev.scalar = BXML_SCALAR_INT;
+  ev.text = "1234xyz";
+  ev.length = 4;
+  ck_assert(libballyhoo_xml_event_int(&ev, &i));
+  assert_int_equal(1234, i);
+  ck_assert(!libballyhoo_xml_event_bool(&ev, &b));
+
+  ev.scalar = BXML_SCALAR_STRING;
+  assert_string_equal_free("1234", libballyhoo_xml_event_dup(&ev));
+}
+
+Suite *ballyhoo_xml_stream_suite(void) {
+  Suite *s = suite_create("BALLYHOO_xml_stream Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Stream");
+  tcase_add_test(tc, test_ballyhoo_xml_stream_response);
+  tcase_add_test(tc, test_ballyhoo_xml_stream_call);
+  tcase_add_test(tc, test_ballyhoo_xml_stream_fault);
+  tcase_add_test(tc, test_ballyhoo_xml_stream_helpers);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
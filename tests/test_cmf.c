@@ -3,6 +3,7 @@
 #include "../libcmf.h"
 
 #include <stdio.h>
+#include <string.h>
 
 START_TEST(test_cmf_decode_header) {
   char in[4096];
@@ -25,12 +26,176 @@ START_TEST(test_cmf_decode_header) {
   g_free(cmf);
 }
 
+START_TEST(test_cmf_index) {
+  char in[4096];
+  FILE *f = fopen("message.bin", "rb");
+  size_t r = fread(in, 1, 4096, f);
+  fclose(f);
+  
+  ck_assert(r == 680);
+
+  // the message twice, plus the start of a third
+  char buffer[680 * 2 + 100];
+  memcpy(buffer, in, 680);
+  memcpy(buffer + 680, in, 680);
+  memcpy(buffer + 680 * 2, in, 100);
+
+  CMFFrame frames[4];
+  size_t consumed;
+  int count = libcmf_index(buffer, sizeof(buffer), frames, 4, &consumed, NULL);
+
+  ck_assert(count == 2);
+  ck_assert(consumed == 680 * 2);
+
+  ck_assert(frames[0].offset == 8);
+  ck_assert(frames[0].size == 672);
+  ck_assert(frames[0].begin == TRUE);
+  ck_assert(frames[0].end == TRUE);
+  ck_assert(frames[0].id == 1);
+
+  ck_assert(frames[1].offset == 680 + 8);
+  ck_assert(frames[1].size == 672);
+
+  // only room for one
+  count = libcmf_index(buffer, sizeof(buffer), frames, 1, &consumed, NULL);
+  ck_assert(count == 1);
+  ck_assert(consumed == 680);
+
+  // not enough for a header
+  count = libcmf_index(buffer, 4, frames, 4, &consumed, NULL);
+  ck_assert(count == 0);
+  ck_assert(consumed == 0);
+}
+
+START_TEST(test_cmf_index_chunks) {
+  char data[3000];
+  memset(data, 'x', sizeof(data));
+
+  GList *chunks = libcmf_encode_priority(data, sizeof(data), 5);
+  ck_assert(g_list_length(chunks) == 3);
+
+  char buffer[4096];
+  size_t length = 0;
+  for (GList *it = chunks; it != NULL; it = it->next) {
+    CMFChunk *c = it->data;
+    memcpy(buffer + length, c->buffer, c->size);
+    length += c->size;
+  }
+
+  CMFFrame frames[4];
+  size_t consumed;
+  int count = libcmf_index(buffer, length, frames, 4, &consumed, NULL);
+
+  ck_assert(count == 3);
+  ck_assert(consumed == length);
+
+  ck_assert(frames[0].begin == TRUE);
+  ck_assert(frames[0].end == FALSE);
+  ck_assert(frames[0].size == 1024);
+  ck_assert(frames[0].priority == 5);
+  ck_assert(frames[1].begin == FALSE);
+  ck_assert(frames[1].end == FALSE);
+  ck_assert(frames[2].end == TRUE);
+  ck_assert(frames[2].id == frames[0].id);
+  ck_assert(frames[2].offset == 8 + 1024 + 8 + 1024 + 8);
+}
+
+START_TEST(test_cmf_index_malformed) {
+  char in[4096];
+  FILE *f = fopen("message.bin", "rb");
+  size_t r = fread(in, 1, 4096, f);
+  fclose(f);
+  
+  ck_assert(r == 680);
+
+  // two good messages, then a header with the first bit set
+  char buffer[680 * 2 + 100];
+  memcpy(buffer, in, 680);
+  memcpy(buffer + 680, in, 680);
+  memcpy(buffer + 680 * 2, in, 100);
+  buffer[680 * 2] |= 0x80;
+
+  CMFFrame frames[4];
+  size_t consumed;
+  gboolean malformed = FALSE;
+  int count = libcmf_index(buffer, sizeof(buffer), frames, 4, &consumed, &malformed);
+
+  // the good frames are still returned
+  ck_assert(malformed == TRUE);
+  ck_assert(count == 2);
+  ck_assert(consumed == 680 * 2);
+  ck_assert(frames[1].offset == 680 + 8);
+  ck_assert(frames[1].size == 672);
+
+  // a bad header at the start
+  count = libcmf_index(buffer + 680 * 2, 100, frames, 4, &consumed, &malformed);
+  ck_assert(malformed == TRUE);
+  ck_assert(count == 0);
+  ck_assert(consumed == 0);
+
+  // and good data isn't flagged
+  count = libcmf_index(buffer, 680 * 2, frames, 4, &consumed, &malformed);
+  ck_assert(malformed == FALSE);
+  ck_assert(count == 2);
+}
+
+START_TEST(test_cmf_reassemble) {
+  CMFReassembler *r = libcmf_reassembler_new();
+  char a[1024], b[1024];
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+
+  // interleave the chunks of two messages
+  CMFFrame frame = {0, sizeof(a), TRUE, FALSE, 0, 1};
+  ck_assert(libcmf_reassembler_add(r, &frame, a) == NULL);
+  frame.id = 2;
+  ck_assert(libcmf_reassembler_add(r, &frame, b) == NULL);
+
+  frame.begin = FALSE;
+  frame.id = 1;
+  for (int i = 0; i < 8; i++) {
+    ck_assert(libcmf_reassembler_add(r, &frame, a) == NULL);
+  }
+
+  frame.end = TRUE;
+  frame.size = 10;
+  frame.id = 2;
+  CMFMessage *m = libcmf_reassembler_add(r, &frame, b);
+  ck_assert(m != NULL);
+  ck_assert(m->id == 2);
+  ck_assert(m->size == 1034);
+  ck_assert(m->buffer[0] == 'b' && m->buffer[1033] == 'b');
+  libcmf_message_free(m);
+
+  frame.id = 1;
+  m = libcmf_reassembler_add(r, &frame, a);
+  ck_assert(m != NULL);
+  ck_assert(m->size == 9 * 1024 + 10);
+  ck_assert(m->capacity >= m->size);
+  for (size_t i = 0; i < m->size; i++) {
+    ck_assert(m->buffer[i] == 'a');
+  }
+  libcmf_message_free(m);
+
+  ck_assert(g_hash_table_size(r->messages) == 0);
+
+  // a partial message is cleaned up with the reassembler
+  frame.end = FALSE;
+  frame.id = 3;
+  ck_assert(libcmf_reassembler_add(r, &frame, a) == NULL);
+  libcmf_reassembler_free(r);
+}
+
 Suite *cmf_suite(void) {
   Suite *s = suite_create("CMF Suite");
   TCase *tc = NULL;
 
   tc = tcase_create("Decode");
   tcase_add_test(tc, test_cmf_decode_header);
+  tcase_add_test(tc, test_cmf_index);
+  tcase_add_test(tc, test_cmf_index_chunks);
+  tcase_add_test(tc, test_cmf_index_malformed);
+  tcase_add_test(tc, test_cmf_reassemble);
   suite_add_tcase(s, tc);
 
   return s;
@@ -0,0 +1,162 @@
+#include "tests.h"
+
+#include "../libgaldr_single_flight.h"
+#include "../libballyhoo_deferred.h"
+
+// the order waiters ran in, tagged by their user_data, with
+//  upper case for callbacks and lower case for errbacks
+static GString *trace = NULL;
+
+// the lookups that were started
+static GPtrArray *lookups = NULL;
+
+static Deferred *lookup_func(GaldrAccount *ga, const char *key)
+{
+  if (g_str_equal(key, "none")) {
+    return NULL;
+  }
+
+  Deferred *d = libballyhoo_deferred_build(DEFAULT_TIMEOUT);
+  g_ptr_array_add(lookups, d);
+  return d;
+}
+
+static DeferredResponse waiter_cb(BallyhooAccount *ba, gpointer result, gpointer user_data)
+{
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+  g_string_append_c(trace, GPOINTER_TO_INT(result));
+  return libballyhoo_deferred_response(DEFERRED_RESPONSE, result);
+}
+
+static DeferredResponse waiter_err(BallyhooAccount *ba, gpointer fault, gpointer user_data)
+{
+  g_string_append_c(trace, g_ascii_tolower(GPOINTER_TO_INT(user_data)));
+  return libballyhoo_deferred_response(DEFERRED_FAULT, fault);
+}
+
+static void destroy_tag(gpointer user_data)
+{
+  g_string_append_c(trace, '-');
+  g_string_append_c(trace, GPOINTER_TO_INT(user_data));
+}
+
+static Deferred *wait_on(GaldrSingleFlight *sf, const char *key, char tag)
+{
+  Deferred *w = libgaldr_single_flight_get(sf, NULL, key);
+  libballyhoo_deferred_add_callbacks_notify(w, waiter_cb, waiter_err,
+                                            GINT_TO_POINTER(tag), destroy_tag);
+  return w;
+}
+
+static void free_lookups(void)
+{
+  for (guint i = 0; i < lookups->len; i++) {
+    libballyhoo_deferred_free(g_ptr_array_index(lookups, i));
+  }
+  g_ptr_array_free(lookups, TRUE);
+}
+
+START_TEST(test_galdr_single_flight_coalesce) {
+  trace = g_string_new(NULL);
+  lookups = g_ptr_array_new();
+  GaldrSingleFlight *sf = libgaldr_single_flight_new(lookup_func);
+
+  // only the first ask for a key starts a lookup
+  wait_on(sf, "a", 'A');
+  wait_on(sf, "b", 'B');
+  wait_on(sf, "a", 'C');
+  wait_on(sf, "a", 'D');
+  assert_int_equal(2, lookups->len);
+  assert_int_equal(2, g_hash_table_size(sf->flights));
+
+  // and everyone waiting on it runs in the order they asked
+  libballyhoo_deferred_callback(g_ptr_array_index(lookups, 0), NULL, GINT_TO_POINTER('x'));
+  assert_string_equal("AxCxDx", trace->str);
+  assert_int_equal(1, g_hash_table_size(sf->flights));
+
+  // once it's done, the next ask starts a new one
+  wait_on(sf, "a", 'E');
+  assert_int_equal(3, lookups->len);
+
+  g_string_truncate(trace, 0);
+  libballyhoo_deferred_callback(g_ptr_array_index(lookups, 1), NULL, GINT_TO_POINTER('y'));
+  libballyhoo_deferred_callback(g_ptr_array_index(lookups, 2), NULL, GINT_TO_POINTER('z'));
+  assert_string_equal("ByEz", trace->str);
+  assert_int_equal(0, g_hash_table_size(sf->flights));
+
+  free_lookups();
+  libgaldr_single_flight_free(sf);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_galdr_single_flight_fault) {
+  trace = g_string_new(NULL);
+  lookups = g_ptr_array_new();
+  GaldrSingleFlight *sf = libgaldr_single_flight_new(lookup_func);
+
+  // a failed lookup fails everyone waiting on it
+  wait_on(sf, "a", 'A');
+  wait_on(sf, "a", 'B');
+  libballyhoo_deferred_errback(g_ptr_array_index(lookups, 0), NULL, NULL);
+  assert_string_equal("ab", trace->str);
+  assert_int_equal(0, g_hash_table_size(sf->flights));
+
+  free_lookups();
+  libgaldr_single_flight_free(sf);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_galdr_single_flight_cancel) {
+  trace = g_string_new(NULL);
+  lookups = g_ptr_array_new();
+  GaldrSingleFlight *sf = libgaldr_single_flight_new(lookup_func);
+
+  // a cancelled lookup frees its waiters without running them
+  wait_on(sf, "a", 'A');
+  wait_on(sf, "a", 'B');
+  libballyhoo_deferred_cancel(NULL, g_ptr_array_index(lookups, 0));
+  assert_string_equal("-A-B", trace->str);
+  assert_int_equal(0, g_hash_table_size(sf->flights));
+
+  // so the key can be looked up again
+  g_string_truncate(trace, 0);
+  wait_on(sf, "a", 'C');
+  assert_int_equal(2, lookups->len);
+  libballyhoo_deferred_callback(g_ptr_array_index(lookups, 1), NULL, GINT_TO_POINTER('x'));
+  assert_string_equal("Cx", trace->str);
+
+  // and freeing a lookup on shutdown frees its waiters
+  g_string_truncate(trace, 0);
+  wait_on(sf, "b", 'D');
+  free_lookups();
+  assert_string_equal("-D", trace->str);
+
+  libgaldr_single_flight_free(sf);
+  g_string_free(trace, TRUE);
+}
+
+START_TEST(test_galdr_single_flight_no_lookup) {
+  lookups = g_ptr_array_new();
+  GaldrSingleFlight *sf = libgaldr_single_flight_new(lookup_func);
+
+  // a lookup that can't start leaves nothing in flight
+  ck_assert(libgaldr_single_flight_get(sf, NULL, "none") == NULL);
+  assert_int_equal(0, g_hash_table_size(sf->flights));
+
+  free_lookups();
+  libgaldr_single_flight_free(sf);
+}
+
+Suite *galdr_single_flight_suite(void) {
+  Suite *s = suite_create("GALDR_single_flight Suite");
+  TCase *tc = NULL;
+
+  tc = tcase_create("Lookups");
+  tcase_add_test(tc, test_galdr_single_flight_coalesce);
+  tcase_add_test(tc, test_galdr_single_flight_fault);
+  tcase_add_test(tc, test_galdr_single_flight_cancel);
+  tcase_add_test(tc, test_galdr_single_flight_no_lookup);
+  suite_add_tcase(s, tc);
+
+  return s;
+}
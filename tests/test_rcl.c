@@ -15,14 +15,18 @@ START_TEST(test_rcl_decode_header) {
   // seek past the first 8 bytes (cmf header)
   char *i = in + 8;
   
+  BallyhooSlice data = libballyhoo_slice_borrow(i, 680 - 8);
   RCLDecoded *rcl = g_new0(RCLDecoded, 1);
-  gboolean success = librcl_decode(i, 680 - 8, rcl);
+  gboolean success = librcl_decode(&data, rcl);
 
   ck_assert(success);
 
   ck_assert(rcl->uuid == 1);
   ck_assert(rcl->response == TRUE);
-  ck_assert(rcl->size == 656);
+  ck_assert(rcl->body.length == 656);
+
+  // the body points into the input, rather than a copy
+  ck_assert((const char*)rcl->body.data == i + 16);
   
   g_free(rcl);
 }
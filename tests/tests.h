@@ -10,6 +10,15 @@ Suite *cmf_suite(void);
 Suite *ballyhoo_message_suite(void);
 Suite *ballyhoo_deflate_suite(void);
 Suite *ballyhoo_xml_suite(void);
+Suite *ballyhoo_xml_stream_suite(void);
+Suite *ballyhoo_outmsg_suite(void);
+Suite *ballyhoo_helo_suite(void);
+Suite *ballyhoo_sched_suite(void);
+Suite *ballyhoo_timers_suite(void);
+Suite *ballyhoo_deferred_suite(void);
+Suite *ballyhoo_pending_suite(void);
+Suite *ballyhoo_ringbuf_suite(void);
+Suite *galdr_single_flight_suite(void);
 
 /* helper macros */
 #define assert_int_equal(expected, actual) { \